@@ -0,0 +1,46 @@
+/*
+ * A test of 1000 checks of the kind selected by CHECK_KIND: 0 for plain
+ * statements without any check, 1 for ASSERT_EQ, and 2 for EXPECT_EQ.  Built
+ * by assertion_size.sh, which compares the sizes of the resulting objects to
+ * find the code size of each kind of check.
+ */
+#include "../test.h"
+
+#ifndef CHECK_KIND
+#define CHECK_KIND 1
+#endif
+
+#if CHECK_KIND == 1
+#define CHECK ASSERT_EQ(T_ values[i], i, "%d"); i++;
+#elif CHECK_KIND == 2
+#define CHECK EXPECT_EQ(T_ values[i], i, "%d"); i++;
+#else
+#define CHECK DO_NOT_OPTIMIZE(T_ values[i]); i++;
+#endif
+
+#define CHECK_10 CHECK CHECK CHECK CHECK CHECK CHECK CHECK CHECK CHECK CHECK
+#define CHECK_100 CHECK_10 CHECK_10 CHECK_10 CHECK_10 CHECK_10 \
+                  CHECK_10 CHECK_10 CHECK_10 CHECK_10 CHECK_10
+#define CHECK_1000 CHECK_100 CHECK_100 CHECK_100 CHECK_100 CHECK_100 \
+                   CHECK_100 CHECK_100 CHECK_100 CHECK_100 CHECK_100
+
+int main(void) {
+    return 0;
+}
+
+#pragma FIXTURE_START
+
+FIXTURE(Size_fixture) {
+    int values[1000];
+};
+
+#pragma FIXTURE_END
+
+#pragma TEST_START
+
+TEST(Thousand_checks, Size_fixture) {
+    int i = 0;
+    CHECK_1000
+}
+
+#pragma TEST_END
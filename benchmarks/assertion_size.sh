@@ -0,0 +1,39 @@
+#!/bin/sh
+# Report the code size of 1000 ASSERT_EQ and 1000 EXPECT_EQ checks, as the
+# growth of an object file to which they are added, relative to one holding
+# 1000 plain statements.  The size of the .text section, which holds the code
+# run when checks pass, is given apart from the total, which includes the code
+# of the failure paths that compilers move to other sections.  Any arguments
+# are passed on to the compiler, which is taken from $CC:
+#
+#     CC=gcc benchmarks/assertion_size.sh -O2
+#
+# Requires the size utility of GNU binutils or LLVM.
+
+set -e
+CC=${CC:-cc}
+DIR=$(dirname "$0")
+OBJECT=${TMPDIR:-/tmp}/assertion_size.$$
+trap 'rm -f "$OBJECT".o' EXIT
+
+# Print the size of the .text section and the total size of the object built
+# with the specified arguments.
+size_of() {
+    "$CC" "$@" -c -o "$OBJECT.o" "$DIR/assertion_size.c"
+    size -A "$OBJECT.o" | awk '$1 == ".text" { text = $2 }
+                              $1 == "Total" { print text, $2 }'
+}
+
+# Print the growth from the sizes BASE to the sizes SIZES of the checks NAME.
+report() {
+    NAME=$1 SIZES=$2 BASE=$3
+    set -- $SIZES $BASE
+    echo "$NAME: $(($1 - $3)) bytes of .text, $(($2 - $4)) bytes in total" \
+         "per 1000 checks"
+}
+
+BASE=$(size_of -DCHECK_KIND=0 "$@")
+ASSERTS=$(size_of -DCHECK_KIND=1 "$@")
+EXPECTS=$(size_of -DCHECK_KIND=2 "$@")
+report ASSERT_EQ "$ASSERTS" "$BASE"
+report EXPECT_EQ "$EXPECTS" "$BASE"
@@ -0,0 +1,116 @@
+/*
+ * Throughput of test.h assertions in a hot loop.  Each benchmark checks every
+ * element of a buffer of 4096 integers, so the number of assertions per second
+ * is 4096 divided by the reported time per iteration, in seconds; the
+ * Plain_comparison benchmark gives the cost of the same loop without the
+ * framework for reference.  Build with optimisation and run with --bench:
+ *
+ *     cc -O2 -o assertions benchmarks/assertions.c && ./assertions --bench
+ *
+ * Save the results with --bench-save to catch regressions in later runs with
+ * --bench-baseline.
+ */
+#include "../test.h"
+
+/* The number of elements checked by each iteration of a benchmark. */
+#define BUFFER_LENGTH 4096
+
+int main(void) {
+    return 0;
+}
+
+#pragma FIXTURE_START
+
+FIXTURE(Buffer_fixture) {
+    int values[BUFFER_LENGTH];
+    int copy[BUFFER_LENGTH];
+    double samples[BUFFER_LENGTH];
+    double expected[BUFFER_LENGTH];
+    struct test_histogram latency;
+};
+
+FIXTURE_SETUP(Buffer_fixture) {
+    int i;
+    for (i = 0; i < BUFFER_LENGTH; i++) {
+        T_ values[i] = i;
+        T_ samples[i] = T_ expected[i] = i / 7.0;
+    }
+    memcpy(T_ copy, T_ values, sizeof(T_ copy));
+}
+
+#pragma FIXTURE_END
+
+#pragma TEST_START
+
+BENCHMARK(Plain_comparison, Buffer_fixture) {
+    int i, mismatches = 0;
+    CLOBBER_MEMORY();
+    for (i = 0; i < BUFFER_LENGTH; i++) {
+        mismatches += T_ values[i] != i;
+    }
+    DO_NOT_OPTIMIZE(mismatches);
+}
+
+BENCHMARK(ASSERT_EQ_per_element, Buffer_fixture) {
+    int i;
+    CLOBBER_MEMORY();
+    for (i = 0; i < BUFFER_LENGTH; i++) {
+        ASSERT_EQ(T_ values[i], i, "%d");
+    }
+}
+
+BENCHMARK(EXPECT_EQ_per_element, Buffer_fixture) {
+    int i;
+    CLOBBER_MEMORY();
+    for (i = 0; i < BUFFER_LENGTH; i++) {
+        EXPECT_EQ(T_ values[i], i, "%d");
+    }
+}
+
+BENCHMARK(ASSERT_STREQ_per_element, Buffer_fixture) {
+    static const char *const words[] = { "alpha", "beta", "gamma", "delta" };
+    int i;
+    CLOBBER_MEMORY();
+    for (i = 0; i < BUFFER_LENGTH; i++) {
+        ASSERT_STREQ(words[T_ values[i] & 3], words[i & 3]);
+    }
+}
+
+BENCHMARK(Plain_memcmp, Buffer_fixture) {
+    CLOBBER_MEMORY();
+    DO_NOT_OPTIMIZE(memcmp(T_ values, T_ copy, sizeof(T_ values)));
+}
+
+BENCHMARK(ASSERT_MEMEQ_whole_buffer, Buffer_fixture) {
+    CLOBBER_MEMORY();
+    ASSERT_MEMEQ(T_ values, T_ copy, sizeof(T_ values));
+}
+
+BENCHMARK(ASSERT_LE_per_sample, Buffer_fixture) {
+    int i;
+    CLOBBER_MEMORY();
+    for (i = 0; i < BUFFER_LENGTH; i++) {
+        ASSERT_LE(T_ samples[i] > T_ expected[i]
+                  ? T_ samples[i] - T_ expected[i]
+                  : T_ expected[i] - T_ samples[i], 1e-9, "%g");
+    }
+}
+
+BENCHMARK(ASSERT_ARRAY_NEAR_whole_buffer, Buffer_fixture) {
+    CLOBBER_MEMORY();
+    ASSERT_ARRAY_NEAR(T_ samples, T_ expected, BUFFER_LENGTH, 1e-9, 0);
+}
+
+BENCHMARK(ASSERT_ARRAY_ULP_whole_buffer, Buffer_fixture) {
+    CLOBBER_MEMORY();
+    ASSERT_ARRAY_ULP(T_ samples, T_ expected, BUFFER_LENGTH, 4);
+}
+
+BENCHMARK(MEASURE_LATENCY_per_element, Buffer_fixture) {
+    int i = 0;
+    MEASURE_LATENCY("element read", T_ latency, BUFFER_LENGTH) {
+        DO_NOT_OPTIMIZE(T_ values[i++]);
+    }
+}
+
+#pragma TEST_END
@@ -14,42 +14,56 @@
  * suite and you're off to the races.
  *
  * <code>test.h</code> makes use of some fairly arcane compiler features to
- * auto-register test and fixture lifecycle functions.  Its syntax and output
- * format are similar to those of the popular Google Test C++ testing framework
- * with no runtime overhead (what's a <code>malloc</code>?) and only a small
- * amount of boilerplate.
- *
- * Internally, <code>test.h</code> uses similar features of the PE (Portable
- * Executable) and ELF binary formats on Windows and all other common operating
- * systems, respectively.  For ELF, it makes use of ELF constructors, functions
- * referenced in the <code>.ctors</code> section of binaries that are run before
- * control is transferred to <code>_start</code> [<code>main()</code> in C].
- * Usually, these functions are used to perform shared library initialisation
- * tasks; however, in <code>test.h</code>, we take advantage of this feature of
- * the ELF format to automatically register tests to run before
+ * auto-register tests and run them without a single line of code in
+ * <code>main()</code>.  Its syntax and output format are similar to those of
+ * the popular Google Test C++ testing framework with no runtime overhead
+ * (what's a <code>malloc</code>?) and only a small amount of boilerplate.
+ *
+ * Internally, every <code>TEST</code>, <code>PCASE</code>, and
+ * <code>BENCHMARK</code> directive declares a constant descriptor of the test
+ * (its name, fixture, functions, fixture data size, and source location) and
+ * registers it in a static table of tests, which a single runner function
+ * walks once all tests are known.  How that table is assembled depends upon
+ * the binary format of the platform.  For ELF, a pointer to each descriptor
+ * is placed in a dedicated <code>test_h_cases</code> section, which the
+ * linker concatenates across the whole binary and whose bounds it
+ * exposes via the magic <code>__start_test_h_cases</code> and
+ * <code>__stop_test_h_cases</code> symbols: registering a test therefore costs
+ * no code at all at startup.  The runner itself is an ELF constructor, a
+ * function referenced in the <code>.init_array</code> (or <code>.ctors</code>)
+ * section of binaries that is run before control is transferred to
+ * <code>main()</code>.  Usually, these functions are used to perform shared
+ * library initialisation tasks; however, in <code>test.h</code>, we take
+ * advantage of this feature of the ELF format to run the test suite before
  * <code>main()</code>, in essence giving us the ability to run functions
  * without explicitly calling them.
  *
  * A similar trick is exploited on Windows, although it instead relies upon the
  * CRT initialisation facilities of the PE format and some quirks of the MSVC
- * preprocessor.  While GCC and Clang support the explicit ordering of
- * constructor functions, MSVC makes no such guarantee, os we instead use two
- * separate PE sections for test initialisation and registration.  The first,
- * <code>.CRT$XIU</code>, is normally used for the initialisation of static
- * objects in object-oriented programming languages; furthermore, it is one of
- * the first sections to which control is transferred in the Windows process
- * setup procedure.  This section is used to register fixture lifecycle
- * functions and is delimited by the pragmas <code>FIXTURE_START</code> and
- * <code>FIXTURE_END</code>, a syntactical convenience made possible by the fact
- * that MSVC's preprocessor performs macro substitution inside
- * <code>#pragma</code> directives.  Actual test functions are placed inside the
- * <code>.CRT$XCU</code> section, which is normally used for C runtime (CRT)
- * initialisation; since functions referenced in this section are run after
- * those in <code>.CRT$XIU</code>, this feature gives us the assurance that test
- * functions will only be run after their corresponding fixture lifecycle
- * functions have been registered.  This section is delimited by the pragmas
- * <code>TEST_START</code> and <code>TEST_END</code>, which are implemented
- * similarly to the fixture pragmas.
+ * preprocessor.  A tiny registration function for each test is placed inside
+ * the <code>.CRT$XCU</code> section, which is normally used for C runtime (CRT)
+ * initialisation, and appends the test's descriptor to the table.  The runner
+ * is placed in the <code>.CRT$XCY</code> section; since functions referenced in
+ * this section are run after those in <code>.CRT$XCU</code>, this gives us the
+ * assurance that the runner will only start once every test has registered
+ * itself.  Older versions of MSVC only allow data to be allocated in these
+ * sections following a matching <code>#pragma data_seg</code> declaration, a
+ * requirement made convenient by the fact that MSVC's preprocessor performs
+ * macro substitution inside <code>#pragma</code> directives: test declarations
+ * are delimited by the pragmas <code>TEST_START</code> and
+ * <code>TEST_END</code>, and fixture declarations by <code>FIXTURE_START</code>
+ * and <code>FIXTURE_END</code>.  Other platforms on which the linker does not
+ * assemble ELF sections, such as macOS, register tests using a constructor
+ * function per test, run before the runner.
+ *
+ * Each translation unit that includes <code>test.h</code> normally gets a
+ * private copy of the runner and of all of its state, and runs and reports only
+ * its own tests.  A test binary linking many test files together can instead
+ * define <code>TEST_MULTI_UNIT</code> in every unit and
+ * <code>TEST_IMPLEMENTATION</code> in exactly one, in the manner of the stb
+ * libraries: the state of the test run is then defined by that unit alone and
+ * merely declared by the others, and its runner runs the tests of every unit,
+ * with a single report and summary.
  *
  * As a result of these implementation details, the code in <code>test.h</code>
  * is <em>highly</em> compiler-dependent, but is stable on the most common
@@ -63,6 +77,10 @@
 #ifndef TEST_H_INCLUDED
 #define TEST_H_INCLUDED
 
+#include <errno.h>
+#include <float.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,6 +102,10 @@
 /* The maximum number of characters that may be in a test failure message. */
 #define _TEST_MAX_FAILURE_LENGTH 1024
 
+/* The maximum number of failed checks recorded for a single test, beyond which
+ * failures are only counted. */
+#define _TEST_MAX_FAILURES 100
+
 /**
  * Pragma to begin the executable portion of test files.  You should write this
  * pragma after you have declared all of your test fixtures and their lifecycle
@@ -143,9 +165,15 @@
  */
 #define FIXTURE_END
 
+/* Pragmas delimiting the definition of the test runner in this file.  Like
+ * the public pragmas above, these are no-ops everywhere but older MSVC. */
+#define _TEST_RUNNER_START
+#define _TEST_RUNNER_END
+
 /* PE sections in which test functions should be allocated. */
 #define _TEST_FIXTURE_SECTION ".CRT$XIU"
 #define _TEST_TEST_SECTION ".CRT$XCU"
+#define _TEST_RUNNER_SECTION ".CRT$XCY"
 
 #ifdef _MSC_VER
 
@@ -159,6 +187,7 @@
 #if _MSC_VER >= 1400
 #pragma section(_TEST_FIXTURE_SECTION, long, read)
 #pragma section(_TEST_TEST_SECTION, long, read)
+#pragma section(_TEST_RUNNER_SECTION, long, read)
 #endif // _MSC_VER >= 1400
 
 #if _MSC_VER < 1400
@@ -173,13 +202,14 @@
  * #pragma TEST_START
  * @endcode
  *
- * This pragma is necessary to ensure that your test functions are run once the
- * test executable is run.  In order to run tests before the <code>main()</code>
- * function on Windows, we place them in the PE section <code>.CRT$XCU</code>,
- * which is normally used to initialise the C Runtime Library (CRT), but which
- * we can repurpose for running tests out-of-line here.  Note that the code
- * snippet above is syntactically valid in MSVC, as it performs macro expansion
- * in pragma directives.
+ * This pragma is necessary to ensure that your tests are registered once the
+ * test executable is run.  In order to register tests before the
+ * <code>main()</code> function on Windows, we place their registration
+ * functions in the PE section <code>.CRT$XCU</code>, which is normally used to
+ * initialise the C Runtime Library (CRT), but which we can repurpose for
+ * building the table of tests here.  Note that the code snippet above is
+ * syntactically valid in MSVC, as it performs macro expansion in pragma
+ * directives.
  */
 #define TEST_START data_seg(_TEST_TEST_SECTION)
 
@@ -208,10 +238,10 @@
  * #pragma FIXTURE_START
  * @endcode
  *
- * This pragma is necessary to ensure that your fixture lifecycle functions are
- * run before any test functions by placing them in the <code>.CRT$XIU</code> PE
+ * This pragma keeps your fixture declarations in the <code>.CRT$XIU</code> PE
  * section, which is normally used for static initialisations in object-oriented
- * programming languages.
+ * programming languages, and thus apart from the test registration functions
+ * in <code>.CRT$XCU</code>.
  */
 #define FIXTURE_START data_seg(_TEST_FIXTURE_SECTION)
 
@@ -231,8 +261,16 @@
  * @see <code>TEST_END</code> for implementation details.
  */
 #define FIXTURE_END data_seg()
+
+#undef _TEST_RUNNER_START
+#define _TEST_RUNNER_START data_seg(_TEST_RUNNER_SECTION)
+#undef _TEST_RUNNER_END
+#define _TEST_RUNNER_END data_seg()
 #endif // _MSC_VER < 1400
 
+/* No attribute is supported to run a function before the runner on MSVC. */
+#define _TEST_REGISTRAR
+
 /* No attribute is supported to run a function before test functions on MSVC. */
 #define _TEST_FIXTURE_LIFECYCLE
 
@@ -246,6 +284,21 @@
  * doesn't really care about unused identifiers, so no harm done. */
 #define _TEST_UNUSED
 
+/* MSVC has no branch prediction hints, but it can at least keep the failure
+ * path of assertions out of line. */
+#define _TEST_UNLIKELY(CONDITION) (CONDITION)
+#if _MSC_VER >= 1300
+#define _TEST_COLD __declspec(noinline)
+#else
+#define _TEST_COLD
+#endif
+
+/* Storage class of variables of which every thread has a copy of its own. */
+#define _TEST_THREAD_LOCAL __declspec(thread)
+
+/* Functions that are only compiled into the units that call them. */
+#define _TEST_INLINE __inline
+
 /* Write an actual function pointer to the data segment to make the CRT run the
  * test function with the specified NAME. */
 #define _TEST_EPILOGUE(NAME, SECTION) \
@@ -267,6 +320,11 @@
 /* Multi-character newline for Windows. */
 #define _TEST_NEWLINE "\r\n"
 
+/* MSVC did not provide a C99-conforming vsnprintf until Visual Studio 2015. */
+#if _MSC_VER < 1900
+#define vsnprintf _vsnprintf
+#endif
+
 #else
 
 /* Disable "unknown pragma" warnings on GCC/Clang.  Allows the TEST_START and
@@ -274,7 +332,11 @@
 #pragma GCC diagnostic ignored "-Wunknown-pragmas"
 #pragma GCC diagnostic ignored "-Wattributes"
 
-/* Attribute to run a fixture setup redirection function on GCC/Clang. */
+/* Attribute to run a test registration function on GCC/Clang.  Only used on
+ * platforms without a linker-assembled test registry. */
+#define _TEST_REGISTRAR __attribute__((constructor(101)))
+
+/* Attribute to run a fixture lifecycle redirection function on GCC/Clang. */
 #define _TEST_FIXTURE_LIFECYCLE __attribute__((constructor(101)))
 
 /* Prefix for test function pointers.  Not really necessary for GCC/Clang, but
@@ -288,8 +350,26 @@
  * "-Wall -Werror" set. */
 #define _TEST_UNUSED __attribute__((unused))
 
-/* No epilogue is required on GCC/Clang, as _TEST_RUNNER ensures that tests will
- * be automatically run. */
+/* Hint that the specified condition, such as the failure of an assertion, is
+ * rarely true, so that the code for it is moved out of the way of the code
+ * that runs when it does not hold. */
+#define _TEST_UNLIKELY(CONDITION) __builtin_expect(!!(CONDITION), 0)
+
+/* Attribute for functions that are rarely called, like the failure path of
+ * assertions: never inlined, optimised for size, and placed apart from hot
+ * code. */
+#define _TEST_COLD __attribute__((noinline, cold))
+
+/* Storage class of variables of which every thread has a copy of its own. */
+#define _TEST_THREAD_LOCAL __thread
+
+/* Functions that are only compiled into the units that call them, even without
+ * optimisation. */
+#define _TEST_INLINE __inline__
+
+/* No epilogue is required on GCC/Clang, as _TEST_RUNNER and _TEST_REGISTRAR
+ * ensure that the runner and registration functions will be automatically
+ * run. */
 #define _TEST_EPILOGUE(NAME, SECTION)
 
 /* Colours for test output, as ANSI escape sequences. */
@@ -309,6 +389,359 @@
 
 #endif
 
+/* Whether the C library declares the POSIX interfaces used by the runner.  On
+ * Unix, it does unless the test suite is compiled in a strict ISO C mode, such
+ * as with -std=c99, without defining a feature test macro to ask for them;
+ * test.h never defines one itself, as that would change the declarations that
+ * the test suite sees.  macOS declares them in every mode. */
+#if defined(__APPLE__) \
+    || (defined(__unix__) \
+        && (!defined(__STRICT_ANSI__) || defined(_POSIX_C_SOURCE) \
+            || defined(_XOPEN_SOURCE) || defined(_DEFAULT_SOURCE) \
+            || defined(_BSD_SOURCE) || defined(_GNU_SOURCE)))
+#define _TEST_POSIX 1
+#endif
+
+/* Platforms on which tests can be run in parallel by forked worker processes
+ * that share a work queue in anonymous shared memory, and on which the data
+ * files of table-driven tests are mapped into memory rather than read. */
+#ifdef _TEST_POSIX
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(MAP_ANONYMOUS) || defined(MAP_ANON)
+#define _TEST_FORK 1
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+/* A watchdog timer interrupts tests that overrun their timeouts. */
+#include <setjmp.h>
+#include <sys/time.h>
+#ifdef ITIMER_REAL
+#define _TEST_WATCHDOG 1
+#endif
+#endif
+
+#ifdef __APPLE__
+#include <crt_externs.h>
+#endif
+
+/* Hardware performance counters are read with perf_event_open() on Linux,
+ * through syscall(), which the C library only declares along with its other
+ * extensions to POSIX: by default, or with _DEFAULT_SOURCE (_BSD_SOURCE with
+ * musl) or _GNU_SOURCE. */
+#if defined(__linux__) && defined(_TEST_POSIX) \
+    && (defined(_DEFAULT_SOURCE) || defined(_BSD_SOURCE) \
+        || defined(_GNU_SOURCE))
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef SYS_perf_event_open
+#define _TEST_PERF_EVENTS 1
+#endif
+#endif
+
+#ifdef _WIN32
+/* Keep windows.h from dragging in winsock.h, which would conflict with any
+ * later inclusion of winsock2.h by the test suite. */
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <windows.h>
+#endif
+#endif
+
+/* Platforms on which the bodies of threaded tests are run on threads of their
+ * own; elsewhere, their threads take turns on the main thread. */
+#ifdef _TEST_POSIX
+#include <pthread.h>
+#include <sched.h>
+#define _TEST_THREADS 1
+#define _TEST_YIELD() sched_yield()
+#elif defined(_WIN32)
+#define _TEST_THREADS 1
+#define _TEST_YIELD() SwitchToThread()
+#endif
+
+/* Atomic operations on the flags and counters, declared volatile long, that
+ * coordinate the threads of a threaded test.  Volatile accesses already have
+ * acquire and release semantics on MSVC. */
+#if defined(_MSC_VER)
+#define _TEST_ATOMIC_INCREMENT(VALUE) InterlockedIncrement(&(VALUE))
+#define _TEST_ATOMIC_DECREMENT(VALUE) InterlockedDecrement(&(VALUE))
+#define _TEST_ATOMIC_READ(VALUE) (VALUE)
+#define _TEST_ATOMIC_WRITE(VALUE, NEW) ((void) ((VALUE) = (NEW)))
+#elif defined(__GNUC__)
+#define _TEST_ATOMIC_INCREMENT(VALUE) __sync_add_and_fetch(&(VALUE), 1)
+#define _TEST_ATOMIC_DECREMENT(VALUE) __sync_sub_and_fetch(&(VALUE), 1)
+#ifdef __ATOMIC_ACQUIRE
+#define _TEST_ATOMIC_READ(VALUE) __atomic_load_n(&(VALUE), __ATOMIC_ACQUIRE)
+#define _TEST_ATOMIC_WRITE(VALUE, NEW) \
+    __atomic_store_n(&(VALUE), (NEW), __ATOMIC_RELEASE)
+#else
+#define _TEST_ATOMIC_READ(VALUE) (__sync_synchronize(), (VALUE))
+#define _TEST_ATOMIC_WRITE(VALUE, NEW) \
+    (__sync_synchronize(), (void) ((VALUE) = (NEW)))
+#endif
+#else
+#undef _TEST_THREADS
+#define _TEST_ATOMIC_INCREMENT(VALUE) (++(VALUE))
+#define _TEST_ATOMIC_DECREMENT(VALUE) (--(VALUE))
+#define _TEST_ATOMIC_READ(VALUE) (VALUE)
+#define _TEST_ATOMIC_WRITE(VALUE, NEW) ((void) ((VALUE) = (NEW)))
+#endif
+
+/* Whether the specified stdio stream is written to a terminal. */
+#ifdef _TEST_POSIX
+#define _TEST_ISATTY(STREAM) isatty(fileno(STREAM))
+#elif defined(_WIN32)
+#include <io.h>
+#define _TEST_ISATTY(STREAM) _isatty(_fileno(STREAM))
+#else
+#define _TEST_ISATTY(STREAM) 0
+#endif
+
+/* Manual poisoning of memory for AddressSanitizer, if it is enabled. */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define _TEST_ASAN 1
+#endif
+#elif defined(__SANITIZE_ADDRESS__)
+#define _TEST_ASAN 1
+#endif
+#ifdef _TEST_ASAN
+#include <sanitizer/asan_interface.h>
+#define _TEST_POISON(ADDRESS, SIZE) ASAN_POISON_MEMORY_REGION(ADDRESS, SIZE)
+#define _TEST_UNPOISON(ADDRESS, SIZE) \
+    ASAN_UNPOISON_MEMORY_REGION(ADDRESS, SIZE)
+#else
+#define _TEST_POISON(ADDRESS, SIZE) ((void) (ADDRESS), (void) (SIZE))
+#define _TEST_UNPOISON(ADDRESS, SIZE) ((void) (ADDRESS), (void) (SIZE))
+#endif
+
+/* Allocation accounting, which interposes the allocator of the whole program,
+ * is only compiled in on request, and only on Linux.  Sanitisers bring their
+ * own allocators, which cannot be interposed. */
+#if defined(TEST_COUNT_ALLOCATIONS) && defined(__linux__) \
+    && defined(_TEST_POSIX) && !defined(_TEST_ASAN) \
+    && !defined(__SANITIZE_THREAD__)
+#include <dlfcn.h>
+#include <malloc.h>
+/* The next definitions of the allocation functions are looked up with
+ * RTLD_NEXT, which glibc only declares with _GNU_SOURCE, but whose value is
+ * fixed by its ABI. */
+#if defined(RTLD_NEXT)
+#define _TEST_RTLD_NEXT RTLD_NEXT
+#elif defined(__GLIBC__)
+#define _TEST_RTLD_NEXT ((void *) -1l)
+#endif
+#ifdef _TEST_RTLD_NEXT
+#define _TEST_ALLOC_COUNTING 1
+#endif
+#endif
+
+/* A duration or point in time in nanoseconds.  MSVC did not support the long
+ * long type until Visual Studio .NET. */
+#if defined(_MSC_VER) && _MSC_VER < 1300
+typedef unsigned __int64 test_ns_t;
+#else
+typedef unsigned long long test_ns_t;
+#endif
+
+/* ELF linkers assemble the test registry for us from a dedicated section; all
+ * other platforms build it at startup using registration functions. */
+#if defined(__ELF__) && !defined(_MSC_VER)
+#define _TEST_LINKER_REGISTRY 1
+#endif
+
+/* A number that increases with each test declared in a translation unit,
+ * used to run tests in declaration order regardless of the layout of the
+ * registry. */
+#ifdef __COUNTER__
+#define _TEST_SEQUENCE __COUNTER__
+#else
+#define _TEST_SEQUENCE __LINE__
+#endif
+
+/* A test binary built from several translation units defines TEST_MULTI_UNIT
+ * in all of them and TEST_IMPLEMENTATION in exactly one, which holds the only
+ * copy of the state of the test run and the only runner, which runs the tests
+ * of every unit; the state is declared in the others, whose own copies of the
+ * functions used by tests all work on it.  Otherwise, each unit is a test
+ * suite of its own, with its own state and runner. */
+#if !defined(TEST_MULTI_UNIT)
+#define _TEST_SHARED static
+#define _TEST_HAS_RUNNER 1
+#elif defined(TEST_IMPLEMENTATION)
+#define _TEST_SHARED
+#define _TEST_HAS_RUNNER 1
+#else
+#define _TEST_SHARED extern
+#endif
+
+/* A test suite built with TEST_FUZZ defined is run by libFuzzer, which calls
+ * the entry point defined by the runner with each of its inputs, rather than
+ * by the runner before main(). */
+#ifdef TEST_FUZZ
+#undef _TEST_RUNNER
+#define _TEST_RUNNER _TEST_UNUSED
+#endif
+
+/* ***************************** TEST REGISTRY ****************************** */
+
+/**
+ * A test callback, be it a fixture lifecycle function or a test itself, taking
+ * the fixture data of the test and the shared state of its fixture.
+ */
+typedef void (*test_fn_t)(void *, const void *);
+
+/** A suite lifecycle callback, taking the shared state of its fixture. */
+typedef void (*test_suite_fn_t)(void *);
+
+/** Static description of a fixture, shared by all of the tests within it. */
+struct test_fixture {
+    const char *name;                       /**< The name of the fixture. */
+    const test_fn_t *setup;                 /**< The setup function, or NULL. */
+    const test_fn_t *teardown;              /**< Teardown function, or NULL. */
+    const test_suite_fn_t *suite_setup;     /**< Suite setup, or NULL. */
+    const test_suite_fn_t *suite_teardown;  /**< Suite teardown, or NULL. */
+    const unsigned long *shared_size;       /**< Size of the shared state. */
+};
+
+/** Static description of the rows of a table-driven test. */
+struct test_table {
+    unsigned long rows;  /**< The number of rows of a static array. */
+    const char *path;    /**< The file holding the rows, or NULL. */
+};
+
+/** Static description of a single test, as declared by TEST or PCASE. */
+struct test_case {
+    const char *name;                    /**< The name of the test. */
+    const struct test_fixture *fixture;  /**< The fixture of the test. */
+    test_fn_t case_setup;                /**< PCASE parameter setup, or NULL. */
+    test_fn_t test;                      /**< The body of the test. */
+    unsigned long data_size;             /**< Size of the fixture data. */
+    const char *file;                    /**< File in which it was declared. */
+    unsigned line;                       /**< Line on which it was declared. */
+    unsigned long sequence;              /**< Declaration order in the file. */
+    const void *unit;                    /**< Translation unit of the test. */
+    unsigned flags;                      /**< Kind of test (_TEST_* flags). */
+    const struct test_table *table;      /**< The rows of the test, or NULL. */
+};
+
+/* Flag for test descriptors that are benchmarks rather than plain tests. */
+#define _TEST_BENCHMARK 1
+/* Flag for the cases into which the runner expands the rows of a table. */
+#define _TEST_ROW 2
+/* Flag for test descriptors that are properties. */
+#define _TEST_PROPERTY 4
+/* Flag for test descriptors that are threaded tests. */
+#define _TEST_THREADED 8
+
+/**
+ * A case of a table-driven test for one of the rows of its table, created by
+ * the runner when the tests are collected.
+ */
+struct test_row {
+    struct test_case test_case;  /**< The test, named after the row. */
+    unsigned long index;         /**< The index of the row in the table. */
+    const char *line;            /**< The line of the data file, or NULL. */
+    unsigned long length;        /**< The length of the line. */
+};
+
+/** The case of a table-driven test being run, or NULL. */
+_TEST_SHARED const struct test_row *test_current_row;
+
+/* A marker whose address identifies the translation unit that included this
+ * file, allowing each unit to run only its own tests, and the tests of each
+ * unit to be kept together when one runner runs those of every unit. */
+static const char test_unit = 0;
+
+#ifdef _TEST_LINKER_REGISTRY
+
+/* Bounds of the test registry section, defined by the linker.  Declared weak so
+ * that a test suite without any tests still links. */
+extern const struct test_case *const __start_test_h_cases[]
+        __attribute__((weak));
+extern const struct test_case *const __stop_test_h_cases[]
+        __attribute__((weak));
+
+/* Bounds of the section in which each use of TEST_TIMEOUT_MS leaves a mark, so
+ * that the runner knows before the first test whether any test may time out.
+ * Empty, and both NULL, if the directive is never used. */
+extern const char __start_test_h_timeouts[] __attribute__((weak));
+extern const char __stop_test_h_timeouts[] __attribute__((weak));
+
+/* Place a pointer to the test descriptor DESC in the registry section. */
+#define _TEST_REGISTER(DESC)                                     \
+    static const struct test_case *const DESC ## _entry          \
+            __attribute__((used, section("test_h_cases"))) = &DESC;
+
+#else
+
+/** A link in the list of tests registered at startup. */
+struct test_node {
+    const struct test_case *test_case;  /**< The registered test. */
+    struct test_node *next;             /**< The next registered test. */
+};
+
+/* The list of tests registered at startup, in registration order. */
+_TEST_SHARED struct test_node *test_registry;
+_TEST_SHARED struct test_node **test_registry_tail;
+
+/**
+ * Append the specified test to the registry using the specified list node,
+ * which must have static storage duration.
+ *
+ * @param node The list node to hold the test.
+ * @param test_case The test to register.
+ */
+static void _TEST_UNUSED test_register(struct test_node *node,
+                                       const struct test_case *test_case) {
+    node->test_case = test_case;
+    node->next = NULL;
+    if (test_registry_tail == NULL) {
+        test_registry_tail = &test_registry;
+    }
+    *test_registry_tail = node;
+    test_registry_tail = &node->next;
+}
+
+/* Append the test descriptor DESC to the registry before the runner starts. */
+#define _TEST_REGISTER(DESC)                                         \
+    static struct test_node DESC ## _node;                           \
+    static int _TEST_REGISTRAR DESC ## _register(void) {             \
+        test_register(&DESC ## _node, &DESC);                        \
+        return 0;                                                    \
+    }                                                                \
+    /* Make the registration function run on Windows. */             \
+    _TEST_EPILOGUE(DESC ## _register, _TEST_TEST_SECTION)
+
+#endif
+
+/* Declare the descriptor ID for the test with the specified name string,
+ * fixture, case setup function, test function, flags, and table of rows, and
+ * add it to the registry.  The descriptor is constant so that older MSVC
+ * versions place it in read-only data rather than in the CRT section named by
+ * the TEST_START pragma. */
+#define _TEST_DECLARE(ID, NAME_STR, FIXTURE, CASE_SETUP, TEST_FN, FLAGS, \
+                      TABLE)                                             \
+    static const struct test_case ID = {                                 \
+        NAME_STR, &FIXTURE ## _fixture,                                  \
+        (test_fn_t) CASE_SETUP, (test_fn_t) TEST_FN,                     \
+        sizeof(struct FIXTURE ## _fixture_data),                         \
+        __FILE__, __LINE__, _TEST_SEQUENCE, &test_unit, FLAGS, TABLE     \
+    };                                                                   \
+    _TEST_REGISTER(ID)
+
 /* ***************************** TEST FIXTURES ****************************** */
 
 /**
@@ -343,28 +776,28 @@
  * Note that this directive must appear inside a <code>FIXTURE_START</code>,
  * <code>FIXTURE_END</code> block.
  */
-#define FIXTURE(NAME)                                                         \
-    struct NAME ## _fixture_data;                                             \
-    /* Declare stubs for fixture lifecycle functions.  Note that these functions
-     * will be automatically run on Windows, but since they're empty it doesn't
-     * really matter. */                                                      \
-    static void NAME ## _fixture_setup_stub                                   \
-            (struct NAME ## _fixture_data *TEST _TEST_UNUSED) {}              \
-    static void NAME ## _fixture_teardown_stub                                \
-            (struct NAME ## _fixture_data *TEST _TEST_UNUSED) {}              \
-    /* Use stubs as actual tasks unless overridden later.  Note that Windows
-     * throws a memory access violation if the pointers are directly assigned,
-     * so we have to do the assignment in separate functions.  Why does this
-     * happen?  Who knows. */                                                 \
-    static void (*NAME ## _fixture_setup)(struct NAME ## _fixture_data *)     \
-            _TEST_UNUSED = NAME ## _fixture_setup_stub;                       \
-    static void (*NAME ## _fixture_teardown)(struct NAME ## _fixture_data *)  \
-            _TEST_UNUSED;                                                     \
-    static int _TEST_FIXTURE_LIFECYCLE NAME ## _fixture_teardown_init(void) { \
-        NAME ## _fixture_teardown = NAME ## _fixture_teardown_stub;           \
-        return 0;                                                             \
-    }                                                                         \
-    _TEST_EPILOGUE(NAME ## _fixture_teardown_init, _TEST_FIXTURE_SECTION)     \
+#define FIXTURE(NAME)                                                      \
+    struct NAME ## _fixture_data;                                          \
+    /* Shared state is only defined if FIXTURE_SHARED is used, but pointers
+     * to it are passed to every lifecycle function. */                    \
+    struct NAME ## _fixture_shared;                                        \
+    /* Lifecycle functions start out NULL, to be pointed at the functions
+     * declared by FIXTURE_SETUP and FIXTURE_TEARDOWN, if they are used,
+     * before the runner starts.  They are left uninitialised so that older
+     * MSVC versions do not place them in the CRT section named by the
+     * FIXTURE_START pragma. */                                            \
+    static test_fn_t NAME ## _fixture_setup;                               \
+    static test_fn_t NAME ## _fixture_teardown;                            \
+    /* Likewise for the suite lifecycle, whose setup function also sets the
+     * size of the shared state. */                                        \
+    static test_suite_fn_t NAME ## _fixture_suite_setup;                   \
+    static test_suite_fn_t NAME ## _fixture_suite_teardown;                \
+    static unsigned long NAME ## _fixture_shared_size;                     \
+    static const struct test_fixture NAME ## _fixture _TEST_UNUSED = {     \
+        #NAME, &NAME ## _fixture_setup, &NAME ## _fixture_teardown,        \
+        &NAME ## _fixture_suite_setup, &NAME ## _fixture_suite_teardown,   \
+        &NAME ## _fixture_shared_size                                      \
+    };                                                                     \
     struct NAME ## _fixture_data
 
 /**
@@ -385,18 +818,22 @@
  * Note that this directive must appear inside a <code>FIXTURE_START</code>,
  * <code>FIXTURE_END</code> block.
  */
-#define FIXTURE_SETUP(NAME)                                                    \
-    /* Forward declaration of overridden implementation. */                    \
-    static void NAME ## _fixture_setup_impl(struct NAME ## _fixture_data *);   \
-    /* Assign new implementation to the setup pointer. */                      \
-    static int _TEST_FIXTURE_LIFECYCLE NAME ## _fixture_setup_override(void) { \
-        NAME ## _fixture_setup = NAME ## _fixture_setup_impl;                  \
-        return 0;                                                              \
-    }                                                                          \
-    /* Make the override function run on Windows. */                           \
-    _TEST_EPILOGUE(NAME ## _fixture_setup_override, _TEST_FIXTURE_SECTION)     \
-    static void NAME ## _fixture_setup_impl(                                   \
-            struct NAME ## _fixture_data *TEST _TEST_UNUSED)
+#define FIXTURE_SETUP(NAME)                                                  \
+    /* Forward declaration of overridden implementation. */                  \
+    static void NAME ## _fixture_setup_impl(                                 \
+            struct NAME ## _fixture_data *,                                  \
+            const struct NAME ## _fixture_shared *);                         \
+    /* Assign new implementation to the setup pointer. */                    \
+    static int _TEST_FIXTURE_LIFECYCLE                                       \
+    NAME ## _fixture_setup_override(void) {                                  \
+        NAME ## _fixture_setup = (test_fn_t) NAME ## _fixture_setup_impl;    \
+        return 0;                                                            \
+    }                                                                        \
+    /* Make the override function run on Windows. */                         \
+    _TEST_EPILOGUE(NAME ## _fixture_setup_override, _TEST_FIXTURE_SECTION)   \
+    static void NAME ## _fixture_setup_impl(                                 \
+            struct NAME ## _fixture_data *TEST _TEST_UNUSED,                 \
+            const struct NAME ## _fixture_shared *SHARED _TEST_UNUSED)
 
 /**
  * Declare a fixture teardown function for the fixture with the specified name.
@@ -414,426 +851,8138 @@
  * <code>FIXTURE_END</code> block.
  */
 #define FIXTURE_TEARDOWN(NAME)                                                 \
-    static void NAME ## _fixture_teardown_impl(struct NAME ## _fixture_data *);\
+    static void NAME ## _fixture_teardown_impl(                                \
+            struct NAME ## _fixture_data *,                                    \
+            const struct NAME ## _fixture_shared *);                           \
     static int _TEST_FIXTURE_LIFECYCLE                                         \
     NAME ## _fixture_teardown_override(void) {                                 \
-        NAME ## _fixture_teardown = NAME ## _fixture_teardown_impl;            \
+        NAME ## _fixture_teardown = (test_fn_t) NAME ## _fixture_teardown_impl;\
         return 0;                                                              \
     }                                                                          \
     _TEST_EPILOGUE(NAME ## _fixture_teardown_override, _TEST_FIXTURE_SECTION)  \
     static void NAME ## _fixture_teardown_impl(                                \
-            struct NAME ## _fixture_data *TEST _TEST_UNUSED)
+            struct NAME ## _fixture_data *TEST _TEST_UNUSED,                   \
+            const struct NAME ## _fixture_shared *SHARED _TEST_UNUSED)
+
+/**
+ * Declare the state shared by all of the tests in the fixture with the
+ * specified name, which is set up once for the fixture rather than once for
+ * every test, making it the place for data that is expensive to produce, such
+ * as a large input file loaded into memory.  Shared state is declared like the
+ * fixture data itself:
+ *
+ * @code{.c}
+ * FIXTURE_SHARED(Some_fixture) {
+ *     char *corpus;
+ *     unsigned long length;
+ * };
+ * @endcode
+ *
+ * The shared state starts out zeroed and is initialised by the function
+ * declared with <code>FIXTURE_SUITE_SETUP</code>, which must follow this
+ * directive.  Tests and the fixture setup and teardown functions may read it
+ * via the constant pointer <code>SHARED</code>, but may not modify it.  Note
+ * that this directive must appear inside a <code>FIXTURE_START</code>,
+ * <code>FIXTURE_END</code> block.
+ */
+#define FIXTURE_SHARED(NAME) struct NAME ## _fixture_shared
+
+/**
+ * Declare a suite setup function for the fixture with the specified name,
+ * which is run once before the first test of the fixture to initialise its
+ * shared state, available to the function via the pointer
+ * <code>SHARED</code>.  The shared state must already have been declared with
+ * the <code>FIXTURE_SHARED</code> directive, which may be <code>EMPTY</code>
+ * if the suite has no state of its own.  Example:
+ *
+ * @code{.c}
+ * FIXTURE_SUITE_SETUP(Some_fixture) {
+ *     SHARED->corpus = load_corpus("corpus.txt", &SHARED->length);
+ *     ASSERT_NON_NULL(SHARED->corpus);
+ * }
+ * @endcode
+ *
+ * If an assertion in the suite setup function fails, or it skips the suite
+ * with <code>SKIP_IF</code>, every test in the fixture is reported with that
+ * outcome without being run.  When tests are run in parallel, suites are set
+ * up by the runner before the workers are started, so that every worker shares
+ * the same state.  Note that this directive must appear inside a
+ * <code>FIXTURE_START</code>, <code>FIXTURE_END</code> block.
+ */
+#define FIXTURE_SUITE_SETUP(NAME)                                             \
+    static void NAME ## _fixture_suite_setup_impl(                            \
+            struct NAME ## _fixture_shared *);                                \
+    static int _TEST_FIXTURE_LIFECYCLE                                        \
+    NAME ## _fixture_suite_setup_override(void) {                             \
+        NAME ## _fixture_suite_setup =                                        \
+                (test_suite_fn_t) NAME ## _fixture_suite_setup_impl;          \
+        NAME ## _fixture_shared_size = sizeof(struct NAME ## _fixture_shared);\
+        return 0;                                                             \
+    }                                                                         \
+    _TEST_EPILOGUE(NAME ## _fixture_suite_setup_override,                     \
+                   _TEST_FIXTURE_SECTION)                                     \
+    static void NAME ## _fixture_suite_setup_impl(                            \
+            struct NAME ## _fixture_shared *SHARED _TEST_UNUSED)
+
+/**
+ * Declare a suite teardown function for the fixture with the specified name,
+ * which is run once after the last test of the fixture to release its shared
+ * state.  Example:
+ *
+ * @code{.c}
+ * FIXTURE_SUITE_TEARDOWN(Some_fixture) {
+ *     free(SHARED->corpus);
+ * }
+ * @endcode
+ *
+ * Note that this directive must appear inside a <code>FIXTURE_START</code>,
+ * <code>FIXTURE_END</code> block.
+ */
+#define FIXTURE_SUITE_TEARDOWN(NAME)                                          \
+    static void NAME ## _fixture_suite_teardown_impl(                         \
+            struct NAME ## _fixture_shared *);                                \
+    static int _TEST_FIXTURE_LIFECYCLE                                        \
+    NAME ## _fixture_suite_teardown_override(void) {                          \
+        NAME ## _fixture_suite_teardown =                                     \
+                (test_suite_fn_t) NAME ## _fixture_suite_teardown_impl;       \
+        return 0;                                                             \
+    }                                                                         \
+    _TEST_EPILOGUE(NAME ## _fixture_suite_teardown_override,                  \
+                   _TEST_FIXTURE_SECTION)                                     \
+    static void NAME ## _fixture_suite_teardown_impl(                         \
+            struct NAME ## _fixture_shared *SHARED _TEST_UNUSED)
 
 /* ******************************* TEST CORE ******************************** */
 
+/** Options controlling the test run, set from the environment and arguments. */
+struct test_options {
+    unsigned long jobs;  /**< Number of worker processes, 0 for one per CPU. */
+    const char *filter;  /**< Patterns selecting the tests to run, or NULL. */
+    int list;            /**< Whether to list the tests instead of running. */
+    int bench;           /**< Whether to measure benchmarks. */
+    test_ns_t bench_ns;  /**< Target duration of a benchmark repetition. */
+    unsigned long bench_repetitions;  /**< Repetitions of each benchmark. */
+    const char *bench_save;      /**< File to save benchmark results to. */
+    const char *bench_baseline;  /**< File to compare benchmarks against. */
+    double bench_threshold;      /**< Tolerated slowdown, in percent. */
+    const char *bench_tag;       /**< Build and host tag of saved results. */
+    const char *reporter;        /**< Name of the format of the report. */
+    const char *output;          /**< File to write the report to, or NULL. */
+    int quiet;                   /**< Whether to only report failures. */
+    int colour;                  /**< 1 to colour output, 0 not to, or -1 to
+                                      colour output written to terminals. */
+    int poison;                  /**< Whether to poison stale fixture data. */
+    test_ns_t timeout_ns;        /**< Default timeout of each test, or 0. */
+    int counters;                /**< Whether to count hardware events. */
+    int check_leaks;             /**< Whether to fail tests that leak. */
+    unsigned long shard_index;   /**< The shard of the tests to run. */
+    unsigned long shard_count;   /**< Number of shards, or 0 for none. */
+    char **merge;                /**< Reports to merge instead of running. */
+    int merge_count;             /**< The number of reports to merge. */
+    const char *history;         /**< File of the durations of past runs. */
+    int shuffle;                 /**< Whether to run tests in random order. */
+    unsigned long seed;          /**< Seed of the order of shuffled tests. */
+    const char *failed_file;     /**< File of the tests that last failed. */
+    int failed_first;            /**< Whether to run those tests first. */
+    int last_failed;             /**< Whether to run only those tests. */
+    unsigned long property_cases;  /**< Cases generated per property. */
+    unsigned long property_seed;   /**< Seed of the cases of properties. */
+    unsigned long property_jobs;   /**< Processes per property, 0 per CPU. */
+};
+
+/** The options of the current test run. */
+_TEST_SHARED struct test_options test_options;
+
 /** The number of tests in this test suite that have passed. */
-static unsigned long test_passed_tests = 0;
+_TEST_SHARED unsigned long test_passed_tests;
 /** The number of tests in this test suite that have failed. */
-static unsigned long test_failed_tests = 0;
+_TEST_SHARED unsigned long test_failed_tests;
 /** The number of tests in this test suite that were skipped. */
-static unsigned long test_skipped_tests = 0;
+_TEST_SHARED unsigned long test_skipped_tests;
 
-/** The failure message for the most recently failed assertion. */
-static char test_failure_message[_TEST_MAX_FAILURE_LENGTH];
+/** The reason for which the last test was skipped, or failed other than by an
+ * assertion (for instance, by crashing its worker process). */
+_TEST_SHARED char test_failure_message[_TEST_MAX_FAILURE_LENGTH];
+
+/** A failed assertion or expectation, recorded for the reporters. */
+struct test_failure {
+    const char *file;        /**< Source file of the check. */
+    unsigned line;           /**< Source line of the check. */
+    const char *expression;  /**< Description of the failed check. */
+    int fatal;               /**< Whether the check ended the test. */
+    unsigned long value_1;   /**< Offset of the first value in the text. */
+    unsigned long value_2;   /**< Offset of the second value in the text. */
+};
+
+/* The checks that failed in the last test, in the order in which they failed,
+ * and the number of further failures that were not recorded. */
+_TEST_SHARED struct test_failure *test_failures;
+_TEST_SHARED unsigned long test_failure_count;
+_TEST_SHARED unsigned long test_failure_capacity;
+_TEST_SHARED unsigned long test_failures_omitted;
+
+/* The formatted values of the failed checks of the last test, which are only
+ * formatted once a check has failed. */
+_TEST_SHARED char *test_failure_text;
+_TEST_SHARED unsigned long test_failure_text_length;
+_TEST_SHARED unsigned long test_failure_text_capacity;
 
 /** Return codes for test functions indicating their final statuses. */
 enum test_status {
     TEST_PASSED,     /**< The test passed with no failing assertions. */
     TEST_FAILED,     /**< The test failed because of a failing assertion. */
     TEST_SKIPPED,    /**< The test was skipped. */
+    TEST_TIMED_OUT,  /**< The test was interrupted by its timeout. */
 };
 
 /** The exit status of the last test run. */
-static enum test_status test_last_status;
+_TEST_SHARED enum test_status test_last_status;
+
+/** Counts of hardware events, or negative for events that were not counted. */
+struct test_counters {
+    double cycles;         /**< CPU cycles. */
+    double instructions;   /**< Instructions retired. */
+    double l1d_misses;     /**< Level 1 data cache read misses. */
+    double cache_misses;   /**< Last-level cache misses. */
+    double branch_misses;  /**< Mispredicted branches. */
+};
+
+/* The number of hardware events counted. */
+#define _TEST_COUNTER_EVENTS 5
+
+/* The name of each hardware event counted, and the offset of its count within
+ * struct test_counters. */
+static const struct {
+    const char *name;
+    size_t offset;
+} test_counter_fields[_TEST_COUNTER_EVENTS] = {
+    {"cycles", offsetof(struct test_counters, cycles)},
+    {"instructions", offsetof(struct test_counters, instructions)},
+    {"l1d_misses", offsetof(struct test_counters, l1d_misses)},
+    {"cache_misses", offsetof(struct test_counters, cache_misses)},
+    {"branch_misses", offsetof(struct test_counters, branch_misses)}
+};
+
+/* The count of the hardware event with the specified index in the specified
+ * struct test_counters. */
+#define _TEST_COUNTER(COUNTERS, INDEX) \
+    (*(double *) ((char *) (COUNTERS) + test_counter_fields[INDEX].offset))
 
-/** A test callback, be it a fixture lifecycle function or a test itself. */
-typedef void (*test_fn_t)(void *);
+/** The outcome of a single test run, as reported by the test runner. */
+struct test_result {
+    const struct test_case *test_case;  /**< The test that was run. */
+    enum test_status status;            /**< The final status of the test. */
+    test_ns_t setup_ns;                 /**< Wall time spent in setup. */
+    test_ns_t body_ns;                  /**< Wall time spent in the test. */
+    test_ns_t teardown_ns;              /**< Wall time spent in teardown. */
+    test_ns_t cpu_ns;                   /**< CPU time spent in the test. */
+    unsigned long allocations;          /**< Calls to the allocator. */
+    unsigned long allocated_bytes;      /**< Bytes requested from it. */
+    int counted;                        /**< Whether events were counted. */
+    struct test_counters counters;      /**< Events counted in the test. */
+    test_ns_t timeout_ns;               /**< The timeout that it overran. */
+};
 
-/* printf arguments for the runtime details of the current test. */
-#define _TEST_DIAGNOSTICS                                               \
-    _TEST_COLOUR_RUNTIME " (%7.3f/%3lus)" _TEST_COLOUR_RESET " %s"      \
-    _TEST_NEWLINE, (double) (end_clock - start_clock) / CLOCKS_PER_SEC, \
-    (unsigned long) difftime(end_time, start_time), name
+/* The allocations made by the current test: the number of calls to the
+ * allocator and the bytes requested from it, and the net number of blocks and
+ * usable bytes that it has yet to free.  They are only counted while
+ * <code>test_alloc_counting</code> is set, that is, while the lifecycle of a
+ * test is running, so that the runner's own allocations are left out. */
+_TEST_SHARED unsigned long test_alloc_calls;
+_TEST_SHARED unsigned long test_alloc_bytes;
+_TEST_SHARED long test_alloc_blocks;
+_TEST_SHARED long test_alloc_live_bytes;
+_TEST_SHARED volatile int test_alloc_counting;
 
 /**
- * Main test runner function.  Runs the test with the specified name,
- * additionally running the specified setup and teardown functions before and
- * after the main test function, respectively.
+ * Resize a block of memory belonging to the runner, leaving the allocation out
+ * of the accounting of the current test.
  *
- * @param name The name of the test to run.
- * @param setup_fn The fixture setup function for the test.
- * @param test_fn The main test function, containing the code under test and any
- *                assertions used to determine the test status.
- * @param teardown_fn The fixture teardown function for the test.
- * @param data_size The size in bytes of the data struct for the fixture to
- *                  which the test being run belongs.
+ * @param block The block to resize, or NULL.
+ * @param size The new size of the block.
+ * @return The resized block, or NULL if it could not be resized.
  */
-static void test_run(char *name, test_fn_t setup_fn, test_fn_t test_fn,
-                     test_fn_t teardown_fn, unsigned long data_size) {
-    /* We want to measure both CPU time and wall-clock time. */
-    clock_t start_clock, end_clock;
-    time_t start_time, end_time;
+static void *test_runner_realloc(void *block, size_t size) {
+    int counting = test_alloc_counting;
+    void *grown;
 
-    /* Initial setup for test run. */
-    void *test_data = malloc(data_size);
-    setup_fn(test_data);
+    test_alloc_counting = 0;
+    grown = realloc(block, size);
+    test_alloc_counting = counting;
+    return grown;
+}
 
-    /* Run the test and store its return status. */
-    printf(_TEST_COLOUR_START "[ START      ]" _TEST_COLOUR_RESET " %s",
-           name);
-    test_last_status = TEST_PASSED;
-    start_time = time(NULL);
-    start_clock = clock();
-    test_fn(test_data);
-    end_time = time(NULL);
-    end_clock = clock();
+/**
+ * Free a block of memory belonging to the runner, leaving it out of the
+ * accounting of the current test.
+ *
+ * @param block The block to free, or NULL.
+ */
+static _TEST_UNUSED void test_runner_free(void *block) {
+    int counting = test_alloc_counting;
+    test_alloc_counting = 0;
+    free(block);
+    test_alloc_counting = counting;
+}
 
-    /* Print results depending on the test function return status. */
-    switch (test_last_status) {
-        case TEST_PASSED: {
-            test_passed_tests++;
-            printf(_TEST_COLOUR_PASS "\r[       PASS ]" _TEST_DIAGNOSTICS);
-            break;
-        } case TEST_SKIPPED: {
-            test_skipped_tests++;
-            printf(_TEST_COLOUR_SKIP "\r[       SKIP ]" _TEST_COLOUR_MUTE
-                   " %s: %s" _TEST_COLOUR_RESET _TEST_NEWLINE, name,
-                   test_failure_message);
-            break;
-        } case TEST_FAILED: {
-            test_failed_tests++;
-            printf(_TEST_NEWLINE);
-            puts(test_failure_message);
-            printf(_TEST_COLOUR_FAIL "[       FAIL ]" _TEST_DIAGNOSTICS);
-            break;
-        } default: {
-            /* This branch should never run. */
-            break;
+/** Forget the failed checks of the previous test. */
+static void test_reset_failures(void) {
+    test_failure_count = test_failures_omitted = test_failure_text_length = 0;
+    test_failure_message[0] = '\0';
+}
+
+/* The most threads on which the body of a threaded test can be run. */
+#define _TEST_MAX_THREADS 256
+
+/** A thread running the body of a threaded test, and how far it got. */
+struct test_thread {
+    unsigned index;            /**< The index of the thread, from 0. */
+    unsigned long iterations;  /**< Iterations of the body completed. */
+    test_ns_t elapsed_ns;      /**< Time from the start until it stopped. */
+    unsigned long failures;    /**< Checks that failed on the thread. */
+#if defined(_TEST_THREADS) && defined(_WIN32)
+    HANDLE handle;             /**< The thread, once it has been created. */
+#elif defined(_TEST_THREADS)
+    pthread_t handle;          /**< The thread, once it has been created. */
+#endif
+};
+
+/** The run of a threaded test, shared by all of its threads. */
+struct test_threads {
+    int measured;                /**< Whether the threads of the test ran. */
+    unsigned count;              /**< The number of threads. */
+    test_fn_t body;              /**< The body of the test. */
+    void *data;                  /**< The fixture data of the test. */
+    const void *shared;          /**< The shared state of its fixture. */
+    unsigned long iterations;    /**< Iterations per thread, or 0 if timed. */
+    test_ns_t duration_ns;       /**< How long timed threads run for. */
+    test_ns_t start_ns;          /**< When the threads were released. */
+    unsigned joinable;           /**< Threads created but not yet joined. */
+    unsigned failed_thread;      /**< The thread that failed first. */
+    volatile long ready;         /**< Threads waiting to be released. */
+    volatile long go;            /**< Whether the threads were released. */
+    volatile long stop;          /**< Whether the threads are to stop. */
+    volatile long running;       /**< Threads that have yet to stop. */
+    volatile long failures;      /**< Checks that failed on any thread. */
+    struct test_thread threads[_TEST_MAX_THREADS];  /**< Every thread. */
+};
+
+/** The run of the last threaded test. */
+_TEST_SHARED struct test_threads test_last_threads;
+
+/** The thread of a threaded test that is running on the calling thread, or
+ * NULL on the runner's own thread. */
+_TEST_SHARED _TEST_THREAD_LOCAL struct test_thread *test_current_thread;
+
+/**
+ * Account for a check that failed on a thread of a threaded test.  Only the
+ * first failure on any thread is recorded, by the thread that made it, so
+ * that the threads never race on the record of failures; the rest are merely
+ * counted.  A fatal failure stops every thread after its current iteration.
+ *
+ * @param fatal Whether the failure ends the test.
+ * @return Nonzero if the failure is the first, and is to be recorded.
+ */
+static int test_thread_failed(int fatal) {
+    test_current_thread->failures++;
+    if (fatal) {
+        _TEST_ATOMIC_WRITE(test_last_threads.stop, 1);
+    }
+    if (_TEST_ATOMIC_INCREMENT(test_last_threads.failures) != 1) {
+        return 0;
+    }
+    test_last_threads.failed_thread = test_current_thread->index;
+    return 1;
+}
+
+/**
+ * Record a failed check, marking the current test as failed.  Called out of
+ * line by the assertion and expectation directives, so that the comparison is
+ * the only code compiled into every check, and marked cold so that the call
+ * itself is moved out of the loops in which checks are made.  The values are
+ * formatted into the failure text, which grows as needed, so long values are
+ * never truncated.
+ *
+ * @param file The source file of the check.
+ * @param line The source line of the check.
+ * @param expression A description of the check.
+ * @param fatal Whether the failure ends the test.
+ * @param format_1 The printf format of the first value.
+ * @param format_2 The printf format of the second value.
+ * @param ... The first and second values.
+ */
+static _TEST_COLD void _TEST_UNUSED test_record_failure(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const char *format_1, const char *format_2, ...) {
+    struct test_failure *failure;
+    char format[128], *grown;
+    unsigned long available;
+    va_list args;
+    int written_1, written;
+
+    if (test_current_thread != NULL && !test_thread_failed(fatal)) {
+        return;
+    }
+    test_last_status = TEST_FAILED;
+    if (test_failure_count == _TEST_MAX_FAILURES) {
+        test_failures_omitted++;
+        return;
+    } else if (test_failure_count == test_failure_capacity) {
+        failure = (struct test_failure *) test_runner_realloc(
+                test_failures,
+                (test_failure_capacity * 2 + 8) * sizeof(*test_failures));
+        if (failure == NULL) {
+            test_failures_omitted++;
+            return;
         }
+        test_failures = failure;
+        test_failure_capacity = test_failure_capacity * 2 + 8;
     }
 
-    /* Test completed: tear down the test environment. */
-    teardown_fn(test_data);
-    free(test_data);
+    /* The arguments can only be consumed in order, so the second value cannot
+     * be formatted on its own.  Instead, the first value is formatted into a
+     * slot of its own, and both values into the next slot, in which the
+     * second value starts where the first one ends.  The values may hold any
+     * character, as neither is split from the other by searching for one. */
+    if (strlen(format_1) + strlen(format_2) + 1 > sizeof(format)) {
+        format_1 = format_2 = "(unprintable)";
+    }
+    sprintf(format, "%s%s", format_1, format_2);
+    for (;;) {
+        available = test_failure_text_capacity - test_failure_text_length;
+        if (available > 2) {
+            va_start(args, format_2);
+            written_1 = vsnprintf(test_failure_text + test_failure_text_length,
+                                  available, format_1, args);
+            va_end(args);
+            if (written_1 >= 0 && (unsigned long) written_1 + 2 < available) {
+                available -= written_1 + 1;
+                va_start(args, format_2);
+                written = vsnprintf(test_failure_text + test_failure_text_length
+                                    + written_1 + 1, available, format, args);
+                va_end(args);
+                if (written >= written_1
+                    && (unsigned long) written < available) {
+                    break;
+                }
+            }
+        }
+        grown = (char *) test_runner_realloc(
+                test_failure_text, test_failure_text_capacity * 2 + 1024);
+        if (grown == NULL) {
+            test_failures_omitted++;
+            return;
+        }
+        test_failure_text = grown;
+        test_failure_text_capacity = test_failure_text_capacity * 2 + 1024;
+    }
+
+    failure = &test_failures[test_failure_count++];
+    failure->file = file;
+    failure->line = line;
+    failure->expression = expression;
+    failure->fatal = fatal;
+    failure->value_1 = test_failure_text_length;
+    failure->value_2 = test_failure_text_length + 2 * written_1 + 1;
+    test_failure_text_length += written_1 + 1 + written + 1;
 }
 
+/* The maximum number of repetitions of a benchmark that are recorded. */
+#define _TEST_MAX_REPETITIONS 1000
+
+/** Measurements of a benchmark, as nanoseconds per iteration of its body. */
+struct test_benchmark {
+    int measured;                /**< Whether the benchmark was measured. */
+    unsigned long iterations;    /**< Iterations per repetition. */
+    unsigned long repetitions;   /**< Number of repetitions measured. */
+    double samples[_TEST_MAX_REPETITIONS];  /**< Time of each repetition. */
+    double min;                  /**< Fastest repetition. */
+    double median;               /**< Median repetition. */
+    double mean;                 /**< Mean of all repetitions. */
+    double stddev;               /**< Sample standard deviation. */
+    double p99;                  /**< 99th percentile repetition. */
+    int compared;                /**< Whether a baseline was compared. */
+    double baseline_median;      /**< Median repetition of the baseline. */
+    double change;               /**< Change in median, in percent. */
+    double z;                    /**< Mann-Whitney test statistic. */
+    const char *baseline_tag;    /**< Build and host of the baseline. */
+    int counted;                 /**< Whether events were counted. */
+    struct test_counters counters;  /**< Events counted per iteration. */
+};
+
+/** The measurements of the last benchmark run. */
+_TEST_SHARED struct test_benchmark test_last_benchmark;
+
+/* The most distributions of latencies reported for a single test. */
+#define _TEST_MAX_LATENCIES 8
+
+/* The number of columns of the table of a distribution of latencies. */
+#define _TEST_LATENCY_COLUMNS 6
+
+/* The name of each column of the table of a distribution of latencies, and the
+ * percentile of the latencies given in it. */
+static const struct {
+    const char *name;
+    double percentile;
+} test_latency_columns[_TEST_LATENCY_COLUMNS] = {
+    {"min", 0}, {"p50", 50}, {"p90", 90}, {"p99", 99}, {"p99.9", 99.9},
+    {"max", 100}
+};
+
+/** The distribution of the latencies measured by a MEASURE_LATENCY block. */
+struct test_latency {
+    const char *name;      /**< What was measured, as named by the block. */
+    const char *file;      /**< Source file of the block. */
+    unsigned line;         /**< Source line of the block. */
+    unsigned long samples;                   /**< Latencies measured. */
+    test_ns_t columns[_TEST_LATENCY_COLUMNS];  /**< Latency at each column. */
+    double mean;                             /**< Mean latency. */
+};
+
+/* The distributions of latencies measured by the last test, one for each
+ * MEASURE_LATENCY block that it ran. */
+_TEST_SHARED struct test_latency test_latencies[_TEST_MAX_LATENCIES];
+_TEST_SHARED unsigned test_latency_count;
+
 /**
- * Declare a test with the specified name, belonging to the specified fixture.
- * The fixture must have been declared with the <code>FIXTURE</code> directive
- * prior to the test.  For each test, the fixture setup function will be run
- * first, then the body of the test as specified after this directive, then
- * finally the fixture teardown function will be run to conclude the test.  All
- * tests should, but are not required to, contain at least one assertion, a
- * statement that contains one of the <code>ASSERT_*</code> directives.  Like
- * test setup and teardown functions, tests are declared with a syntax very
- * similar to standard C functions, as follows:
- *
- * @code{.c}
- * TEST(Example_test, Some_fixture) {
- *     ASSERT_NON_NULL(TEST->message);
- *     strcpy(TEST->message, "Hello!");
- *     ASSERT_STREQ(TEST->message, "Hello!");
- *     ASSERT_EQ(strlen(TEST->message), 6);
- * }
- * @endcode
+ * Read a monotonic clock with the highest resolution available.
  *
- * As shown above, the data members of a test's fixture are made available via
- * the pointer <code>TEST</code>, as in the fixture functions.  Furthermore,
- * note that tests that contain multiple assertions will be terminated
- * immediately once any assertion fails.  This directive must be written within
- * a <code>TEST_START</code>, <code>TEST_END</code> block.
+ * @return The current time in nanoseconds since an arbitrary epoch.
  */
-#define TEST(NAME, FIXTURE)                                                \
-    /* Forward declare test function to allow standard function syntax. */ \
-    static void                                                            \
-    FIXTURE ## _ ## NAME ## _test(struct FIXTURE ## _fixture_data *);      \
-    /* Actual test function: calls the user-defined test function. */      \
-    static int _TEST_RUNNER FIXTURE ## _ ## NAME ## _test_run(void) {      \
-        test_run(#NAME,                                                    \
-        (test_fn_t) FIXTURE ## _fixture_setup,                             \
-        (test_fn_t) FIXTURE ## _ ## NAME ## _test,                         \
-        (test_fn_t) FIXTURE ## _fixture_teardown,                          \
-        sizeof(struct FIXTURE ## _fixture_data));                          \
-        return 0;                                                          \
-    }                                                                      \
-    /* Make the test function run on Windows. */                           \
-    _TEST_EPILOGUE(FIXTURE ## _ ## NAME ## _test_run, _TEST_TEST_SECTION)  \
-    /* And finally, the user-declared test function. */                    \
-    static void FIXTURE ## _ ## NAME ## _test(                             \
-        struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED)
+static test_ns_t test_clock_ns(void) {
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    /* Split the conversion to avoid overflowing 64 bits. */
+    return (test_ns_t) (counter.QuadPart / frequency.QuadPart) * 1000000000
+           + (test_ns_t) (counter.QuadPart % frequency.QuadPart) * 1000000000
+             / frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (test_ns_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    return (test_ns_t) time(NULL) * 1000000000;
+#endif
+}
 
-/** Shorthand for fixture data member access.  Save yourself some typing! */
-#define T_ TEST ->
+#ifdef _TEST_HAS_RUNNER
+/**
+ * Read the CPU time consumed by the calling thread with the highest resolution
+ * available.
+ *
+ * @return The CPU time of the thread in nanoseconds.
+ */
+static test_ns_t test_cpu_clock_ns(void) {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    /* FILETIMEs are measured in units of 100 nanoseconds. */
+    return ((((test_ns_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime)
+            + (((test_ns_t) user.dwHighDateTime << 32) | user.dwLowDateTime))
+           * 100;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (test_ns_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    return (test_ns_t) clock() * 1000000000 / CLOCKS_PER_SEC;
+#endif
+}
 
 /**
- * Declare the common test function for a parameterised test with the specified
- * name, belonging to the specified fixture.  Unlike tests declared with the
- * <code>TEST</code> directive, this function will not be run simply as a result
- * of the <code>PTEST</code> directive, but must be followed by
- * <code>PCASE</code> directives that specify the parameters for each test to be
- * run.  These directives should be combined as follows:
+ * Format the specified duration with three significant decimals in the most
+ * appropriate unit, right-aligned in 10 characters.
  *
- * @code{.c}
+ * @param ns The duration in nanoseconds.
+ * @param buffer A buffer of at least 16 characters to which to write.
+ * @return The buffer.
+ */
+static char *test_format_duration(test_ns_t ns, char *buffer) {
+    if (ns < 1000) {
+        sprintf(buffer, "%7lu ns", (unsigned long) ns);
+    } else if (ns < 1000000) {
+        sprintf(buffer, "%7.3f us", (double) ns / 1e3);
+    } else if (ns < 1000000000) {
+        sprintf(buffer, "%7.3f ms", (double) ns / 1e6);
+    } else {
+        sprintf(buffer, "%7.3f s ", (double) ns / 1e9);
+    }
+    return buffer;
+}
+
+/**
+ * Format the rate at which the specified number of events happened in the
+ * specified duration with one decimal and a metric prefix, like "12.3M/s".
+ *
+ * @param count The number of events.
+ * @param ns The duration in nanoseconds.
+ * @param buffer A buffer of at least 32 characters to which to write.
+ * @return The buffer.
+ */
+static char *test_format_rate(double count, test_ns_t ns, char *buffer) {
+    static const char *const prefixes[] = {"", "k", "M", "G", "T"};
+    double rate = count * 1e9 / (double) (ns > 0 ? ns : 1);
+    int prefix = 0;
+
+    while (rate >= 999.95 && prefix < 4) {
+        rate /= 1000;
+        prefix++;
+    }
+    sprintf(buffer, "%.1f%s/s", rate, prefixes[prefix]);
+    return buffer;
+}
+#endif
+
+/* Alignment of fixture data: the size of a cache line on common processors. */
+#define _TEST_ARENA_ALIGNMENT 64
+
+/* Byte with which fixture data is overwritten after each test in poisoning
+ * mode, so that stale pointers to it read conspicuous garbage. */
+#define _TEST_POISON_BYTE 0xA5
+
+/* Storage for the fixture data of the test being run, shared by every test run
+ * by this process and sized for the largest fixture among them. */
+_TEST_SHARED unsigned char *test_arena;
+_TEST_SHARED unsigned long test_arena_size;
+_TEST_SHARED void *test_arena_allocation;
+
+#ifdef _TEST_HAS_RUNNER
+/**
+ * Allocate the fixture data arena with room for the specified number of bytes,
+ * aligned to a cache line.
+ *
+ * @param size The size of the largest fixture data of the tests to be run.
+ * @return Nonzero if the arena was allocated, or 0 if it was not.
+ */
+static int test_arena_reserve(unsigned long size) {
+    unsigned long misalignment;
+
+    size = (size + _TEST_ARENA_ALIGNMENT - 1) / _TEST_ARENA_ALIGNMENT
+           * _TEST_ARENA_ALIGNMENT;
+    test_arena_allocation = malloc(size + _TEST_ARENA_ALIGNMENT);
+    if (test_arena_allocation == NULL) {
+        return 0;
+    }
+    misalignment = (unsigned long) ((size_t) test_arena_allocation
+                                    % _TEST_ARENA_ALIGNMENT);
+    test_arena = (unsigned char *) test_arena_allocation
+                 + (misalignment ? _TEST_ARENA_ALIGNMENT - misalignment : 0);
+    test_arena_size = size;
+    if (test_options.poison) {
+        _TEST_POISON(test_arena, test_arena_size);
+    }
+    return 1;
+}
+
+/** Release the fixture data arena. */
+static void test_arena_release(void) {
+    if (test_options.poison) {
+        _TEST_UNPOISON(test_arena, test_arena_size);
+    }
+    free(test_arena_allocation);
+    test_arena = NULL;
+    test_arena_allocation = NULL;
+    test_arena_size = 0;
+}
+#endif
+
+/* The allocator is interposed once per program, by the unit that runs the
+ * tests. */
+#if defined(_TEST_ALLOC_COUNTING) && defined(_TEST_HAS_RUNNER)
+
+/* Allocation accounting may happen on any thread that a test starts. */
+#define _TEST_ALLOC_ADD(COUNTER, AMOUNT) \
+    ((void) __sync_fetch_and_add(&(COUNTER), (AMOUNT)))
+
+/* In C++, the interposed functions must be declared as the C library declares
+ * them, which glibc does with an exception specification. */
+#if defined(__cplusplus) && defined(__THROW)
+#define _TEST_ALLOC_THROW __THROW
+#else
+#define _TEST_ALLOC_THROW
+#endif
+
+/* The allocator that the program would have used without test.h, looked up
+ * when the first allocation is made. */
+static void *(*test_next_malloc)(size_t) = NULL;
+static void *(*test_next_calloc)(size_t, size_t) = NULL;
+static void *(*test_next_realloc)(void *, size_t) = NULL;
+static void (*test_next_free)(void *) = NULL;
+static int (*test_next_posix_memalign)(void **, size_t, size_t) = NULL;
+static void *(*test_next_aligned_alloc)(size_t, size_t) = NULL;
+static void *(*test_next_memalign)(size_t, size_t) = NULL;
+
+/* Zeroed memory handed out while the allocator is being looked up, as the
+ * dynamic linker may itself allocate in the process.  It is never freed. */
+static double test_alloc_bootstrap[512];
+static size_t test_alloc_bootstrap_used = 0;
+
+/**
+ * Look up the next definition of the specified function after this one.
+ *
+ * @param name The name of the function.
+ * @param function Output parameter for the pointer to the function.
+ */
+static void test_alloc_lookup(const char *name, void *function) {
+    void *symbol = dlsym(_TEST_RTLD_NEXT, name);
+    memcpy(function, &symbol, sizeof(symbol));
+}
+
+/**
+ * Look up the allocator to which the interposed allocation functions forward,
+ * unless it has already been looked up.
+ *
+ * @return Nonzero if the allocator is available, or 0 if it is being looked up.
+ */
+static int test_alloc_ready(void) {
+    static int resolving = 0;
+
+    if (test_next_malloc == NULL && !resolving) {
+        resolving = 1;
+        test_alloc_lookup("calloc", &test_next_calloc);
+        test_alloc_lookup("realloc", &test_next_realloc);
+        test_alloc_lookup("free", &test_next_free);
+        test_alloc_lookup("posix_memalign", &test_next_posix_memalign);
+        test_alloc_lookup("aligned_alloc", &test_next_aligned_alloc);
+        test_alloc_lookup("memalign", &test_next_memalign);
+        /* Looked up last, as it marks the allocator as available. */
+        test_alloc_lookup("malloc", &test_next_malloc);
+        resolving = 0;
+    }
+    return test_next_malloc != NULL;
+}
+
+/**
+ * Allocate a block of zeroed memory before the allocator is available.
+ *
+ * @param size The size of the block.
+ * @return The block, or NULL if the bootstrap memory is exhausted.
+ */
+static void *test_alloc_bootstrap_block(size_t size) {
+    void *block;
+
+    size = (size + 15) / 16 * 16;
+    if (size > sizeof(test_alloc_bootstrap) - test_alloc_bootstrap_used) {
+        return NULL;
+    }
+    block = (char *) test_alloc_bootstrap + test_alloc_bootstrap_used;
+    test_alloc_bootstrap_used += size;
+    return block;
+}
+
+/**
+ * Determine whether the specified block of memory is bootstrap memory.
+ *
+ * @param block The block to check.
+ * @return Nonzero if the block is bootstrap memory, or 0 if it is not.
+ */
+static int test_alloc_bootstrapped(const void *block) {
+    const char *start = (const char *) test_alloc_bootstrap;
+    return (const char *) block >= start
+           && (const char *) block < start + sizeof(test_alloc_bootstrap);
+}
+
+/**
+ * Account for a call to the allocator made by the current test.
+ *
+ * @param size The number of bytes requested.
+ * @param block The block that was allocated, or NULL if none was.
+ */
+static void test_alloc_count(size_t size, void *block) {
+    _TEST_ALLOC_ADD(test_alloc_calls, 1);
+    _TEST_ALLOC_ADD(test_alloc_bytes, (unsigned long) size);
+    if (block != NULL) {
+        _TEST_ALLOC_ADD(test_alloc_blocks, 1);
+        _TEST_ALLOC_ADD(test_alloc_live_bytes,
+                        (long) malloc_usable_size(block));
+    }
+}
+
+/*
+ * With TEST_COUNT_ALLOCATIONS defined before this file is included, the
+ * allocation functions of the C library are interposed by the following
+ * definitions, which forward to the next definitions in the program (usually
+ * those of the C library) and account for the memory allocated and freed
+ * while a test runs.  The functions that allocate aligned memory are
+ * interposed along with the others so that the memory they allocate is freed
+ * through the same accounting.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *malloc(size_t size) _TEST_ALLOC_THROW {
+    void *block;
+
+    if (!test_alloc_ready()) {
+        return test_alloc_bootstrap_block(size);
+    }
+    block = test_next_malloc(size);
+    if (test_alloc_counting) {
+        test_alloc_count(size, block);
+    }
+    return block;
+}
+
+void *calloc(size_t count, size_t size) _TEST_ALLOC_THROW {
+    void *block;
+
+    if (!test_alloc_ready()) {
+        return size == 0 || count <= (size_t) -1 / size
+               ? test_alloc_bootstrap_block(count * size) : NULL;
+    }
+    block = test_next_calloc(count, size);
+    if (test_alloc_counting) {
+        test_alloc_count(count * size, block);
+    }
+    return block;
+}
+
+void *realloc(void *block, size_t size) _TEST_ALLOC_THROW {
+    size_t usable, available;
+    void *resized;
+
+    /* Bootstrap memory is moved to the allocator once it is available. */
+    if (block != NULL && test_alloc_bootstrapped(block)) {
+        available = (size_t) ((char *) test_alloc_bootstrap
+                              + sizeof(test_alloc_bootstrap) - (char *) block);
+        resized = malloc(size);
+        if (resized != NULL) {
+            memcpy(resized, block, size < available ? size : available);
+        }
+        return resized;
+    } else if (!test_alloc_ready()) {
+        return block == NULL ? test_alloc_bootstrap_block(size) : NULL;
+    }
+
+    usable = block != NULL && test_alloc_counting
+             ? malloc_usable_size(block) : 0;
+    resized = test_next_realloc(block, size);
+    if (test_alloc_counting) {
+        _TEST_ALLOC_ADD(test_alloc_calls, 1);
+        _TEST_ALLOC_ADD(test_alloc_bytes, (unsigned long) size);
+        if (resized != NULL) {
+            _TEST_ALLOC_ADD(test_alloc_blocks, block == NULL);
+            _TEST_ALLOC_ADD(test_alloc_live_bytes,
+                            (long) malloc_usable_size(resized) - (long) usable);
+        } else if (block != NULL && size == 0) {
+            /* The block was freed. */
+            _TEST_ALLOC_ADD(test_alloc_blocks, -1);
+            _TEST_ALLOC_ADD(test_alloc_live_bytes, -(long) usable);
+        }
+    }
+    return resized;
+}
+
+void free(void *block) _TEST_ALLOC_THROW {
+    if (block == NULL || test_alloc_bootstrapped(block)
+        || !test_alloc_ready()) {
+        return;
+    }
+    if (test_alloc_counting) {
+        _TEST_ALLOC_ADD(test_alloc_blocks, -1);
+        _TEST_ALLOC_ADD(test_alloc_live_bytes,
+                        -(long) malloc_usable_size(block));
+    }
+    test_next_free(block);
+}
+
+int posix_memalign(void **block, size_t alignment,
+                   size_t size) _TEST_ALLOC_THROW {
+    int error;
+
+    if (!test_alloc_ready()) {
+        return ENOMEM;
+    }
+    error = test_next_posix_memalign(block, alignment, size);
+    if (test_alloc_counting) {
+        test_alloc_count(size, error == 0 ? *block : NULL);
+    }
+    return error;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) _TEST_ALLOC_THROW {
+    void *block;
+
+    if (!test_alloc_ready()) {
+        return NULL;
+    }
+    block = test_next_aligned_alloc(alignment, size);
+    if (test_alloc_counting) {
+        test_alloc_count(size, block);
+    }
+    return block;
+}
+
+void *memalign(size_t alignment, size_t size) _TEST_ALLOC_THROW {
+    void *block;
+
+    if (!test_alloc_ready()) {
+        return NULL;
+    }
+    block = test_next_memalign(alignment, size);
+    if (test_alloc_counting) {
+        test_alloc_count(size, block);
+    }
+    return block;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* The maximum depth to which checked blocks, such as those of
+ * ASSERT_MAX_ALLOCS, are checked when nested inside one another. */
+#define _TEST_MAX_SCOPES 16
+
+/* Whether the innermost checked block has been entered, but its body has yet
+ * to run, and whether the block that was just left failed its check. */
+_TEST_SHARED int test_scope_entered;
+_TEST_SHARED int test_scope_failed;
+
+/* The number of allocations that the current test had made when each of the
+ * enclosing ASSERT_MAX_ALLOCS blocks was entered. */
+_TEST_SHARED unsigned long test_alloc_scopes[_TEST_MAX_SCOPES];
+_TEST_SHARED unsigned test_alloc_scope_depth;
+
+/**
+ * Enter an <code>ASSERT_MAX_ALLOCS</code> block, noting the number of
+ * allocations made by the current test so far.
+ */
+static void _TEST_UNUSED test_alloc_scope_enter(void) {
+    if (test_alloc_scope_depth < _TEST_MAX_SCOPES) {
+        test_alloc_scopes[test_alloc_scope_depth] = test_alloc_calls;
+    }
+    test_alloc_scope_depth++;
+    test_scope_entered = 1;
+}
+
+/**
+ * Step an <code>ASSERT_MAX_ALLOCS</code> block: just after the block has been
+ * entered, let its body run; once the body has run, leave the block, failing
+ * the test if the body made more than the specified number of allocations.
+ *
+ * @param limit The number of allocations that the body may make.
+ * @param file The source file of the block.
+ * @param line The source line of the block.
+ * @param expression A description of the check.
+ * @return Nonzero if the body is to run or the test has failed, or 0 once the
+ *         block has been left.
+ */
+static int _TEST_UNUSED test_alloc_scope_step(unsigned long limit,
+                                              const char *file, unsigned line,
+                                              const char *expression) {
+    unsigned long made;
+
+    test_scope_failed = 0;
+    if (test_scope_entered) {
+        test_scope_entered = 0;
+        return 1;
+    } else if (--test_alloc_scope_depth < _TEST_MAX_SCOPES) {
+        made = test_alloc_calls - test_alloc_scopes[test_alloc_scope_depth];
+        if (_TEST_UNLIKELY(made > limit)) {
+            test_record_failure(file, line, expression, 1, "%lu allocation(s)",
+                                "At most %lu", made, limit);
+            test_scope_failed = 1;
+        }
+    }
+    return test_scope_failed;
+}
+
+#ifdef _TEST_PERF_EVENTS
+
+/* The type and configuration of each hardware event counted, in the order of
+ * test_counter_fields. */
+static const struct {
+    unsigned type;
+    unsigned long long config;
+} test_counter_events[_TEST_COUNTER_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                         | PERF_COUNT_HW_CACHE_OP_READ << 8
+                         | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+
+/* The file descriptors of the group of events counted for this process, led
+ * by the first, and the position of each event in the group, or -1 for events
+ * that the processor cannot count. */
+_TEST_SHARED int test_counter_descriptors[_TEST_COUNTER_EVENTS];
+_TEST_SHARED int test_counter_members;
+_TEST_SHARED int test_counter_slots[_TEST_COUNTER_EVENTS];
+
+/* The process that opened the group, whose counts it reads, and the reason
+ * for which the group could not be opened, if it could not. */
+_TEST_SHARED pid_t test_counter_owner;
+_TEST_SHARED const char *test_counter_error;
+
+#endif
+
+/**
+ * Open the group of hardware events counted for this process, unless it is
+ * already open.  Worker processes inherit the group of their parent, which
+ * only counts the events of the parent, so each opens a group of its own.
+ *
+ * @return NULL if the events can be counted, or the reason for which not.
+ */
+static const char *test_counters_open(void) {
+#ifdef _TEST_PERF_EVENTS
+    struct perf_event_attr attr;
+    int leader, descriptor, i;
+
+    if (test_counter_owner == getpid()) {
+        return test_counter_error;
+    }
+    for (i = 0; i < test_counter_members; i++) {
+        close(test_counter_descriptors[i]);
+    }
+    test_counter_members = 0;
+    test_counter_owner = getpid();
+    test_counter_error = NULL;
+
+    /* Count this process in user space only, which perf_event_paranoid
+     * allows by default, reading the counts of the whole group at once. */
+    leader = -1;
+    for (i = 0; i < _TEST_COUNTER_EVENTS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = test_counter_events[i].type;
+        attr.config = test_counter_events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                           | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = attr.exclude_hv = 1;
+        descriptor = (int) syscall(SYS_perf_event_open, &attr, 0, -1, leader,
+                                   0);
+        if (descriptor < 0 && leader < 0) {
+            test_counter_error = errno == EACCES || errno == EPERM
+                ? "forbidden by /proc/sys/kernel/perf_event_paranoid"
+                : strerror(errno);
+            return test_counter_error;
+        } else if (descriptor < 0) {
+            test_counter_slots[i] = -1;
+            continue;
+        }
+        leader = leader < 0 ? descriptor : leader;
+        test_counter_slots[i] = test_counter_members;
+        test_counter_descriptors[test_counter_members++] = descriptor;
+    }
+    return NULL;
+#else
+    return "not supported on this platform";
+#endif
+}
+
+/**
+ * Read the counts of the hardware events of this process so far, scaled up
+ * for any time for which the processor did not count them.
+ *
+ * @param counters Output parameter for the counts.
+ * @return Nonzero if the counts were read, or 0 if they could not be.
+ */
+static int test_counters_read(struct test_counters *counters) {
+#ifdef _TEST_PERF_EVENTS
+    unsigned long long values[3 + _TEST_COUNTER_EVENTS];
+    double scale;
+    int i;
+
+    if (test_counter_members == 0 || test_counter_owner != getpid()
+        || read(test_counter_descriptors[0], values, sizeof(values))
+           < (ssize_t) ((3 + test_counter_members) * sizeof(values[0]))) {
+        return 0;
+    }
+    /* The counts follow the number of events and the times for which the
+     * group was enabled and running. */
+    scale = values[2] > 0 ? (double) values[1] / values[2] : 0;
+    for (i = 0; i < _TEST_COUNTER_EVENTS; i++) {
+        _TEST_COUNTER(counters, i) = test_counter_slots[i] < 0 ? -1
+            : (double) values[3 + test_counter_slots[i]] * scale;
+    }
+    return 1;
+#else
+    (void) counters;
+    return 0;
+#endif
+}
+
+/**
+ * Read the counts of the hardware events of this process since the specified
+ * counts were read.  Events that were not counted are left negative.
+ *
+ * @param start The counts at the start of the interval.
+ * @param counters Output parameter for the counts during the interval.
+ * @return Nonzero if the counts were read, or 0 if they could not be.
+ */
+static int test_counters_since(const struct test_counters *start,
+                               struct test_counters *counters) {
+    int i;
+
+    if (!test_counters_read(counters)) {
+        return 0;
+    }
+    for (i = 0; i < _TEST_COUNTER_EVENTS; i++) {
+        if (_TEST_COUNTER(start, i) < 0) {
+            _TEST_COUNTER(counters, i) = -1;
+        } else {
+            _TEST_COUNTER(counters, i) -= _TEST_COUNTER(start, i);
+        }
+    }
+    return 1;
+}
+
+/* The counts of hardware events when each of the enclosing ASSERT_COUNTER_LE
+ * blocks was entered, with negative cycles if they could not be read. */
+_TEST_SHARED struct test_counters test_counter_scopes[_TEST_MAX_SCOPES];
+_TEST_SHARED unsigned test_counter_scope_depth;
+
+/**
+ * Enter an <code>ASSERT_COUNTER_LE</code> block, reading the counts of
+ * hardware events so far.
+ */
+static void _TEST_UNUSED test_counter_scope_enter(void) {
+    struct test_counters *start;
+
+    if (test_counter_scope_depth < _TEST_MAX_SCOPES) {
+        start = &test_counter_scopes[test_counter_scope_depth];
+        if (test_counters_open() != NULL || !test_counters_read(start)) {
+            start->cycles = -1;
+        }
+    }
+    test_counter_scope_depth++;
+    test_scope_entered = 1;
+}
+
+/**
+ * Step an <code>ASSERT_COUNTER_LE</code> block: just after the block has been
+ * entered, let its body run; once the body has run, leave the block, failing
+ * the test if more than the specified number of the specified event were
+ * counted during the body.  Blocks whose events cannot be counted always pass.
+ *
+ * @param offset The offset of the event within struct test_counters.
+ * @param limit The number of events that the body may cause.
+ * @param file The source file of the block.
+ * @param line The source line of the block.
+ * @param expression A description of the check.
+ * @return Nonzero if the body is to run or the test has failed, or 0 once the
+ *         block has been left.
+ */
+static int _TEST_UNUSED test_counter_scope_step(size_t offset, double limit,
+                                                const char *file,
+                                                unsigned line,
+                                                const char *expression) {
+    struct test_counters *start, counters;
+    double counted;
+
+    test_scope_failed = 0;
+    if (test_scope_entered) {
+        test_scope_entered = 0;
+        return 1;
+    } else if (--test_counter_scope_depth < _TEST_MAX_SCOPES) {
+        start = &test_counter_scopes[test_counter_scope_depth];
+        if (start->cycles >= 0 && test_counters_since(start, &counters)) {
+            counted = *(double *) ((char *) &counters + offset);
+            if (_TEST_UNLIKELY(counted > limit)) {
+                test_record_failure(file, line, expression, 1,
+                                    "%.0f event(s)", "At most %.0f", counted,
+                                    limit);
+                test_scope_failed = 1;
+            }
+        }
+    }
+    return test_scope_failed;
+}
+
+#ifdef _TEST_WATCHDOG
+
+/* Where the runner resumes once the watchdog interrupts a test. */
+_TEST_SHARED sigjmp_buf test_watchdog_jump;
+
+/* When the current test started, and how long it may take (0 for as long as
+ * it likes). */
+_TEST_SHARED test_ns_t test_watchdog_start;
+_TEST_SHARED test_ns_t test_watchdog_timeout;
+
+/* Whether the watchdog timer is running. */
+_TEST_SHARED int test_watchdog_armed;
+
+/* Called by the watchdog, in a worker process, to end the worker once its test
+ * has overrun its timeout, or NULL if the runner is to resume instead. */
+_TEST_SHARED void (*test_watchdog_expire)(void);
+
+/**
+ * Stop the threads of the threaded test being abandoned, if any, and give them
+ * up to a tenth of a second to finish their current iterations.  Threads that
+ * are stuck for longer are left behind, and keep any further threaded test
+ * from running until they stop.
+ */
+static void test_watchdog_stop_threads(void) {
+    struct timespec pause;
+    int i;
+
+    if (test_last_threads.joinable == 0) {
+        return;
+    }
+    pause.tv_sec = 0;
+    pause.tv_nsec = 1000000;
+    _TEST_ATOMIC_WRITE(test_last_threads.stop, 1);
+    _TEST_ATOMIC_WRITE(test_last_threads.go, 1);
+    for (i = 0; i < 100 && _TEST_ATOMIC_READ(test_last_threads.running) > 0;
+         i++) {
+        nanosleep(&pause, NULL);
+    }
+}
+
+/**
+ * Handler for the watchdog timer, which fires once the current test has
+ * overrun its timeout.  The test may have been interrupted while holding a
+ * lock, such as that of the allocator, so nothing that it might hold is safe
+ * to use afterwards: a worker process is simply ended, leaving the runner to
+ * report the timeout.  Only where tests cannot be run in workers is the test
+ * abandoned, stopping its threads if it has any, and the runner resumed in the
+ * same process.
+ *
+ * @param signal_number The signal received.
+ */
+static void test_watchdog_signal(int signal_number) {
+    (void) signal_number;
+    if (test_watchdog_expire != NULL) {
+        test_watchdog_expire();
+    }
+    test_watchdog_stop_threads();
+    siglongjmp(test_watchdog_jump, 1);
+}
+
+/**
+ * Start the watchdog timer to fire once the current test has run for its
+ * timeout, or stop it if the test has no timeout.  The handler of the timer is
+ * only installed once a timeout is first set, so that test suites without
+ * timeouts are free to use <code>SIGALRM</code> themselves.
+ */
+static void test_watchdog_arm(void) {
+    static int installed = 0;
+    struct sigaction action;
+    struct itimerval timer;
+    test_ns_t elapsed, remaining;
+
+    if (!installed && test_watchdog_timeout > 0) {
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = test_watchdog_signal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGALRM, &action, NULL);
+        installed = 1;
+    }
+    if (!test_watchdog_armed && test_watchdog_timeout == 0) {
+        return;
+    }
+
+    /* A timeout that has already passed fires at once. */
+    memset(&timer, 0, sizeof(timer));
+    if (test_watchdog_timeout > 0) {
+        elapsed = test_clock_ns() - test_watchdog_start;
+        remaining = (elapsed < test_watchdog_timeout
+                     ? test_watchdog_timeout - elapsed : 0) / 1000 + 1;
+        timer.it_value.tv_sec = (time_t) (remaining / 1000000);
+        timer.it_value.tv_usec = (long) (remaining % 1000000);
+    }
+    setitimer(ITIMER_REAL, &timer, NULL);
+    test_watchdog_armed = test_watchdog_timeout > 0;
+}
+
+#endif
+
+/**
+ * Set the timeout of the current test, counted from the start of its setup,
+ * replacing the default timeout of the test run.
+ *
+ * @param milliseconds The timeout in milliseconds, or 0 for none.
+ */
+static void _TEST_UNUSED test_set_timeout(unsigned long milliseconds) {
+#ifdef _TEST_WATCHDOG
+    test_watchdog_timeout = (test_ns_t) milliseconds * 1000000;
+    test_watchdog_arm();
+#else
+    (void) milliseconds;
+#endif
+}
+
+#ifdef _TEST_HAS_RUNNER
+/**
+ * Run the lifecycle of the specified test: its fixture's setup function and
+ * parameter setup, its body, and its fixture's teardown function, timing each
+ * of these phases separately.
+ *
+ * @param test_case The descriptor of the test to run.
+ * @param test_data The zeroed fixture data of the test.
+ * @param shared The shared state of the fixture of the test.
+ * @param result Output parameter for the outcome of the test.
+ */
+static void test_run_lifecycle(const struct test_case *test_case,
+                               void *test_data, const void *shared,
+                               struct test_result *result) {
+    const struct test_fixture *fixture = test_case->fixture;
+
+    /* We want to measure both CPU time and wall-clock time. */
+    test_ns_t start_setup, end_setup, start_body, end_body, start_cpu;
+    test_ns_t start_teardown, end_teardown;
+    struct test_counters start_counters;
+    int counting_events;
+
+    test_alloc_counting = 1;
+    start_setup = test_clock_ns();
+    if (*fixture->setup != NULL) {
+        (*fixture->setup)(test_data, shared);
+    }
+    if (test_case->case_setup != NULL) {
+        test_case->case_setup(test_data, shared);
+    }
+
+    end_setup = test_clock_ns();
+
+    /* Run the test; failures in the setup functions also fail the test.  The
+     * (comparatively slow) CPU clock is read outside of the wall-clock
+     * intervals, as are hardware events, if they are counted. */
+    counting_events = test_options.counters && test_counters_open() == NULL
+                      && test_counters_read(&start_counters);
+    start_cpu = test_cpu_clock_ns();
+    start_body = test_clock_ns();
+    test_case->test(test_data, shared);
+    end_body = test_clock_ns();
+    result->cpu_ns = test_cpu_clock_ns() - start_cpu;
+    result->counted = counting_events
+                      && test_counters_since(&start_counters,
+                                             &result->counters);
+
+    /* Test completed: tear down the test environment. */
+    start_teardown = test_clock_ns();
+    if (*fixture->teardown != NULL) {
+        (*fixture->teardown)(test_data, shared);
+    }
+    end_teardown = test_clock_ns();
+    test_alloc_counting = 0;
+
+#ifdef _TEST_ALLOC_COUNTING
+    /* Blocks still held once teardown is complete have leaked, unless the C
+     * library allocated them lazily for good (a stream's buffer on its first
+     * use, the time zone), so this is only checked on request.  A test that
+     * has already failed may well have skipped its cleanup, so it is spared
+     * the noise. */
+    if (test_options.check_leaks && test_last_status == TEST_PASSED
+        && test_alloc_blocks > 0) {
+        test_record_failure(test_case->file, test_case->line,
+                            "Memory leaked by test", 0,
+                            "%ld byte(s) in %ld block(s)", "0 bytes",
+                            test_alloc_live_bytes, test_alloc_blocks);
+    }
+#endif
+
+    result->status = test_last_status;
+    result->setup_ns = end_setup - start_setup;
+    result->body_ns = end_body - start_body;
+    result->teardown_ns = end_teardown - start_teardown;
+}
+
+/**
+ * Main test runner function.  Runs the specified test, additionally running its
+ * fixture's setup and teardown functions before and after the main test
+ * function, respectively, and timing each of these phases separately.  If the
+ * test has a timeout, a watchdog interrupts it once the timeout has passed: in
+ * a worker process, the worker ends there, and otherwise this function returns
+ * without running the teardown function.  The outcome is left to the
+ * reporters to print.
+ *
+ * @param test_case The descriptor of the test to run.
+ * @param shared The shared state of the fixture of the test.
+ * @param result Output parameter for the outcome of the test.
+ */
+static void test_run(const struct test_case *test_case, const void *shared,
+                     struct test_result *result) {
+    /* Initial setup for test run: fixture data starts out zeroed.  In
+     * poisoning mode, the rest of the arena stays inaccessible to catch
+     * overruns of the fixture data. */
+    void *test_data = test_arena;
+    if (test_options.poison) {
+        _TEST_UNPOISON(test_data, test_case->data_size);
+    }
+    memset(test_data, 0, test_case->data_size);
+    test_reset_failures();
+    test_last_status = TEST_PASSED;
+    test_last_benchmark.measured = test_last_benchmark.compared = 0;
+    test_last_threads.measured = 0;
+    test_latency_count = 0;
+    test_alloc_calls = test_alloc_bytes = 0;
+    test_alloc_blocks = test_alloc_live_bytes = 0;
+    test_alloc_scope_depth = test_counter_scope_depth = 0;
+    test_scope_entered = 0;
+    test_last_benchmark.counted = 0;
+    test_current_row = (test_case->flags & _TEST_ROW)
+                       ? (const struct test_row *) test_case : NULL;
+    result->test_case = test_case;
+    result->counted = 0;
+
+#ifdef _TEST_WATCHDOG
+    /* Measured benchmarks take as long as their repetitions take, so they are
+     * only subject to timeouts of their own. */
+    test_watchdog_start = test_clock_ns();
+    test_watchdog_timeout = (test_case->flags & _TEST_BENCHMARK)
+                            && test_options.bench
+                            ? 0 : test_options.timeout_ns;
+    if (sigsetjmp(test_watchdog_jump, 1) == 0) {
+        test_watchdog_arm();
+        test_run_lifecycle(test_case, test_data, shared, result);
+        test_watchdog_timeout = 0;
+        test_watchdog_arm();
+    } else {
+        test_watchdog_armed = 0;
+        test_alloc_counting = 0;
+        result->timeout_ns = test_watchdog_timeout;
+        sprintf(test_failure_message, "Test timed out after %lu ms.",
+                (unsigned long) (test_watchdog_timeout / 1000000));
+        test_last_benchmark.measured = test_last_threads.measured = 0;
+        test_latency_count = 0;
+        result->status = TEST_TIMED_OUT;
+        result->setup_ns = result->teardown_ns = result->cpu_ns = 0;
+        result->body_ns = test_clock_ns() - test_watchdog_start;
+    }
+#else
+    test_run_lifecycle(test_case, test_data, shared, result);
+#endif
+    result->allocations = test_alloc_calls;
+    result->allocated_bytes = test_alloc_bytes;
+
+    if (test_options.poison) {
+        memset(test_data, _TEST_POISON_BYTE, test_case->data_size);
+        _TEST_POISON(test_data, test_case->data_size);
+    }
+}
+#endif
+
+/**
+ * Declare a test with the specified name, belonging to the specified fixture.
+ * The fixture must have been declared with the <code>FIXTURE</code> directive
+ * prior to the test.  For each test, the fixture setup function will be run
+ * first, then the body of the test as specified after this directive, then
+ * finally the fixture teardown function will be run to conclude the test.  All
+ * tests should, but are not required to, contain at least one assertion, a
+ * statement that contains one of the <code>ASSERT_*</code> directives.  Like
+ * test setup and teardown functions, tests are declared with a syntax very
+ * similar to standard C functions, as follows:
+ *
+ * @code{.c}
+ * TEST(Example_test, Some_fixture) {
+ *     ASSERT_NON_NULL(TEST->message);
+ *     strcpy(TEST->message, "Hello!");
+ *     ASSERT_STREQ(TEST->message, "Hello!");
+ *     ASSERT_EQ(strlen(TEST->message), 6);
+ * }
+ * @endcode
+ *
+ * As shown above, the data members of a test's fixture are made available via
+ * the pointer <code>TEST</code>, as in the fixture functions, and its shared
+ * state, if any, via the constant pointer <code>SHARED</code>.  Furthermore,
+ * note that tests that contain multiple assertions will be terminated
+ * immediately once any assertion fails.  This directive must be written within
+ * a <code>TEST_START</code>, <code>TEST_END</code> block.
+ */
+#define TEST(NAME, FIXTURE)                                                \
+    /* Forward declare test function to allow standard function syntax. */ \
+    static void FIXTURE ## _ ## NAME ## _test(                             \
+        struct FIXTURE ## _fixture_data *,                                 \
+        const struct FIXTURE ## _fixture_shared *);                        \
+    /* Register the test to be run by the test runner. */                  \
+    _TEST_DECLARE(FIXTURE ## _ ## NAME ## _case, #NAME, FIXTURE, NULL,     \
+                  FIXTURE ## _ ## NAME ## _test, 0, NULL)                  \
+    /* And finally, the user-declared test function. */                    \
+    static void FIXTURE ## _ ## NAME ## _test(                             \
+        struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,                \
+        const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED)
+
+/** Shorthand for fixture data member access.  Save yourself some typing! */
+#define T_ TEST ->
+
+/** Shorthand for access to the shared state of a fixture. */
+#define S_ SHARED ->
+
+/**
+ * Declare the common test function for a parameterised test with the specified
+ * name, belonging to the specified fixture.  Unlike tests declared with the
+ * <code>TEST</code> directive, this function will not be run simply as a result
+ * of the <code>PTEST</code> directive, but must be followed by
+ * <code>PCASE</code> directives that specify the parameters for each test to be
+ * run.  These directives should be combined as follows:
+ *
+ * @code{.c}
  * #pragma FIXTURE_START
  *
- * FIXTURE(Param_fixture) {
- *     char *message;
- *     unsigned long length;
- * }
+ * FIXTURE(Param_fixture) {
+ *     char *message;
+ *     unsigned long length;
+ * }
+ *
+ * #pragma FIXTURE_END
+ *
+ * #pragma TEST_START
+ *
+ * PTEST(String_length, Param_fixture) {
+ *     ASSERT_EQ(strlen(T_ message), T_ length);
+ * }
+ *
+ * PCASE(String_length, Param_fixture) { T_ message = "Hi!"; T_ length = 3; }
+ * PCASE(String_length, Param_fixture) { T_ message = "Hello"; T_ length = 5; }
+ * PCASE(String_length, Param_fixture) { T_ message = "Salve!"; T_ length = 6; }
+ *
+ * #pragma TEST_END
+ * @endcode
+ *
+ * Note that the data for a parameterised test should be defined in a
+ * corresponding fixture.  Note further that <code>PCASE</code> directives
+ * should follow the corresponding <code>PTEST</code> directive, and that both
+ * <code>PTEST</code> and <code>PCASE</code> directives must be inside a
+ * <code>TEST_START</code>, <code>TEST_END</code> block.
+ */
+#define PTEST(NAME, FIXTURE)                                               \
+    /* Simply allow the user to define the function, but do not run it. */ \
+    static void FIXTURE ## _ ## NAME ## _test(                             \
+            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,            \
+            const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED)
+
+#define PCASE(NAME, FIXTURE)                                                  \
+    /* Forward declare the case setup function. */                            \
+    static void                                                               \
+    _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_setup_, __LINE__)(       \
+            struct FIXTURE ## _fixture_data *,                                \
+            const struct FIXTURE ## _fixture_shared *);                       \
+    /* Register the case to be run after the fixture setup function. */       \
+    _TEST_DECLARE(_TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_, __LINE__),\
+                  #NAME " (L" _TEST_LINE_STR ")", FIXTURE,                    \
+                  _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_setup_,    \
+                                     __LINE__),                               \
+                  FIXTURE ## _ ## NAME ## _test, 0, NULL)                     \
+    /* At last, the user-declared case setup function. */                     \
+    static void                                                               \
+    _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_setup_, __LINE__)(       \
+            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,               \
+            const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED)
+
+/**
+ * Declare a table-driven test with the specified name, belonging to the
+ * specified fixture, that is run once for each element of the specified static
+ * array.  Unlike <code>PCASE</code>, which declares a test for each of its
+ * cases, a table adds but one test to the binary however many rows it has: the
+ * runner expands it into a case for each row, named after the index of the row,
+ * which is reported, filtered, sharded, and scheduled like any other test.  The
+ * index of the row being run is passed as <code>ROW</code>:
+ *
+ * @code{.c}
+ * struct length_case {
+ *     const char *message;
+ *     unsigned long length;
+ * };
+ *
+ * static const struct length_case length_cases[] = {
+ *     {"Hi!", 3}, {"Hello", 5}, {"Salve!", 6}
+ * };
+ *
+ * PTEST_TABLE(String_length, Param_fixture, length_cases) {
+ *     ASSERT_EQ(strlen(length_cases[ROW].message), length_cases[ROW].length);
+ * }
+ * @endcode
+ *
+ * The test above is reported as the three cases
+ * <code>String_length[0]</code> through <code>String_length[2]</code>.  This
+ * directive must be written within a <code>TEST_START</code>,
+ * <code>TEST_END</code> block.
+ */
+#define PTEST_TABLE(NAME, FIXTURE, TABLE)                                     \
+    /* Forward declare the row function to allow standard function syntax. */\
+    static void FIXTURE ## _ ## NAME ## _row(                                 \
+        struct FIXTURE ## _fixture_data *,                                    \
+        const struct FIXTURE ## _fixture_shared *, unsigned long);            \
+    /* Run the row function on the row of the case being run. */              \
+    static void FIXTURE ## _ ## NAME ## _test(                                \
+            struct FIXTURE ## _fixture_data *TEST,                            \
+            const struct FIXTURE ## _fixture_shared *SHARED) {                \
+        FIXTURE ## _ ## NAME ## _row(TEST, SHARED, test_current_row->index);  \
+    }                                                                         \
+    static const struct test_table FIXTURE ## _ ## NAME ## _table = {         \
+        sizeof(TABLE) / sizeof(*(TABLE)), NULL                                \
+    };                                                                        \
+    _TEST_DECLARE(FIXTURE ## _ ## NAME ## _case, #NAME, FIXTURE, NULL,        \
+                  FIXTURE ## _ ## NAME ## _test, 0,                           \
+                  &FIXTURE ## _ ## NAME ## _table)                            \
+    /* And finally, the user-declared row function. */                        \
+    static void FIXTURE ## _ ## NAME ## _row(                                 \
+            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,               \
+            const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED,     \
+            unsigned long ROW _TEST_UNUSED)
+
+/**
+ * Declare a table-driven test with the specified name, belonging to the
+ * specified fixture, that is run once for each line of the data file at the
+ * specified path, relative to the working directory of the test binary.  Blank
+ * lines are skipped.  The file is mapped into memory (or, where it cannot be,
+ * read) once, when the tests are collected, and each case is passed its line in
+ * place as <code>LINE</code>, which is not terminated, and
+ * <code>LINE_LENGTH</code>, along with the index of the row as
+ * <code>ROW</code>.  The fields of comma-separated lines can be found with
+ * <code>test_field</code>:
+ *
+ * @code{.c}
+ * PTEST_FILE(Parse_number, Number_fixture, "numbers.csv") {
+ *     unsigned long length;
+ *     const char *expected = test_field(LINE, LINE_LENGTH, 1, &length);
+ *     ASSERT_NON_NULL(expected);
+ *     // Parse the first field and compare it to the second here...
+ * }
+ * @endcode
+ *
+ * The cases are named after the rows, as for <code>PTEST_TABLE</code>; if the
+ * file cannot be read, a single case with the name of the test fails.  This
+ * directive must be written within a <code>TEST_START</code>,
+ * <code>TEST_END</code> block.
+ */
+#define PTEST_FILE(NAME, FIXTURE, PATH)                                       \
+    /* Forward declare the row function to allow standard function syntax. */\
+    static void FIXTURE ## _ ## NAME ## _row(                                 \
+        struct FIXTURE ## _fixture_data *,                                    \
+        const struct FIXTURE ## _fixture_shared *, unsigned long,             \
+        const char *, unsigned long);                                         \
+    /* Run the row function on the line of the case being run, if any. */    \
+    static void FIXTURE ## _ ## NAME ## _test(                                \
+            struct FIXTURE ## _fixture_data *TEST,                            \
+            const struct FIXTURE ## _fixture_shared *SHARED) {                \
+        const struct test_row *row = test_current_row;                        \
+        if (row->line == NULL) {                                              \
+            test_fail_unreadable();                                           \
+            return;                                                           \
+        }                                                                     \
+        FIXTURE ## _ ## NAME ## _row(TEST, SHARED, row->index, row->line,     \
+                                     row->length);                            \
+    }                                                                         \
+    static const struct test_table FIXTURE ## _ ## NAME ## _table = {         \
+        0, PATH                                                               \
+    };                                                                        \
+    _TEST_DECLARE(FIXTURE ## _ ## NAME ## _case, #NAME, FIXTURE, NULL,        \
+                  FIXTURE ## _ ## NAME ## _test, 0,                           \
+                  &FIXTURE ## _ ## NAME ## _table)                            \
+    /* And finally, the user-declared row function. */                        \
+    static void FIXTURE ## _ ## NAME ## _row(                                 \
+            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,               \
+            const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED,     \
+            unsigned long ROW _TEST_UNUSED,                                   \
+            const char *LINE _TEST_UNUSED,                                    \
+            unsigned long LINE_LENGTH _TEST_UNUSED)
+
+/**
+ * Fail the case being run, that of a test declared with <code>PTEST_FILE</code>
+ * whose data file could not be read.
+ */
+static _TEST_COLD void _TEST_UNUSED test_fail_unreadable(void) {
+    sprintf(test_failure_message, "Could not read the data file %.*s.",
+            _TEST_MAX_FAILURE_LENGTH - 32,
+            test_current_row->test_case.table->path);
+    test_last_status = TEST_FAILED;
+}
+
+/**
+ * Find the field with the specified index, counting from 0, in the specified
+ * line of comma-separated values, such as the <code>LINE</code> of a test
+ * declared with <code>PTEST_FILE</code>.  The field is found in place, without
+ * copying or unquoting it.
+ *
+ * @param line The line to search, which need not be terminated.
+ * @param length The length of the line.
+ * @param index The index of the field to find.
+ * @param field_length Output parameter for the length of the field.
+ * @return The start of the field within the line, or NULL if the line has no
+ *         field with the specified index.
+ */
+static _TEST_UNUSED const char *test_field(const char *line,
+                                           unsigned long length,
+                                           unsigned long index,
+                                           unsigned long *field_length) {
+    const char *end = line + length, *comma;
+    for (;;) {
+        for (comma = line; comma < end && *comma != ','; comma++) {
+        }
+        if (index-- == 0) {
+            *field_length = (unsigned long) (comma - line);
+            return line;
+        } else if (comma == end) {
+            return NULL;
+        }
+        line = comma + 1;
+    }
+}
+
+/**
+ * Skip the test in whose body this directive appears and print a skipped status
+ * and the specified message in the test status report if the specified
+ * condition holds true.  Explanation messages are required for all skipped
+ * tests in order to enforce proper testing discipline.  This directive may
+ * appear anywhere within the body of a test; if the condition holds true, all
+ * assertions from that point forth will not be run.  Furthermore, skipped tests
+ * will not be counted toward the total test count printed in the test report.
+ * Example:
+ *
+ * @code{.c}
+ * TEST(Conditionally_skipped_test, Some_fixture) {
+ *     SKIP_IF(time(NULL) == -1, "Time functions not available");
+ *     // Code that requires time here...
+ * }
+ * @endcode
+ */
+#define SKIP_IF(CONDITION, MESSAGE)                \
+    do {                                           \
+        if (CONDITION) {                           \
+            strcpy(test_failure_message, MESSAGE); \
+            test_last_status = TEST_SKIPPED;       \
+            return;                                \
+        }                                          \
+    } while (0)
+
+/**
+ * Unconditional version of the <code>SKIP_IF</code> directive.  Immediately
+ * skips the remainder of the test in whose body the directive appears.
+ * Example:
+ *
+ * @code{.c}
+ * TEST(Skipped_test, Some_fixture) {
+ *     SKIP("Bug #1: Faulty assertion");
+ *     // Fix this!
+ *     ASSERT_TRUE(0);
+ * }
+ * @endcode
+ *
+ * @see SKIP_IF
+ */
+#define SKIP(MESSAGE) SKIP_IF(1, MESSAGE)
+
+/**
+ * Set the timeout of the test in which this directive appears to the specified
+ * number of milliseconds, counted from the start of the test's setup, in place
+ * of the default timeout set with the <code>--timeout</code> option.  A
+ * timeout of 0 lets the test run for as long as it takes.  Once a test has
+ * overrun its timeout, it is interrupted and reported as timed out, and the
+ * test run carries on with the next test.  Example:
+ *
+ * @code{.c}
+ * TEST(Slow_test, Some_fixture) {
+ *     TEST_TIMEOUT_MS(5000);
+ *     // Code that may take a few seconds here...
+ * }
+ * @endcode
+ *
+ * Written in a fixture setup function, this directive sets the timeout of
+ * every test in the fixture.  Timeouts are enforced with <code>SIGALRM</code>
+ * on Unix-like systems, and are ignored elsewhere.  A test run that includes
+ * this directive runs each test in a worker process, even with
+ * <code>-j 1</code>, so that a test that overruns its timeout is ended with
+ * its worker rather than resumed.
+ */
+#ifdef _TEST_LINKER_REGISTRY
+#define TEST_TIMEOUT_MS(MILLISECONDS)                                      \
+    do {                                                                   \
+        static const char test_timeout_mark                                \
+                __attribute__((used, section("test_h_timeouts"))) = 1;     \
+        test_set_timeout(MILLISECONDS);                                    \
+    } while (0)
+#else
+#define TEST_TIMEOUT_MS(MILLISECONDS) test_set_timeout(MILLISECONDS)
+#endif
+
+/* ******************************* ASSERTIONS ******************************* */
+
+/* Run an assertion comparing two values with the specified representations and
+ * printf formats according to the specified comparator, recording the failure
+ * with the specified message and terminating the test on failure. */
+#define _TEST_ASSERT(A, A_REPR, A_FMT, CMP, B, B_REPR, B_FMT, MSG)     \
+    do {                                                               \
+        if (_TEST_UNLIKELY(!((A) CMP (B)))) {                          \
+            test_record_failure(__FILE__, __LINE__, MSG, 1, A_FMT,     \
+                                B_FMT, (A_REPR), (B_REPR));            \
+            return;                                                    \
+        }                                                              \
+    } while (0)
+
+/* Like _TEST_ASSERT, but let the test continue once the failure is recorded,
+ * so that a single run reports every failed expectation. */
+#define _TEST_EXPECT(A, A_REPR, A_FMT, CMP, B, B_REPR, B_FMT, MSG)     \
+    do {                                                               \
+        if (_TEST_UNLIKELY(!((A) CMP (B)))) {                          \
+            test_record_failure(__FILE__, __LINE__, MSG, 0, A_FMT,     \
+                                B_FMT, (A_REPR), (B_REPR));            \
+        }                                                              \
+    } while (0)
+
+/** Assert that the specified predicate evaluates to a truthy (non-0) value. */
+#define ASSERT_TRUE(PREDICATE)                                             \
+    _TEST_ASSERT(0, "TRUE (!= 0)", "%s", !=, PREDICATE, (PREDICATE), "%d", \
+            "Expression is true: (" #PREDICATE ")")
+
+/** Assert that the specified predicate evaluates to a falsy (0) value. */
+#define ASSERT_FALSE(PREDICATE)                                          \
+    _TEST_ASSERT(0, "FALSE (0)", "%s", ==, PREDICATE, (PREDICATE), "%d", \
+            "Expression is false: (" #PREDICATE ")")
+
+/** Assert that the specified pointer is null (0). */
+#define ASSERT_NULL(PTR)                                         \
+    _TEST_ASSERT(NULL, "NULL (0x0)", "%s", ==, PTR, (PTR), "%p", \
+            "Pointer is non-null: (" #PTR ")")
+
+/** Assert that the specified pointer is non-null (non-0). */
+#define ASSERT_NON_NULL(PTR)                                            \
+    _TEST_ASSERT(NULL, "Non-null (!= 0x0)", "%s", !=, PTR, (PTR), "%p", \
+            "Pointer is null: (" #PTR ")")
+
+/**
+ * Assert that the first specified value is equal to the second specified value.
+ * Values will be printed in the specified format.
+ */
+#define ASSERT_EQ(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, ==, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") == (" #VALUE_2 ")")
+
+/**
+ * Assert that the first specified value is not equal to the second specified
+ * value.  Values will be printed in the specified format.
+ */
+#define ASSERT_NE(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, !=, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") != (" #VALUE_2 ")")
+
+/**
+ * Assert that the first specified value is greater than the second specified
+ * value.  Values will be printed in the specified format.
+ */
+#define ASSERT_GT(VALUE_1, VALUE_2, FORMAT)                                 \
+    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, >, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") > (" #VALUE_2 ")")
+
+/**
+ * Assert that the first specified value is greater than or equal to the second
+ * specified value.  Values will be printed in the specified format.
+ */
+#define ASSERT_GE(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, >=, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") >= (" #VALUE_2 ")")
+
+/**
+ * Assert that the first specified value is less than the second specified
+ * value.  Values will be printed in the specified format.
+ */
+#define ASSERT_LT(VALUE_1, VALUE_2, FORMAT)                                 \
+    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, <, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") < (" #VALUE_2 ")")
+
+/**
+ * Assert that the first specified value is less than or equal to the second
+ * specified value.  Values will be printed in the specified format.
+ */
+#define ASSERT_LE(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, <=, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") <= (" #VALUE_2 ")")
+
+/**
+ * Assert that the contents of the specified strings (<code>char *</code>) are
+ * equal.  Values will be printed as strings.
+ */
+#define ASSERT_STREQ(STR_1, STR_2)                                            \
+    _TEST_ASSERT(strcmp((STR_1), (STR_2)), (STR_1), "\"%s\"", ==, 0, (STR_2), \
+            "\"%s\"", "(" #STR_1 ") == (" #STR_2 ")")
+
+/**
+ * Assert that the contents of the specified strings (<code>char *</code>) are
+ * not equal.  Values will be printed as strings.
+ */
+#define ASSERT_STRNE(STR_1, STR_2)                                            \
+    _TEST_ASSERT(strcmp((STR_1), (STR_2)), (STR_1), "\"%s\"", !=, 0, (STR_2), \
+            "\"%s\"", "(" #STR_1 ") != (" #STR_2 ")")
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+/*
+ * With C11, _Generic lets the comparisons take the printf format of a value
+ * from its type, so that a mismatched format cannot be passed by mistake.
+ * Each value is widened to the largest type of its kind by passing it to one
+ * of the identity functions below, whose parameter type matches the format
+ * selected for it; the kinds are signed and unsigned integers, the three
+ * floating types, and everything else as a pointer.
+ */
+
+/** Widen the specified signed integer for printing with "%lld". */
+static _TEST_UNUSED long long test_typed_signed(long long value) {
+    return value;
+}
+
+/** Widen the specified unsigned integer for printing with "%llu". */
+static _TEST_UNUSED unsigned long long test_typed_unsigned(
+        unsigned long long value) {
+    return value;
+}
+
+/** Pass the specified float on for printing with "%.9g". */
+static _TEST_UNUSED double test_typed_float(double value) {
+    return value;
+}
+
+/** Pass the specified double on for printing with "%.17g". */
+static _TEST_UNUSED double test_typed_double(double value) {
+    return value;
+}
+
+/** Pass the specified long double on for printing with "%.21Lg". */
+static _TEST_UNUSED long double test_typed_long_double(long double value) {
+    return value;
+}
+
+/** Convert the specified pointer for printing with "%p". */
+static _TEST_UNUSED const volatile void *test_typed_pointer(
+        const volatile void *value) {
+    return value;
+}
+
+/* The specified value, converted for printing with _TEST_TYPED_FORMAT. */
+#define _TEST_TYPED(VALUE)                             \
+    _Generic((VALUE),                                  \
+             _Bool: test_typed_unsigned,               \
+             char: test_typed_signed,                  \
+             signed char: test_typed_signed,           \
+             unsigned char: test_typed_unsigned,       \
+             short: test_typed_signed,                 \
+             unsigned short: test_typed_unsigned,      \
+             int: test_typed_signed,                   \
+             unsigned: test_typed_unsigned,            \
+             long: test_typed_signed,                  \
+             unsigned long: test_typed_unsigned,       \
+             long long: test_typed_signed,             \
+             unsigned long long: test_typed_unsigned,  \
+             float: test_typed_float,                  \
+             double: test_typed_double,                \
+             long double: test_typed_long_double,      \
+             default: test_typed_pointer)(VALUE)
+
+/* The printf format of the specified value, as converted by _TEST_TYPED. */
+#define _TEST_TYPED_FORMAT(VALUE)             \
+    _Generic((VALUE),                         \
+             _Bool: "%llu",                   \
+             char: "%lld",                    \
+             signed char: "%lld",             \
+             unsigned char: "%llu",           \
+             short: "%lld",                   \
+             unsigned short: "%llu",          \
+             int: "%lld",                     \
+             unsigned: "%llu",                \
+             long: "%lld",                    \
+             unsigned long: "%llu",           \
+             long long: "%lld",               \
+             unsigned long long: "%llu",      \
+             float: "%.9g",                   \
+             double: "%.17g",                 \
+             long double: "%.21Lg",           \
+             default: "%p")
+
+/* Run an assertion comparing two values according to the specified comparator,
+ * printing each of them in the format of its type. */
+#define _TEST_ASSERT_TYPED(A, CMP, B)                                       \
+    _TEST_ASSERT(A, _TEST_TYPED(A), _TEST_TYPED_FORMAT(A), CMP, B,          \
+            _TEST_TYPED(B), _TEST_TYPED_FORMAT(B), "(" #A ") " #CMP " (" #B ")")
+
+/* Like _TEST_ASSERT_TYPED, but let the test continue on failure. */
+#define _TEST_EXPECT_TYPED(A, CMP, B)                                       \
+    _TEST_EXPECT(A, _TEST_TYPED(A), _TEST_TYPED_FORMAT(A), CMP, B,          \
+            _TEST_TYPED(B), _TEST_TYPED_FORMAT(B), "(" #A ") " #CMP " (" #B ")")
+
+/**
+ * Assert that the first specified value is equal to the second.  Like
+ * <code>ASSERT_EQ</code>, but each value is printed in a format chosen for its
+ * type, so none need be given.  Values of arithmetic types are printed as
+ * numbers and all others as pointers: compare the contents of strings and
+ * buffers with <code>ASSERT_STREQ</code> and <code>ASSERT_MEMEQ</code>.
+ * Requires C11.
+ */
+#define ASSERT_EQUAL(VALUE_1, VALUE_2) _TEST_ASSERT_TYPED(VALUE_1, ==, VALUE_2)
+
+/** Assert that the first specified value is not equal to the second. */
+#define ASSERT_NOT_EQUAL(VALUE_1, VALUE_2) \
+    _TEST_ASSERT_TYPED(VALUE_1, !=, VALUE_2)
+
+/** Assert that the first specified value is greater than the second. */
+#define ASSERT_GREATER(VALUE_1, VALUE_2) _TEST_ASSERT_TYPED(VALUE_1, >, VALUE_2)
+
+/** Assert that the first specified value is at least the second. */
+#define ASSERT_GREATER_EQUAL(VALUE_1, VALUE_2) \
+    _TEST_ASSERT_TYPED(VALUE_1, >=, VALUE_2)
+
+/** Assert that the first specified value is less than the second. */
+#define ASSERT_LESS(VALUE_1, VALUE_2) _TEST_ASSERT_TYPED(VALUE_1, <, VALUE_2)
+
+/** Assert that the first specified value is at most the second. */
+#define ASSERT_LESS_EQUAL(VALUE_1, VALUE_2) \
+    _TEST_ASSERT_TYPED(VALUE_1, <=, VALUE_2)
+#endif
+
+/* SSE2 compares 16 bytes at a time, and is available on every x86-64
+ * processor. */
+#if defined(__SSE2__) || defined(_M_X64) \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define _TEST_SSE2
+#endif
+
+/* The number of rows of 16 bytes shown on each side of the row containing the
+ * first mismatch in the hexdump printed for a failed ASSERT_MEMEQ. */
+#define _TEST_HEXDUMP_CONTEXT 1
+
+/**
+ * Find the offset of the first byte at which the specified buffers differ,
+ * once memcmp() has found that they do.  Rather than byte by byte, the
+ * buffers are compared 64 bytes at a time using SSE2 where it is available,
+ * or four machine words at a time otherwise, and only the block containing
+ * the mismatch is re-scanned by byte.
+ *
+ * @param buffer_1 The first buffer to compare.
+ * @param buffer_2 The second buffer to compare.
+ * @param length The length of both buffers, in bytes.
+ * @return The offset of the first mismatch, or the length if the buffers are
+ *         equal.
+ */
+static _TEST_UNUSED size_t test_mismatch(const void *buffer_1,
+                                         const void *buffer_2, size_t length) {
+    const unsigned char *bytes_1 = (const unsigned char *) buffer_1;
+    const unsigned char *bytes_2 = (const unsigned char *) buffer_2;
+    size_t offset = 0;
+#ifdef _TEST_SSE2
+    const __m128i *blocks_1, *blocks_2;
+    __m128i equal;
+    for (; length - offset >= 64; offset += 64) {
+        blocks_1 = (const __m128i *) (bytes_1 + offset);
+        blocks_2 = (const __m128i *) (bytes_2 + offset);
+        equal = _mm_and_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(blocks_1),
+                                             _mm_loadu_si128(blocks_2)),
+                              _mm_cmpeq_epi8(_mm_loadu_si128(blocks_1 + 1),
+                                             _mm_loadu_si128(blocks_2 + 1))),
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(blocks_1 + 2),
+                                             _mm_loadu_si128(blocks_2 + 2)),
+                              _mm_cmpeq_epi8(_mm_loadu_si128(blocks_1 + 3),
+                                             _mm_loadu_si128(blocks_2 + 3))));
+        if (_mm_movemask_epi8(equal) != 0xFFFF) {
+            break;
+        }
+    }
+#else
+    size_t words_1[4], words_2[4];
+    /* memcpy() makes the loads safe at any alignment, and compiles to plain
+     * loads where unaligned ones are allowed. */
+    for (; length - offset >= sizeof(words_1); offset += sizeof(words_1)) {
+        memcpy(words_1, bytes_1 + offset, sizeof(words_1));
+        memcpy(words_2, bytes_2 + offset, sizeof(words_2));
+        if (((words_1[0] ^ words_2[0]) | (words_1[1] ^ words_2[1])
+             | (words_1[2] ^ words_2[2]) | (words_1[3] ^ words_2[3])) != 0) {
+            break;
+        }
+    }
+#endif
+    while (offset < length && bytes_1[offset] == bytes_2[offset]) {
+        offset++;
+    }
+    return offset;
+}
+
+/**
+ * Write a hexdump of the window of the specified buffer around the specified
+ * offset, headed by the value of the byte at that offset, to the specified
+ * output buffer.  The window is the row of 16 bytes containing the offset and
+ * _TEST_HEXDUMP_CONTEXT rows on either side of it.
+ *
+ * @param output The buffer to which to write the hexdump.
+ * @param buffer The buffer to dump.
+ * @param length The length of the buffer.
+ * @param offset The offset of the byte of interest.
+ */
+static _TEST_COLD void _TEST_UNUSED test_hexdump(
+        char *output, const unsigned char *buffer, size_t length,
+        size_t offset) {
+    size_t row, end, i;
+    output += sprintf(output, "byte %lu (%#lx) of %lu is 0x%02x",
+                      (unsigned long) offset, (unsigned long) offset,
+                      (unsigned long) length, buffer[offset]);
+    row = offset / 16 * 16;
+    row -= row < 16 * _TEST_HEXDUMP_CONTEXT ? row : 16 * _TEST_HEXDUMP_CONTEXT;
+    end = offset / 16 * 16 + 16 * (_TEST_HEXDUMP_CONTEXT + 1);
+    for (; row < end && row < length; row += 16) {
+        /* Align the rows under the text following "Value 1: ". */
+        output += sprintf(output, _TEST_NEWLINE "             %08lx ",
+                          (unsigned long) row);
+        for (i = row; i < row + 16; i++) {
+            output += sprintf(output, i < length ? " %02x" : "   ",
+                              i < length ? buffer[i] : 0);
+            if (i == row + 7) {
+                *output++ = ' ';
+            }
+        }
+        output += sprintf(output, "  |");
+        for (i = row; i < row + 16 && i < length; i++) {
+            *output++ = buffer[i] >= 0x20 && buffer[i] < 0x7F ? buffer[i] : '.';
+        }
+        *output++ = '|';
+    }
+    *output = '\0';
+}
+
+/**
+ * Record the failure of a comparison of two buffers which differ, printing a
+ * hexdump of each around their first mismatch rather than the whole buffers.
+ *
+ * @param file The source file of the check.
+ * @param line The source line of the check.
+ * @param expression A description of the check.
+ * @param fatal Whether the failure ends the test.
+ * @param buffer_1 The first buffer compared.
+ * @param buffer_2 The second buffer compared.
+ * @param length The length of both buffers.
+ */
+static _TEST_COLD void _TEST_UNUSED test_record_mismatch(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const void *buffer_1, const void *buffer_2, size_t length) {
+    /* Each row of the hexdump takes 93 characters, and the heading fewer. */
+    char dump_1[100 * (2 * _TEST_HEXDUMP_CONTEXT + 2)];
+    char dump_2[100 * (2 * _TEST_HEXDUMP_CONTEXT + 2)];
+    size_t offset = test_mismatch(buffer_1, buffer_2, length);
+    test_hexdump(dump_1, (const unsigned char *) buffer_1, length, offset);
+    test_hexdump(dump_2, (const unsigned char *) buffer_2, length, offset);
+    test_record_failure(file, line, expression, fatal, "%s", "%s", dump_1,
+                        dump_2);
+}
+
+/**
+ * Compare the specified buffers, recording a failure with the specified
+ * description if they differ.  Buffers that are equal cost a single call to
+ * memcmp(); the first mismatch is only searched for once they are found to
+ * differ.
+ *
+ * @return 1 if the buffers are equal, or 0 if they differ.
+ */
+static _TEST_UNUSED int test_memeq(const char *file, unsigned line,
+                                   const char *expression, int fatal,
+                                   const void *buffer_1, const void *buffer_2,
+                                   size_t length) {
+    if (_TEST_UNLIKELY(memcmp(buffer_1, buffer_2, length) != 0)) {
+        test_record_mismatch(file, line, expression, fatal, buffer_1,
+                             buffer_2, length);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Assert that the first specified number of bytes of the specified buffers are
+ * equal.  The buffers may hold any data, including null bytes.  On failure,
+ * the offset of the first mismatch is printed along with a hexdump of each
+ * buffer around it, so that even a multi-megabyte buffer is reported in a few
+ * lines.
+ */
+#define ASSERT_MEMEQ(BUFFER_1, BUFFER_2, LENGTH)                              \
+    do {                                                                      \
+        if (!test_memeq(__FILE__, __LINE__, "(" #BUFFER_1 ") == (" #BUFFER_2  \
+                        ") for (" #LENGTH ") bytes", 1, (BUFFER_1),           \
+                        (BUFFER_2), (LENGTH))) {                              \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
+
+/* The number of mismatched elements listed by a failed array comparison. */
+#define _TEST_MAX_OFFENDERS 8
+
+/**
+ * Determine whether the specified values differ by more than the specified
+ * tolerance, which is the sum of an absolute part and a part relative to the
+ * larger magnitude of the two.  Two NaNs are taken to match, as are two
+ * infinities of the same sign, but a NaN or infinity never matches any other
+ * value, however large the tolerance.  The test is made without branches, so
+ * that loops calling this function can be vectorised.
+ *
+ * @return 1 if the values differ by more than the tolerance, or 0 otherwise.
+ */
+static _TEST_UNUSED int test_near_mismatch(double x, double y,
+                                           double absolute, double relative) {
+    double difference = x > y ? x - y : y - x;
+    double size_x = x < 0 ? -x : x, size_y = y < 0 ? -y : y;
+    double size = size_x > size_y ? size_x : size_y;
+    return !((x == y) | ((x != x) & (y != y))
+             | ((difference <= absolute + relative * size)
+                & (difference <= DBL_MAX)));
+}
+
+/**
+ * Compute the distance between the specified doubles in units in the last
+ * place: the number of representable doubles between them, plus one.  The bits
+ * of each value are mapped to an integer that orders them like the values
+ * themselves, with both zeros mapped to the same integer.
+ */
+static _TEST_UNUSED unsigned long long test_ulps_double(double x, double y) {
+    const unsigned long long sign = 1ULL << 63;
+    unsigned long long bits_x, bits_y;
+    memcpy(&bits_x, &x, sizeof(bits_x));
+    memcpy(&bits_y, &y, sizeof(bits_y));
+    bits_x = bits_x & sign ? sign - (bits_x & ~sign) : sign + bits_x;
+    bits_y = bits_y & sign ? sign - (bits_y & ~sign) : sign + bits_y;
+    return bits_x > bits_y ? bits_x - bits_y : bits_y - bits_x;
+}
+
+/** Compute the distance between the specified floats in units in the last
+ * place, like <code>test_ulps_double</code>. */
+static _TEST_UNUSED unsigned long long test_ulps_float(float x, float y) {
+    const unsigned int sign = 1U << 31;
+    unsigned int bits_x, bits_y;
+    memcpy(&bits_x, &x, sizeof(bits_x));
+    memcpy(&bits_y, &y, sizeof(bits_y));
+    bits_x = bits_x & sign ? sign - (bits_x & ~sign) : sign + bits_x;
+    bits_y = bits_y & sign ? sign - (bits_y & ~sign) : sign + bits_y;
+    return bits_x > bits_y ? bits_x - bits_y : bits_y - bits_x;
+}
+
+/**
+ * Determine whether the specified values, which are the specified distance
+ * apart in units in the last place, are further apart than allowed.  NaNs and
+ * infinities are handled as by <code>test_near_mismatch</code>, not by their
+ * distance: the largest finite double is one unit from infinity.
+ *
+ * @return 1 if the values are too far apart, or 0 otherwise.
+ */
+static _TEST_UNUSED int test_ulps_mismatch(double x, double y,
+                                           unsigned long long ulps,
+                                           unsigned long max_ulps) {
+    double size_x = x < 0 ? -x : x, size_y = y < 0 ? -y : y;
+    return !((x == y) | ((x != x) & (y != y))
+             | ((ulps <= max_ulps) & (size_x <= DBL_MAX)
+                & (size_y <= DBL_MAX)));
+}
+
+#ifdef _TEST_SSE2
+/* The number of elements compared by tolerance before checking for suspects,
+ * as one mask for the whole block. */
+#define _TEST_NEAR_BLOCK 16
+
+/**
+ * Find the pairs of elements of the specified vectors of two doubles that are
+ * not plainly near one another: whose difference is NaN, infinite, or greater
+ * than the tolerance, the relative part of which is scaled by the first element
+ * of the pair alone.  Every pair that <code>test_near_mismatch</code> rejects
+ * is among them, given a relative tolerance that is not negative, along with
+ * pairs of NaNs and equal infinities, which it accepts, and pairs that are
+ * only within the tolerance scaled by the second element.
+ *
+ * @param x The first elements of the pairs.
+ * @param y The second elements of the pairs.
+ * @param absolute The absolute tolerance, in both lanes.
+ * @param relative The relative tolerance, in both lanes.  If it is 0, the
+ *                 absolute tolerance must be no greater than DBL_MAX.
+ * @param scaled Whether the relative tolerance is other than 0.
+ * @return A mask whose lanes are set for the pairs that may be mismatched.
+ */
+static _TEST_UNUSED __m128d test_near_suspects_sse2(__m128d x, __m128d y,
+                                                    __m128d absolute,
+                                                    __m128d relative,
+                                                    int scaled) {
+    const __m128d sign = _mm_set1_pd(-0.0);
+    /* A NaN in either value gives a NaN difference, which is not within any
+     * tolerance. */
+    __m128d difference = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+    if (!scaled) {
+        return _mm_cmpnle_pd(difference, absolute);
+    }
+    /* Capping the tolerance rejects infinite differences.  MINPD returns its
+     * second operand if either is NaN, so a NaN tolerance rejects every
+     * difference. */
+    return _mm_cmpnle_pd(difference, _mm_min_pd(
+            _mm_set1_pd(DBL_MAX),
+            _mm_add_pd(absolute, _mm_mul_pd(relative,
+                                            _mm_andnot_pd(sign, x)))));
+}
+
+/**
+ * Determine whether any pair of elements of the specified blocks of
+ * _TEST_NEAR_BLOCK doubles may not be near one another, as found by
+ * <code>test_near_suspects_sse2</code>.  Each tolerance gets a loop of its
+ * own, so that neither tests which it is for each element.
+ *
+ * @return Nonzero if any pair may be mismatched.
+ */
+static _TEST_UNUSED int test_near_block_doubles_sse2(
+        const double *doubles_1, const double *doubles_2, __m128d absolute,
+        __m128d relative, int scaled) {
+    __m128d suspects = _mm_setzero_pd();
+    int i;
+    if (scaled) {
+        for (i = 0; i < _TEST_NEAR_BLOCK; i += 2) {
+            suspects = _mm_or_pd(suspects, test_near_suspects_sse2(
+                    _mm_loadu_pd(doubles_1 + i), _mm_loadu_pd(doubles_2 + i),
+                    absolute, relative, 1));
+        }
+    } else {
+        for (i = 0; i < _TEST_NEAR_BLOCK; i += 2) {
+            suspects = _mm_or_pd(suspects, test_near_suspects_sse2(
+                    _mm_loadu_pd(doubles_1 + i), _mm_loadu_pd(doubles_2 + i),
+                    absolute, relative, 0));
+        }
+    }
+    return _mm_movemask_pd(suspects);
+}
+
+/**
+ * Determine whether any pair of elements of the specified blocks of
+ * _TEST_NEAR_BLOCK floats may not be near one another, like
+ * <code>test_near_block_doubles_sse2</code>.  The floats are compared as
+ * doubles, as by <code>test_near_mismatch</code>.
+ *
+ * @return Nonzero if any pair may be mismatched.
+ */
+static _TEST_UNUSED int test_near_block_floats_sse2(
+        const float *floats_1, const float *floats_2, __m128d absolute,
+        __m128d relative, int scaled) {
+    __m128d suspects = _mm_setzero_pd();
+    __m128 x, y;
+    int i;
+    if (scaled) {
+        for (i = 0; i < _TEST_NEAR_BLOCK; i += 4) {
+            x = _mm_loadu_ps(floats_1 + i);
+            y = _mm_loadu_ps(floats_2 + i);
+            suspects = _mm_or_pd(suspects, _mm_or_pd(
+                    test_near_suspects_sse2(_mm_cvtps_pd(x), _mm_cvtps_pd(y),
+                                            absolute, relative, 1),
+                    test_near_suspects_sse2(_mm_cvtps_pd(_mm_movehl_ps(x, x)),
+                                            _mm_cvtps_pd(_mm_movehl_ps(y, y)),
+                                            absolute, relative, 1)));
+        }
+    } else {
+        for (i = 0; i < _TEST_NEAR_BLOCK; i += 4) {
+            x = _mm_loadu_ps(floats_1 + i);
+            y = _mm_loadu_ps(floats_2 + i);
+            suspects = _mm_or_pd(suspects, _mm_or_pd(
+                    test_near_suspects_sse2(_mm_cvtps_pd(x), _mm_cvtps_pd(y),
+                                            absolute, relative, 0),
+                    test_near_suspects_sse2(_mm_cvtps_pd(_mm_movehl_ps(x, x)),
+                                            _mm_cvtps_pd(_mm_movehl_ps(y, y)),
+                                            absolute, relative, 0)));
+        }
+    }
+    return _mm_movemask_pd(suspects);
+}
+#endif
+
+/**
+ * Count the elements of the specified arrays that are not near one another, in
+ * a single pass: with SSE2 where it is available, and otherwise in loops that
+ * the compiler can vectorise for wider vector extensions.  Distances in units
+ * in the last place are only computed for elements that are not equal.
+ *
+ * @param array_1 The first array to compare.
+ * @param array_2 The second array to compare.
+ * @param floats Whether the elements of the arrays are floats, not doubles.
+ * @param length The number of elements in each array.
+ * @param absolute The absolute tolerance.
+ * @param relative The tolerance relative to the magnitude of the elements.
+ * @param max_ulps The greatest distance allowed in units in the last place, or
+ *                 0 to compare by absolute and relative tolerance instead,
+ *                 which with no tolerance is the same as a distance of 0.
+ * @return The number of mismatched elements.
+ */
+static _TEST_UNUSED unsigned long test_count_mismatches(
+        const void *array_1, const void *array_2, int floats,
+        unsigned long length, double absolute, double relative,
+        unsigned long max_ulps) {
+    const float *floats_1 = (const float *) array_1;
+    const float *floats_2 = (const float *) array_2;
+    const double *doubles_1 = (const double *) array_1;
+    const double *doubles_2 = (const double *) array_2;
+    unsigned long i = 0, count = 0;
+#ifdef _TEST_SSE2
+    /* Without a relative tolerance, the absolute one is capped once, which
+     * rejects infinite differences but keeps a NaN tolerance. */
+    __m128d absolute_2 = _mm_set1_pd(relative == 0 && absolute > DBL_MAX
+                                     ? DBL_MAX : absolute);
+    __m128d relative_2 = _mm_set1_pd(relative);
+    __m128 x, y;
+    unsigned long j;
+    int suspects;
+    /* When comparing by tolerance, the elements of a whole block are checked
+     * at once for a plain match, and only those of a block with any suspects
+     * are checked fully; a negative relative tolerance, which would make
+     * scaling by either element alone unsafe, is left to the loops below.
+     * When comparing by distance, four elements at a time are checked for
+     * equality, and only those of a block that are not are checked fully. */
+    if (floats && max_ulps == 0 && relative >= 0) {
+        for (; i < length / _TEST_NEAR_BLOCK * _TEST_NEAR_BLOCK;
+             i += _TEST_NEAR_BLOCK) {
+            if (_TEST_UNLIKELY(test_near_block_floats_sse2(
+                    floats_1 + i, floats_2 + i, absolute_2, relative_2,
+                    relative > 0))) {
+                for (j = i; j < i + _TEST_NEAR_BLOCK; j++) {
+                    count += test_near_mismatch(floats_1[j], floats_2[j],
+                                                absolute, relative);
+                }
+            }
+        }
+    } else if (max_ulps == 0 && relative >= 0) {
+        for (; i < length / _TEST_NEAR_BLOCK * _TEST_NEAR_BLOCK;
+             i += _TEST_NEAR_BLOCK) {
+            if (_TEST_UNLIKELY(test_near_block_doubles_sse2(
+                    doubles_1 + i, doubles_2 + i, absolute_2, relative_2,
+                    relative > 0))) {
+                for (j = i; j < i + _TEST_NEAR_BLOCK; j++) {
+                    count += test_near_mismatch(doubles_1[j], doubles_2[j],
+                                                absolute, relative);
+                }
+            }
+        }
+    } else if (floats && max_ulps > 0) {
+        for (; i < length / 4 * 4; i += 4) {
+            x = _mm_loadu_ps(floats_1 + i);
+            y = _mm_loadu_ps(floats_2 + i);
+            if (_TEST_UNLIKELY(_mm_movemask_ps(_mm_cmpeq_ps(x, y)) != 15)) {
+                for (j = i; j < i + 4; j++) {
+                    count += test_ulps_mismatch(
+                            floats_1[j], floats_2[j],
+                            test_ulps_float(floats_1[j], floats_2[j]),
+                            max_ulps);
+                }
+            }
+        }
+    } else if (max_ulps > 0) {
+        for (; i < length / 4 * 4; i += 4) {
+            suspects = _mm_movemask_pd(_mm_and_pd(
+                    _mm_cmpeq_pd(_mm_loadu_pd(doubles_1 + i),
+                                 _mm_loadu_pd(doubles_2 + i)),
+                    _mm_cmpeq_pd(_mm_loadu_pd(doubles_1 + i + 2),
+                                 _mm_loadu_pd(doubles_2 + i + 2)))) ^ 3;
+            if (_TEST_UNLIKELY(suspects != 0)) {
+                for (j = i; j < i + 4; j++) {
+                    count += test_ulps_mismatch(
+                            doubles_1[j], doubles_2[j],
+                            test_ulps_double(doubles_1[j], doubles_2[j]),
+                            max_ulps);
+                }
+            }
+        }
+    }
+#endif
+    /* Each combination gets a loop of its own, so that each loop has a single
+     * element type and test to vectorise. */
+    if (floats && max_ulps > 0) {
+        for (; i < length; i++) {
+            if (floats_1[i] != floats_2[i]) {
+                count += test_ulps_mismatch(
+                        floats_1[i], floats_2[i],
+                        test_ulps_float(floats_1[i], floats_2[i]), max_ulps);
+            }
+        }
+    } else if (max_ulps > 0) {
+        for (; i < length; i++) {
+            if (doubles_1[i] != doubles_2[i]) {
+                count += test_ulps_mismatch(
+                        doubles_1[i], doubles_2[i],
+                        test_ulps_double(doubles_1[i], doubles_2[i]),
+                        max_ulps);
+            }
+        }
+    } else if (floats) {
+        for (; i < length; i++) {
+            count += test_near_mismatch(floats_1[i], floats_2[i], absolute,
+                                        relative);
+        }
+    } else {
+        for (; i < length; i++) {
+            count += test_near_mismatch(doubles_1[i], doubles_2[i], absolute,
+                                        relative);
+        }
+    }
+    return count;
+}
+
+/**
+ * Record the failure of a comparison of two arrays in which
+ * <code>test_count_mismatches</code> found mismatched elements given the same
+ * arguments.  The mismatches are found and counted again to report the worst
+ * of them, by difference or by distance in units in the last place, and the
+ * first _TEST_MAX_OFFENDERS.
+ */
+static _TEST_COLD void _TEST_UNUSED test_record_mismatches(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const void *array_1, const void *array_2, int floats,
+        unsigned long length, double absolute, double relative,
+        unsigned long max_ulps) {
+    const char *format = floats ? "%.9g vs %.9g" : "%.17g vs %.17g";
+    char summary[320], offenders[80 * _TEST_MAX_OFFENDERS + 32];
+    char *cursor = offenders;
+    unsigned long i, worst = 0, shown = 0;
+    unsigned long long ulps = 0, worst_ulps = 0;
+    double x, y, difference, worst_difference = -1;
+    int mismatch;
+
+    for (i = 0; i < length; i++) {
+        x = floats ? ((const float *) array_1)[i]
+                   : ((const double *) array_1)[i];
+        y = floats ? ((const float *) array_2)[i]
+                   : ((const double *) array_2)[i];
+        if (max_ulps > 0) {
+            ulps = floats ? test_ulps_float((float) x, (float) y)
+                          : test_ulps_double(x, y);
+            mismatch = test_ulps_mismatch(x, y, ulps, max_ulps);
+        } else {
+            mismatch = test_near_mismatch(x, y, absolute, relative);
+        }
+        if (!mismatch) {
+            continue;
+        }
+
+        /* A NaN compared with a number is as bad as an infinite difference. */
+        difference = x > y ? x - y : y - x;
+        if (difference != difference) {
+            difference = DBL_MAX;
+        }
+        if (max_ulps > 0 ? shown == 0 || ulps > worst_ulps
+                         : difference > worst_difference) {
+            worst = i;
+            worst_ulps = ulps;
+            worst_difference = difference;
+        }
+        if (shown < _TEST_MAX_OFFENDERS) {
+            cursor += sprintf(cursor, "%s[%lu] ", shown > 0 ? ", " : "", i);
+            cursor += sprintf(cursor, format, x, y);
+        }
+        shown++;
+    }
+    if (shown > _TEST_MAX_OFFENDERS) {
+        sprintf(cursor, ", and %lu more", shown - _TEST_MAX_OFFENDERS);
+    }
+
+    x = floats ? ((const float *) array_1)[worst]
+               : ((const double *) array_1)[worst];
+    y = floats ? ((const float *) array_2)[worst]
+               : ((const double *) array_2)[worst];
+    cursor = summary + sprintf(summary, "%lu of %lu elements differ, the "
+                               "worst at [%lu]: ", shown, length, worst);
+    cursor += sprintf(cursor, format, x, y);
+    if (max_ulps > 0) {
+        sprintf(cursor, " (%llu ulps, at most %lu)", worst_ulps, max_ulps);
+    } else {
+        x = x < 0 ? -x : x;
+        y = y < 0 ? -y : y;
+        sprintf(cursor, " (difference %.3g, tolerance %.3g)",
+                worst_difference, absolute + relative * (x > y ? x : y));
+    }
+    test_record_failure(file, line, expression, fatal, "%s", "%s", summary,
+                        offenders);
+}
+
+/**
+ * Compare the specified arrays of floats or doubles, recording a failure with
+ * the specified description if any of their elements are not near one another.
+ * The arguments are those of <code>test_count_mismatches</code>.
+ *
+ * @return 1 if every element matches, or 0 otherwise.
+ */
+static _TEST_UNUSED int test_arrays_near(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const void *array_1, const void *array_2, int floats,
+        unsigned long length, double absolute, double relative,
+        unsigned long max_ulps) {
+    if (_TEST_UNLIKELY(test_count_mismatches(array_1, array_2, floats, length,
+                                             absolute, relative, max_ulps)
+                       > 0)) {
+        test_record_mismatches(file, line, expression, fatal, array_1,
+                               array_2, floats, length, absolute, relative,
+                               max_ulps);
+        return 0;
+    }
+    return 1;
+}
+
+#if (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L) \
+    || defined(__cplusplus)
+/** Compare the specified arrays of floats, like <code>test_arrays_near</code>.
+ */
+static _TEST_UNUSED int test_floats_near(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const float *array_1, const float *array_2, unsigned long length,
+        double absolute, double relative, unsigned long max_ulps) {
+    return test_arrays_near(file, line, expression, fatal, array_1, array_2, 1,
+                            length, absolute, relative, max_ulps);
+}
+
+/** Compare the specified arrays of doubles, like <code>test_arrays_near</code>.
+ */
+static _TEST_UNUSED int test_doubles_near(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const double *array_1, const double *array_2, unsigned long length,
+        double absolute, double relative, unsigned long max_ulps) {
+    return test_arrays_near(file, line, expression, fatal, array_1, array_2, 0,
+                            length, absolute, relative, max_ulps);
+}
+#endif
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+/* Selected in place of the comparison of two arrays whose element types
+ * differ, so that calling it fails to compile with a message naming it. */
+static _TEST_UNUSED const int test_array_types_differ = 0;
+
+/* The comparison of arrays of floats or of doubles, selected by the type of
+ * the second array once that of the first is known. */
+#define _TEST_FLOATS_NEAR(ARRAY)                \
+    _Generic((ARRAY),                           \
+             float *: test_floats_near,         \
+             const float *: test_floats_near,   \
+             default: test_array_types_differ)
+#define _TEST_DOUBLES_NEAR(ARRAY)               \
+    _Generic((ARRAY),                           \
+             double *: test_doubles_near,       \
+             const double *: test_doubles_near, \
+             default: test_array_types_differ)
+
+/* Compare the specified arrays, which must both be of floats or both of
+ * doubles: arrays of any other type, or of two different types, fail to
+ * compile. */
+#define _TEST_ARRAYS_NEAR(FATAL, EXPRESSION, ARRAY_1, ARRAY_2, LENGTH,      \
+                          ABSOLUTE, RELATIVE, MAX_ULPS)                     \
+    _Generic((ARRAY_1),                                                     \
+             float *: _TEST_FLOATS_NEAR(ARRAY_2),                           \
+             const float *: _TEST_FLOATS_NEAR(ARRAY_2),                     \
+             double *: _TEST_DOUBLES_NEAR(ARRAY_2),                         \
+             const double *: _TEST_DOUBLES_NEAR(ARRAY_2))(                  \
+            __FILE__, __LINE__, EXPRESSION, FATAL, (ARRAY_1), (ARRAY_2),    \
+            (LENGTH), (ABSOLUTE), (RELATIVE), (MAX_ULPS))
+#elif defined(__cplusplus)
+/* C++ has no _Generic, but overloading selects the comparison of two arrays
+ * of floats or of doubles just as well, and finds none for other arrays. */
+static _TEST_UNUSED int test_typed_arrays_near(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const float *array_1, const float *array_2, unsigned long length,
+        double absolute, double relative, unsigned long max_ulps) {
+    return test_floats_near(file, line, expression, fatal, array_1, array_2,
+                            length, absolute, relative, max_ulps);
+}
+static _TEST_UNUSED int test_typed_arrays_near(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const double *array_1, const double *array_2, unsigned long length,
+        double absolute, double relative, unsigned long max_ulps) {
+    return test_doubles_near(file, line, expression, fatal, array_1, array_2,
+                             length, absolute, relative, max_ulps);
+}
+
+/* Compare the specified arrays, which must both be of floats or both of
+ * doubles: arrays of any other type, or of two different types, fail to
+ * compile. */
+#define _TEST_ARRAYS_NEAR(FATAL, EXPRESSION, ARRAY_1, ARRAY_2, LENGTH,      \
+                          ABSOLUTE, RELATIVE, MAX_ULPS)                     \
+    test_typed_arrays_near(__FILE__, __LINE__, EXPRESSION, FATAL,           \
+                           (ARRAY_1), (ARRAY_2), (LENGTH), (ABSOLUTE),      \
+                           (RELATIVE), (MAX_ULPS))
+#else
+/* Before C11, GCC and Clang can still compare the element types of two
+ * arrays, but other compilers only their sizes. */
+#if defined(__GNUC__)
+#define _TEST_SAME_TYPE(TYPE_1, TYPE_2) \
+    __builtin_types_compatible_p(TYPE_1, TYPE_2)
+#define _TEST_ELEMENT_TYPE(ARRAY) __typeof__(*(ARRAY))
+#else
+#define _TEST_SAME_TYPE(TYPE_1, TYPE_2) (sizeof(TYPE_1) == sizeof(TYPE_2))
+#define _TEST_ELEMENT_TYPE(ARRAY) *(ARRAY)
+#endif
+
+/* Compare the specified arrays, which must both be of floats or both of
+ * doubles: arrays of any other type, or of two different types, fail to
+ * compile as far as the compiler can tell them apart. */
+#define _TEST_ARRAYS_NEAR(FATAL, EXPRESSION, ARRAY_1, ARRAY_2, LENGTH,      \
+                          ABSOLUTE, RELATIVE, MAX_ULPS)                     \
+    test_arrays_near(__FILE__, __LINE__, EXPRESSION, FATAL, (ARRAY_1),      \
+                     (ARRAY_2),                                             \
+                     sizeof(char[_TEST_SAME_TYPE(                           \
+                                         _TEST_ELEMENT_TYPE(ARRAY_1),       \
+                                         _TEST_ELEMENT_TYPE(ARRAY_2))       \
+                                 && (_TEST_SAME_TYPE(                       \
+                                             _TEST_ELEMENT_TYPE(ARRAY_1),   \
+                                             float)                         \
+                                     || _TEST_SAME_TYPE(                    \
+                                             _TEST_ELEMENT_TYPE(ARRAY_1),   \
+                                             double)) ? 1 : -1])            \
+                     && sizeof(*(ARRAY_1)) == sizeof(float), (LENGTH),      \
+                     (ABSOLUTE), (RELATIVE), (MAX_ULPS))
+#endif
+
+/**
+ * Assert that the first specified number of elements of the specified arrays
+ * of floats or doubles are near one another: that each pair differs by no more
+ * than the absolute tolerance plus the relative tolerance times the larger
+ * magnitude of the two.  NaNs match only NaNs, and infinities only infinities
+ * of the same sign.  The arrays are compared in a single vectorisable pass,
+ * and on failure, the number of mismatched elements, the worst of them, and
+ * the first few are printed.  Both arrays must have the same element type,
+ * which with C11 is checked when compiling.
+ */
+#define ASSERT_ARRAY_NEAR(ARRAY_1, ARRAY_2, LENGTH, ABSOLUTE, RELATIVE)       \
+    do {                                                                      \
+        if (!_TEST_ARRAYS_NEAR(1, "(" #ARRAY_1 ") near (" #ARRAY_2 ") for ("  \
+                               #LENGTH ") elements", ARRAY_1, ARRAY_2,        \
+                               LENGTH, ABSOLUTE, RELATIVE, 0)) {              \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
+
+/**
+ * Assert that the first specified number of elements of the specified arrays
+ * of floats or doubles are at most the specified number of units in the last
+ * place apart.  Otherwise like <code>ASSERT_ARRAY_NEAR</code>.
+ */
+#define ASSERT_ARRAY_ULP(ARRAY_1, ARRAY_2, LENGTH, MAX_ULPS)                  \
+    do {                                                                      \
+        if (!_TEST_ARRAYS_NEAR(1, "(" #ARRAY_1 ") within (" #MAX_ULPS         \
+                               ") ulps of (" #ARRAY_2 ") for (" #LENGTH       \
+                               ") elements", ARRAY_1, ARRAY_2, LENGTH, 0, 0,  \
+                               MAX_ULPS)) {                                   \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
+
+/*
+ * Each of the assertions above has a non-fatal counterpart, an expectation,
+ * whose name begins with EXPECT_ rather than ASSERT_.  An expectation that
+ * fails marks the test as failed, but lets it continue, so that a test which
+ * checks many independent properties reports all of those that do not hold in
+ * a single run rather than only the first:
+ *
+ * @code{.c}
+ * TEST(Decode_header, Some_fixture) {
+ *     ASSERT_EQ(decode(&TEST->header, TEST->bytes), 0, "%d");
+ *     EXPECT_EQ(TEST->header.version, 2, "%d");
+ *     EXPECT_EQ(TEST->header.flags, 0x80, "%#x");
+ *     EXPECT_STREQ(TEST->header.name, "example");
+ * }
+ * @endcode
+ *
+ * Use an assertion where the rest of the test cannot sensibly run if the check
+ * fails, such as before dereferencing a pointer that may be NULL.
+ */
+
+/** Expect that the specified predicate evaluates to a truthy (non-0) value. */
+#define EXPECT_TRUE(PREDICATE)                                             \
+    _TEST_EXPECT(0, "TRUE (!= 0)", "%s", !=, PREDICATE, (PREDICATE), "%d", \
+            "Expression is true: (" #PREDICATE ")")
+
+/** Expect that the specified predicate evaluates to a falsy (0) value. */
+#define EXPECT_FALSE(PREDICATE)                                          \
+    _TEST_EXPECT(0, "FALSE (0)", "%s", ==, PREDICATE, (PREDICATE), "%d", \
+            "Expression is false: (" #PREDICATE ")")
+
+/** Expect that the specified pointer is null (0). */
+#define EXPECT_NULL(PTR)                                         \
+    _TEST_EXPECT(NULL, "NULL (0x0)", "%s", ==, PTR, (PTR), "%p", \
+            "Pointer is non-null: (" #PTR ")")
+
+/** Expect that the specified pointer is non-null (non-0). */
+#define EXPECT_NON_NULL(PTR)                                            \
+    _TEST_EXPECT(NULL, "Non-null (!= 0x0)", "%s", !=, PTR, (PTR), "%p", \
+            "Pointer is null: (" #PTR ")")
+
+/** Expect that the first specified value is equal to the second. */
+#define EXPECT_EQ(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_EXPECT(VALUE_1, (VALUE_1), FORMAT, ==, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") == (" #VALUE_2 ")")
+
+/** Expect that the first specified value is not equal to the second. */
+#define EXPECT_NE(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_EXPECT(VALUE_1, (VALUE_1), FORMAT, !=, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") != (" #VALUE_2 ")")
+
+/** Expect that the first specified value is greater than the second. */
+#define EXPECT_GT(VALUE_1, VALUE_2, FORMAT)                                 \
+    _TEST_EXPECT(VALUE_1, (VALUE_1), FORMAT, >, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") > (" #VALUE_2 ")")
+
+/** Expect that the first specified value is at least the second. */
+#define EXPECT_GE(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_EXPECT(VALUE_1, (VALUE_1), FORMAT, >=, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") >= (" #VALUE_2 ")")
+
+/** Expect that the first specified value is less than the second. */
+#define EXPECT_LT(VALUE_1, VALUE_2, FORMAT)                                 \
+    _TEST_EXPECT(VALUE_1, (VALUE_1), FORMAT, <, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") < (" #VALUE_2 ")")
+
+/** Expect that the first specified value is at most the second. */
+#define EXPECT_LE(VALUE_1, VALUE_2, FORMAT)                                  \
+    _TEST_EXPECT(VALUE_1, (VALUE_1), FORMAT, <=, VALUE_2, (VALUE_2), FORMAT, \
+            "(" #VALUE_1 ") <= (" #VALUE_2 ")")
+
+/** Expect that the contents of the specified strings are equal. */
+#define EXPECT_STREQ(STR_1, STR_2)                                            \
+    _TEST_EXPECT(strcmp((STR_1), (STR_2)), (STR_1), "\"%s\"", ==, 0, (STR_2), \
+            "\"%s\"", "(" #STR_1 ") == (" #STR_2 ")")
+
+/** Expect that the contents of the specified strings are not equal. */
+#define EXPECT_STRNE(STR_1, STR_2)                                            \
+    _TEST_EXPECT(strcmp((STR_1), (STR_2)), (STR_1), "\"%s\"", !=, 0, (STR_2), \
+            "\"%s\"", "(" #STR_1 ") != (" #STR_2 ")")
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+/** Expect that the first specified value is equal to the second. */
+#define EXPECT_EQUAL(VALUE_1, VALUE_2) _TEST_EXPECT_TYPED(VALUE_1, ==, VALUE_2)
+
+/** Expect that the first specified value is not equal to the second. */
+#define EXPECT_NOT_EQUAL(VALUE_1, VALUE_2) \
+    _TEST_EXPECT_TYPED(VALUE_1, !=, VALUE_2)
+
+/** Expect that the first specified value is greater than the second. */
+#define EXPECT_GREATER(VALUE_1, VALUE_2) _TEST_EXPECT_TYPED(VALUE_1, >, VALUE_2)
+
+/** Expect that the first specified value is at least the second. */
+#define EXPECT_GREATER_EQUAL(VALUE_1, VALUE_2) \
+    _TEST_EXPECT_TYPED(VALUE_1, >=, VALUE_2)
+
+/** Expect that the first specified value is less than the second. */
+#define EXPECT_LESS(VALUE_1, VALUE_2) _TEST_EXPECT_TYPED(VALUE_1, <, VALUE_2)
+
+/** Expect that the first specified value is at most the second. */
+#define EXPECT_LESS_EQUAL(VALUE_1, VALUE_2) \
+    _TEST_EXPECT_TYPED(VALUE_1, <=, VALUE_2)
+#endif
+
+/**
+ * Expect that the first specified number of bytes of the specified buffers are
+ * equal.
+ */
+#define EXPECT_MEMEQ(BUFFER_1, BUFFER_2, LENGTH)                            \
+    ((void) test_memeq(__FILE__, __LINE__, "(" #BUFFER_1 ") == (" #BUFFER_2 \
+                       ") for (" #LENGTH ") bytes", 0, (BUFFER_1),          \
+                       (BUFFER_2), (LENGTH)))
+
+/**
+ * Expect that the first specified number of elements of the specified arrays
+ * of floats or doubles are near one another.
+ */
+#define EXPECT_ARRAY_NEAR(ARRAY_1, ARRAY_2, LENGTH, ABSOLUTE, RELATIVE)       \
+    ((void) _TEST_ARRAYS_NEAR(0, "(" #ARRAY_1 ") near (" #ARRAY_2 ") for ("   \
+                              #LENGTH ") elements", ARRAY_1, ARRAY_2, LENGTH, \
+                              ABSOLUTE, RELATIVE, 0))
+
+/**
+ * Expect that the first specified number of elements of the specified arrays
+ * of floats or doubles are at most the specified number of units in the last
+ * place apart.
+ */
+#define EXPECT_ARRAY_ULP(ARRAY_1, ARRAY_2, LENGTH, MAX_ULPS)                  \
+    ((void) _TEST_ARRAYS_NEAR(0, "(" #ARRAY_1 ") within (" #MAX_ULPS          \
+                              ") ulps of (" #ARRAY_2 ") for (" #LENGTH        \
+                              ") elements", ARRAY_1, ARRAY_2, LENGTH, 0, 0,   \
+                              MAX_ULPS))
+
+/* Run the block following this directive once between the specified calls
+ * entering and leaving it, terminating the test if the block fails the check
+ * made on leaving it. */
+#define _TEST_SCOPE(ENTER, STEP)     \
+    for (ENTER; STEP; )              \
+        if (test_scope_failed) {     \
+            return;                  \
+        } else
+
+/* Run the block following this directive, then fail the test with the
+ * specified message if it made more than the specified number of calls to the
+ * allocator. */
+#define _TEST_ALLOC_SCOPE(LIMIT, MSG)                                        \
+    _TEST_SCOPE(test_alloc_scope_enter(),                                    \
+                test_alloc_scope_step((unsigned long) (LIMIT), __FILE__,     \
+                                      __LINE__, MSG))
+
+/**
+ * Assert that the block of code following this directive makes at most the
+ * specified number of calls to <code>malloc</code>, <code>calloc</code>,
+ * <code>realloc</code>, or the aligned allocation functions, be it directly or
+ * within the functions that it calls.  Example:
+ *
+ * @code{.c}
+ * TEST(Push_reuses_capacity, Some_fixture) {
+ *     vector_reserve(&TEST->vector, 64);
+ *     ASSERT_MAX_ALLOCS(0) {
+ *         vector_push(&TEST->vector, 42);
+ *     }
+ * }
+ * @endcode
+ *
+ * Allocations are only counted if <code>TEST_COUNT_ALLOCATIONS</code> is
+ * defined before this file is included, and only on Linux; otherwise, the
+ * block is simply run.  The block must not be left with <code>break</code> or
+ * <code>goto</code>.
+ */
+#define ASSERT_MAX_ALLOCS(LIMIT) \
+    _TEST_ALLOC_SCOPE(LIMIT, "Block allocates more than (" #LIMIT ") time(s)")
+
+/**
+ * Assert that the block of code following this directive makes no calls to
+ * the allocator at all, as for a hot path that should only use memory that it
+ * was given in advance.
+ *
+ * @see ASSERT_MAX_ALLOCS
+ */
+#define ASSERT_NO_ALLOC _TEST_ALLOC_SCOPE(0, "Block allocates memory")
+
+/**
+ * Assert that running the block of code following this directive causes at
+ * most the specified number of the specified hardware event, one of
+ * <code>cycles</code>, <code>instructions</code>, <code>l1d_misses</code>
+ * (level 1 data cache read misses), <code>cache_misses</code> (last-level
+ * cache misses), and <code>branch_misses</code>, as counted by the processor
+ * for the test's process.  Example:
+ *
+ * @code{.c}
+ * TEST(Lookup_stays_in_cache, Some_fixture) {
+ *     ASSERT_COUNTER_LE(cache_misses, 64) {
+ *         table_lookup(&TEST->table, "key");
+ *     }
+ * }
+ * @endcode
+ *
+ * Events are counted with <code>perf_event_open</code> on Linux, whether or
+ * not the test run counts them for every test, as for the
+ * <code>--counters</code> option.  Where they cannot be counted, on other
+ * platforms or where <code>perf_event_paranoid</code> forbids it, the block is
+ * simply run.  The block must not be left with <code>break</code> or
+ * <code>goto</code>.
+ */
+#define ASSERT_COUNTER_LE(COUNTER, LIMIT)                                     \
+    _TEST_SCOPE(test_counter_scope_enter(),                                   \
+                test_counter_scope_step(offsetof(struct test_counters,        \
+                                                 COUNTER),                    \
+                                        (double) (LIMIT), __FILE__, __LINE__, \
+                                        "Block counts more " #COUNTER         \
+                                        " than (" #LIMIT ")"))
+
+/* ******************************* BENCHMARKS ******************************* */
+
+#if defined(__GNUC__) || defined(__clang__)
+/**
+ * Prevent the compiler from optimising away the computation of the specified
+ * scalar value, for instance the result of the operation under test in a
+ * benchmark.  To keep an aggregate alive, pass its address instead.
+ */
+#define DO_NOT_OPTIMIZE(VALUE) \
+    __asm__ __volatile__("" : : "g"(VALUE) : "memory")
+
+/**
+ * Prevent the compiler from assuming anything about the contents of memory
+ * across this point, forcing pending writes to be performed and values to be
+ * re-read afterwards.
+ */
+#define CLOBBER_MEMORY() __asm__ __volatile__("" : : : "memory")
+#else
+/* Without inline assembly, escape values through a volatile sink instead. */
+static volatile int test_benchmark_sink;
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CLOBBER_MEMORY() _ReadWriteBarrier()
+#else
+#define CLOBBER_MEMORY() ((void) test_benchmark_sink)
+#endif
+#define DO_NOT_OPTIMIZE(VALUE) \
+    (CLOBBER_MEMORY(), test_benchmark_sink = (VALUE) != 0)
+#endif
+
+/** The loop of a benchmark: runs its body the specified number of times. */
+typedef void (*test_benchmark_fn_t)(void *, const void *, unsigned long);
+
+/**
+ * Comparison function for qsort, ordering doubles in ascending order.
+ */
+static int test_compare_double(const void *a, const void *b) {
+    double value_a = *(const double *) a, value_b = *(const double *) b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+/**
+ * Compute the square root of the specified non-negative value by Newton's
+ * method, avoiding a dependency on the maths library.
+ */
+static double test_sqrt(double value) {
+    double root = value > 1 ? value : 1, previous;
+    int i;
+    if (value <= 0) {
+        return 0;
+    }
+    for (i = 0; i < 200; i++) {
+        previous = root;
+        root = (root + value / root) / 2;
+        if (root >= previous) {
+            break;
+        }
+    }
+    return root;
+}
+
+/**
+ * Compute the summary statistics of the repetitions of the specified benchmark.
+ *
+ * @param benchmark The benchmark whose samples to summarise.
+ */
+static void test_benchmark_statistics(struct test_benchmark *benchmark) {
+    double sorted[_TEST_MAX_REPETITIONS], sum = 0, squares = 0, deviation;
+    unsigned long count = benchmark->repetitions, i;
+
+    memcpy(sorted, benchmark->samples, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), test_compare_double);
+    for (i = 0; i < count; i++) {
+        sum += sorted[i];
+    }
+    benchmark->mean = sum / count;
+    for (i = 0; i < count; i++) {
+        deviation = sorted[i] - benchmark->mean;
+        squares += deviation * deviation;
+    }
+
+    benchmark->min = sorted[0];
+    benchmark->median = count % 2 ? sorted[count / 2]
+                        : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+    benchmark->stddev = count > 1 ? test_sqrt(squares / (count - 1)) : 0;
+    /* Nearest-rank percentile. */
+    benchmark->p99 = sorted[(count * 99 + 99) / 100 - 1];
+}
+
+/**
+ * Benchmark harness.  Runs the specified benchmark loop with an iteration
+ * count calibrated so that each repetition takes at least the target duration
+ * of the test run, then times the configured number of repetitions, recording
+ * the results in <code>test_last_benchmark</code>.  Unless benchmarks are
+ * enabled for the test run, the body is simply run once as a smoke test.
+ *
+ * @param data The fixture data of the benchmark.
+ * @param shared The shared state of the fixture of the benchmark.
+ * @param loop The loop function of the benchmark.
+ */
+static void _TEST_UNUSED test_benchmark_run(void *data, const void *shared,
+                                          test_benchmark_fn_t loop) {
+    struct test_benchmark *benchmark = &test_last_benchmark;
+    struct test_counters start_counters, counters;
+    unsigned long iterations = 1, i;
+    test_ns_t start, elapsed;
+    double growth;
+    int event;
+
+    if (!test_options.bench) {
+        loop(data, shared, 1);
+        return;
+    }
+
+    /* Grow the iteration count geometrically until a batch takes at least the
+     * target time, aiming a little beyond it to converge quickly.  The final
+     * calibration batch doubles as a warm-up. */
+    for (;;) {
+        start = test_clock_ns();
+        loop(data, shared, iterations);
+        elapsed = test_clock_ns() - start;
+        if (test_last_status != TEST_PASSED) {
+            return;
+        } else if (elapsed >= test_options.bench_ns
+                   || iterations > (unsigned long) -1 / 10) {
+            break;
+        }
+        growth = elapsed > 0 ? 1.4 * test_options.bench_ns / elapsed : 10;
+        growth = growth < 2 ? 2 : growth > 10 ? 10 : growth;
+        iterations = (unsigned long) (iterations * growth);
+    }
+
+    /* Hardware events are counted around each timed repetition, and
+     * reported per iteration. */
+    benchmark->iterations = iterations;
+    benchmark->repetitions = test_options.bench_repetitions;
+    benchmark->counted = test_options.counters && test_counters_open() == NULL;
+    memset(&benchmark->counters, 0, sizeof(benchmark->counters));
+    for (i = 0; i < benchmark->repetitions; i++) {
+        benchmark->counted = benchmark->counted
+                             && test_counters_read(&start_counters);
+        start = test_clock_ns();
+        loop(data, shared, iterations);
+        elapsed = test_clock_ns() - start;
+        benchmark->counted = benchmark->counted
+                             && test_counters_since(&start_counters,
+                                                    &counters);
+        if (test_last_status != TEST_PASSED) {
+            return;
+        }
+        benchmark->samples[i] = (double) elapsed / iterations;
+        for (event = 0; benchmark->counted && event < _TEST_COUNTER_EVENTS;
+             event++) {
+            _TEST_COUNTER(&benchmark->counters, event) +=
+                _TEST_COUNTER(&counters, event)
+                / ((double) iterations * benchmark->repetitions);
+        }
+    }
+    test_benchmark_statistics(benchmark);
+    benchmark->measured = 1;
+}
+
+/**
+ * Declare a microbenchmark with the specified name, belonging to the specified
+ * fixture.  The body of the benchmark is the operation to be measured, and is
+ * run in a tight loop by the benchmark harness: the number of iterations per
+ * repetition is calibrated automatically to reach a target duration, after
+ * which a number of repetitions are timed and the time per iteration is
+ * reported as its median, mean, minimum, 99th percentile, and standard
+ * deviation.  Like a test, the fixture's setup and teardown functions are run
+ * once before and after the benchmark, outside of the timed region, and the
+ * fixture's data members are available via <code>TEST</code>.  Example:
+ *
+ * @code{.c}
+ * BENCHMARK(String_length, Some_fixture) {
+ *     DO_NOT_OPTIMIZE(strlen(TEST->message));
+ * }
+ * @endcode
+ *
+ * Benchmarks are only measured if the test run is started with the
+ * <code>--bench</code> option; otherwise, their bodies are run once and they
+ * are reported like any other test.  When tests are run in parallel,
+ * benchmarks are run one at a time once all other tests have completed.  If an
+ * assertion in the body fails, the benchmark stops once the current batch of
+ * iterations is complete.  This directive must be written within a
+ * <code>TEST_START</code>, <code>TEST_END</code> block.
+ */
+#define BENCHMARK(NAME, FIXTURE)                                               \
+    /* Forward declare the body to allow standard function syntax. */         \
+    static void FIXTURE ## _ ## NAME ## _bench_body(                          \
+            struct FIXTURE ## _fixture_data *,                                \
+            const struct FIXTURE ## _fixture_shared *);                       \
+    /* The benchmark loop, into which the body can be inlined. */             \
+    static void FIXTURE ## _ ## NAME ## _bench_loop(void *data,               \
+                                                    const void *shared,       \
+                                                    unsigned long count) {    \
+        while (count-- > 0) {                                                 \
+            FIXTURE ## _ ## NAME ## _bench_body(                              \
+                    (struct FIXTURE ## _fixture_data *) data,                 \
+                    (const struct FIXTURE ## _fixture_shared *) shared);      \
+        }                                                                     \
+    }                                                                         \
+    /* The test function run by the runner: hands the loop to the harness. */ \
+    static void FIXTURE ## _ ## NAME ## _bench(void *data,                    \
+                                               const void *shared) {          \
+        test_benchmark_run(data, shared, FIXTURE ## _ ## NAME ## _bench_loop);\
+    }                                                                         \
+    _TEST_DECLARE(FIXTURE ## _ ## NAME ## _case, #NAME, FIXTURE, NULL,        \
+                  FIXTURE ## _ ## NAME ## _bench, _TEST_BENCHMARK, NULL)      \
+    /* And finally, the user-declared body of the benchmark. */               \
+    static void FIXTURE ## _ ## NAME ## _bench_body(                          \
+            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,               \
+            const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED)
+
+/* ***************************** THREADED TESTS ***************************** */
+
+#ifdef _TEST_THREADS
+/**
+ * Run the body of a threaded test as the specified one of its threads: wait
+ * until every thread is released at once, then run the body for the number of
+ * iterations or the duration of the test, stopping early once a fatal check
+ * fails on any thread.
+ *
+ * @param thread The thread to run the body as.
+ */
+static void test_thread_main(struct test_thread *thread) {
+    struct test_threads *run = &test_last_threads;
+    unsigned long iterations = 0, batch = 1, i;
+    test_ns_t now, last, deadline;
+
+    test_current_thread = thread;
+    _TEST_ATOMIC_INCREMENT(run->ready);
+    while (!_TEST_ATOMIC_READ(run->go)) {
+        _TEST_YIELD();
+    }
+    if (run->iterations > 0) {
+        while (iterations < run->iterations && !_TEST_ATOMIC_READ(run->stop)) {
+            run->body(run->data, run->shared);
+            iterations++;
+        }
+    } else {
+        /* The clock is read after every batch of iterations, and batches
+         * double until they take at least 100 microseconds. */
+        deadline = run->start_ns + run->duration_ns;
+        last = run->start_ns;
+        while (!_TEST_ATOMIC_READ(run->stop)) {
+            for (i = 0; i < batch && !_TEST_ATOMIC_READ(run->stop); i++) {
+                run->body(run->data, run->shared);
+            }
+            iterations += i;
+            now = test_clock_ns();
+            if (now >= deadline) {
+                break;
+            } else if (now - last < 100000 && batch < 1048576) {
+                batch *= 2;
+            }
+            last = now;
+        }
+    }
+    thread->iterations = iterations;
+    thread->elapsed_ns = test_clock_ns() - run->start_ns;
+    test_current_thread = NULL;
+    _TEST_ATOMIC_DECREMENT(run->running);
+}
+
+/* The entry point of the threads of threaded tests.  It and the functions that
+ * start and join them are inline, so that only the units that declare threaded
+ * tests call for the threads library (pthreads before glibc 2.34). */
+#ifdef _WIN32
+static _TEST_INLINE DWORD WINAPI test_thread_start(LPVOID thread) {
+    test_thread_main((struct test_thread *) thread);
+    return 0;
+}
+#else
+static _TEST_INLINE void *test_thread_start(void *thread) {
+    test_thread_main((struct test_thread *) thread);
+    return NULL;
+}
+#endif
+
+/**
+ * Join the threads of the last threaded test once their bodies have stopped,
+ * leaving the memory that the threads library frees out of the accounting of
+ * the current test.
+ */
+static _TEST_INLINE void test_threads_join(void) {
+    struct test_threads *run = &test_last_threads;
+    int counting = test_alloc_counting;
+    unsigned i;
+
+    test_alloc_counting = 0;
+    for (i = 0; i < run->joinable; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(run->threads[i].handle, INFINITE);
+        CloseHandle(run->threads[i].handle);
+#else
+        pthread_join(run->threads[i].handle, NULL);
+#endif
+    }
+    run->joinable = 0;
+    test_alloc_counting = counting;
+}
+#endif
+
+/**
+ * Run the body of a threaded test on the specified number of threads, all
+ * released together once every one of them has started, and record how many
+ * iterations each of them got through in <code>test_last_threads</code>.
+ *
+ * @param body The body of the test.
+ * @param data The fixture data of the test, shared by every thread.
+ * @param shared The shared state of the fixture of the test.
+ * @param threads The number of threads, or 0 for one per CPU.
+ * @param iterations The number of times that each thread runs the body.
+ * @param milliseconds How long each thread runs the body for instead, or 0
+ *                     to run it for the number of iterations.
+ */
+static _TEST_INLINE void test_threads_run(test_fn_t body, void *data,
+                                          const void *shared, unsigned threads,
+                                          unsigned long iterations,
+                                          unsigned long milliseconds) {
+#ifdef _TEST_THREADS
+    struct test_threads *run = &test_last_threads;
+    int counting = test_alloc_counting;
+    unsigned i;
+#ifdef _WIN32
+    SYSTEM_INFO system;
+#else
+    sigset_t alarm, mask;
+    struct timespec pause;
+    long processors;
+#endif
+
+    /* The threads of a test that timed out are joined once they stop. */
+    if (run->joinable > 0) {
+        if (_TEST_ATOMIC_READ(run->running) > 0) {
+            strcpy(test_failure_message,
+                   "The threads of a test that timed out are still running.");
+            test_last_status = TEST_FAILED;
+            return;
+        }
+        test_threads_join();
+    }
+    if (threads == 0) {
+#ifdef _WIN32
+        GetSystemInfo(&system);
+        threads = (unsigned) system.dwNumberOfProcessors;
+#else
+        processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = processors > 0 ? (unsigned) processors : 1;
+#endif
+    }
+    if (threads > _TEST_MAX_THREADS) {
+        threads = _TEST_MAX_THREADS;
+    }
+    memset(run->threads, 0, threads * sizeof(*run->threads));
+    for (i = 0; i < threads; i++) {
+        run->threads[i].index = i;
+    }
+    run->count = threads;
+    run->body = body;
+    run->data = data;
+    run->shared = shared;
+    run->iterations = milliseconds > 0 ? 0 : iterations > 0 ? iterations : 1;
+    run->duration_ns = (test_ns_t) milliseconds * 1000000;
+    run->failed_thread = 0;
+    run->ready = run->go = run->stop = run->running = run->failures = 0;
+
+    /* The watchdog's signal is to interrupt the runner, not the threads, and
+     * the memory that the threads library allocates for them is the runner's,
+     * not the test's. */
+    test_alloc_counting = 0;
+#ifndef _WIN32
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, &mask);
+#endif
+    for (i = 0; i < threads; i++) {
+        _TEST_ATOMIC_INCREMENT(run->running);
+#ifdef _WIN32
+        run->threads[i].handle = CreateThread(NULL, 0, test_thread_start,
+                                              &run->threads[i], 0, NULL);
+        if (run->threads[i].handle == NULL) {
+#else
+        if (pthread_create(&run->threads[i].handle, NULL, test_thread_start,
+                           &run->threads[i]) != 0) {
+#endif
+            _TEST_ATOMIC_DECREMENT(run->running);
+            sprintf(test_failure_message, "Could not start thread %u of %u.",
+                    i + 1, threads);
+            test_last_status = TEST_FAILED;
+            _TEST_ATOMIC_WRITE(run->stop, 1);
+            break;
+        }
+        run->joinable++;
+    }
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+#endif
+
+    while (_TEST_ATOMIC_READ(run->ready) < (long) run->joinable) {
+        _TEST_YIELD();
+    }
+    test_alloc_counting = counting;
+    run->start_ns = test_clock_ns();
+    _TEST_ATOMIC_WRITE(run->go, 1);
+
+    /* Counting is paused while the threads are joined, so the bodies must
+     * have stopped first; the runner sleeps rather than take a CPU from them
+     * meanwhile. */
+#ifndef _WIN32
+    pause.tv_sec = 0;
+    pause.tv_nsec = 1000000;
+#endif
+    while (_TEST_ATOMIC_READ(run->running) > 0) {
+#ifdef _WIN32
+        Sleep(1);
+#else
+        nanosleep(&pause, NULL);
+#endif
+    }
+    test_threads_join();
+    run->measured = i == threads;
+    if (run->failures > 1) {
+        test_failures_omitted += run->failures - 1;
+    }
+#else
+    (void) body, (void) data, (void) shared, (void) threads;
+    (void) iterations, (void) milliseconds;
+    strcpy(test_failure_message,
+           "Threaded tests are not supported on this platform.");
+    test_last_status = TEST_SKIPPED;
+#endif
+}
+
+/**
+ * The index of the thread of a threaded test on which it is evaluated, from 0
+ * to <code>THREAD_COUNT - 1</code>, or 0 outside of threaded tests.  It can be
+ * used to give each thread a share of the work, or a slot of its own in the
+ * fixture data.
+ */
+#define THREAD_INDEX \
+    (test_current_thread != NULL ? test_current_thread->index : 0u)
+
+/** The number of threads on which the current threaded test is run. */
+#define THREAD_COUNT (test_last_threads.count)
+
+/* Declare a threaded test whose body is run by each of the specified number
+ * of threads for the specified number of iterations or milliseconds. */
+#define _TEST_THREADED_TEST(NAME, FIXTURE, THREADS, ITERATIONS, MILLISECONDS) \
+    /* Forward declare the body to allow standard function syntax. */         \
+    static void FIXTURE ## _ ## NAME ## _thread(                              \
+            struct FIXTURE ## _fixture_data *,                                \
+            const struct FIXTURE ## _fixture_shared *);                       \
+    /* The test function run by the runner: runs the body on every thread. */ \
+    static void FIXTURE ## _ ## NAME ## _test(void *data,                     \
+                                              const void *shared) {           \
+        test_threads_run((test_fn_t) FIXTURE ## _ ## NAME ## _thread, data,   \
+                         shared, THREADS, ITERATIONS, MILLISECONDS);          \
+    }                                                                         \
+    _TEST_DECLARE(FIXTURE ## _ ## NAME ## _case, #NAME, FIXTURE, NULL,        \
+                  FIXTURE ## _ ## NAME ## _test, _TEST_THREADED, NULL)        \
+    /* And finally, the user-declared body of the threaded test. */           \
+    static void FIXTURE ## _ ## NAME ## _thread(                              \
+            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,               \
+            const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED)
+
+/**
+ * Declare a threaded test with the specified name, belonging to the specified
+ * fixture, whose body is run once by each of the specified number of threads,
+ * or by one thread per CPU if it is 0.  The threads are all started before any
+ * of them is released into the body, so that they contend with each other
+ * from the first instruction; <code>THREAD_INDEX</code> tells them apart.
+ * Example:
+ *
+ * @code{.c}
+ * THREADED_TEST(Concurrent_push, Queue_fixture, 16) {
+ *     ASSERT_TRUE(queue_push(&TEST->queue, THREAD_INDEX));
+ * }
+ * @endcode
+ *
+ * The fixture is set up once for all of the threads, which share its data.
+ * Assertions and expectations can be used on any thread: the first check to
+ * fail on any thread is reported, and the rest are counted, and a failed
+ * assertion stops every thread, each once its current iteration is done.
+ * Other directives that change the state of the test, like
+ * <code>SKIP_IF</code> and the scoped checks of allocations and hardware
+ * events, can only be used outside of the body.  The number of iterations of
+ * each thread and their rates are reported.  When tests are run in parallel,
+ * threaded tests are run one at a time once all other tests have completed.
+ * This directive must be written within a <code>TEST_START</code>,
+ * <code>TEST_END</code> block.
+ */
+#define THREADED_TEST(NAME, FIXTURE, THREADS) \
+    _TEST_THREADED_TEST(NAME, FIXTURE, THREADS, 1, 0)
+
+/**
+ * Declare a threaded test, as with <code>THREADED_TEST</code>, whose body is
+ * run by each thread the specified number of times.
+ */
+#define THREADED_TEST_ITERATIONS(NAME, FIXTURE, THREADS, ITERATIONS) \
+    _TEST_THREADED_TEST(NAME, FIXTURE, THREADS, ITERATIONS, 0)
+
+/**
+ * Declare a threaded test, as with <code>THREADED_TEST</code>, whose body is
+ * run by each thread over and over for the specified number of milliseconds,
+ * which must be well within the timeout of the test.  The rate at which each
+ * thread gets through the body shows how well the code under test scales as
+ * threads contend for it.
+ */
+#define THREADED_TEST_DURATION(NAME, FIXTURE, THREADS, MILLISECONDS) \
+    _TEST_THREADED_TEST(NAME, FIXTURE, THREADS, 0, MILLISECONDS)
+
+/* ******************************** LATENCY ********************************* */
+
+/* Latencies below twice this many nanoseconds are recorded exactly, and each
+ * power of two above is split into this many buckets, so that the bucket of a
+ * latency is at most 1/64 of it wide. */
+#define _TEST_HISTOGRAM_SUBBUCKETS 64
+#define _TEST_HISTOGRAM_SHIFT 6
+
+/* The number of buckets of a histogram of latencies, the last of which holds
+ * every latency from 127 * 2^33 ns (about 18 minutes) up. */
+#define _TEST_HISTOGRAM_BUCKETS 2240
+
+/**
+ * A histogram of latencies, filled by <code>MEASURE_LATENCY</code>.  Its
+ * buckets widen with the latencies that they hold, as in an HDR histogram, so
+ * that every latency is recorded with the same relative precision in a fixed
+ * amount of memory, without any allocation.
+ */
+struct test_histogram {
+    unsigned long counts[_TEST_HISTOGRAM_BUCKETS];  /**< Latencies by bucket. */
+    unsigned long samples;     /**< The number of latencies recorded. */
+    test_ns_t min;             /**< The shortest latency. */
+    test_ns_t max;             /**< The longest latency. */
+    double total;              /**< The sum of all latencies. */
+    unsigned long remaining;   /**< Iterations of the block yet to run. */
+    int timing;                /**< Whether an iteration is being timed. */
+    test_ns_t start;           /**< When the iteration started. */
+    const char *name;          /**< What is measured, as named by the block. */
+    const char *file;          /**< Source file of the block. */
+    unsigned line;             /**< Source line of the block. */
+};
+
+/**
+ * Find the bucket of a histogram that holds the specified latency.
+ *
+ * @param ns The latency in nanoseconds.
+ * @return The index of its bucket.
+ */
+static unsigned test_histogram_bucket(test_ns_t ns) {
+    unsigned shift;
+
+    if (ns < 2 * _TEST_HISTOGRAM_SUBBUCKETS) {
+        return (unsigned) ns;
+    } else if (ns >> 40 != 0) {
+        return _TEST_HISTOGRAM_BUCKETS - 1;
+    }
+#if defined(__GNUC__)
+    shift = 63 - __builtin_clzll(ns) - _TEST_HISTOGRAM_SHIFT;
+#else
+    for (shift = 1; ns >> shift >= 2 * _TEST_HISTOGRAM_SUBBUCKETS; shift++) {
+    }
+#endif
+    return shift * _TEST_HISTOGRAM_SUBBUCKETS + (unsigned) (ns >> shift);
+}
+
+/**
+ * Find the latency at the specified percentile of a histogram: the least
+ * latency that at least that percentage of the recorded ones do not exceed,
+ * rounded up to the top of its bucket, but never beyond the longest.
+ *
+ * @param histogram The histogram.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The latency in nanoseconds, or 0 if none were recorded.
+ */
+static test_ns_t test_histogram_percentile(
+        const struct test_histogram *histogram, double percentile) {
+    double wanted = percentile / 100 * histogram->samples;
+    unsigned long rank = (unsigned long) wanted, seen = 0;
+    unsigned bucket, shift;
+    test_ns_t top;
+
+    if (histogram->samples == 0) {
+        return 0;
+    } else if (percentile <= 0) {
+        return histogram->min;
+    }
+    rank += rank < wanted;
+    for (bucket = 0; bucket < _TEST_HISTOGRAM_BUCKETS - 1; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    if (bucket < 2 * _TEST_HISTOGRAM_SUBBUCKETS) {
+        top = bucket;
+    } else {
+        shift = bucket / _TEST_HISTOGRAM_SUBBUCKETS - 1;
+        top = ((test_ns_t) (bucket - shift * _TEST_HISTOGRAM_SUBBUCKETS + 1)
+               << shift) - 1;
+    }
+    return bucket < _TEST_HISTOGRAM_BUCKETS - 1 && top < histogram->max
+           ? top : histogram->max;
+}
+
+/**
+ * Enter a <code>MEASURE_LATENCY</code> block, emptying its histogram.
+ *
+ * @param histogram The histogram into which to measure.
+ * @param iterations The number of times to run the block.
+ * @param name What the block measures, by which its latencies are reported.
+ * @param file The source file of the block.
+ * @param line The source line of the block.
+ */
+static void _TEST_UNUSED test_histogram_begin(
+        struct test_histogram *histogram, unsigned long iterations,
+        const char *name, const char *file, unsigned line) {
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min = ~(test_ns_t) 0;
+    histogram->remaining = iterations;
+    histogram->name = name;
+    histogram->file = file;
+    histogram->line = line;
+}
+
+/**
+ * Report the distribution of the latencies measured by a block that has just
+ * completed, replacing any earlier report of the same block.  The blocks of
+ * threaded tests are not reported, as their threads would race on the record.
+ *
+ * @param histogram The histogram of the block.
+ */
+static void test_histogram_report(const struct test_histogram *histogram) {
+    struct test_latency *latency;
+    unsigned i;
+
+    if (test_current_thread != NULL) {
+        return;
+    }
+    for (i = 0; i < test_latency_count; i++) {
+        if (test_latencies[i].line == histogram->line
+            && strcmp(test_latencies[i].file, histogram->file) == 0) {
+            break;
+        }
+    }
+    if (i == _TEST_MAX_LATENCIES) {
+        return;
+    } else if (i == test_latency_count) {
+        test_latency_count++;
+    }
+    latency = &test_latencies[i];
+    latency->name = histogram->name;
+    latency->file = histogram->file;
+    latency->line = histogram->line;
+    latency->samples = histogram->samples;
+    for (i = 0; i < _TEST_LATENCY_COLUMNS; i++) {
+        latency->columns[i] = test_histogram_percentile(
+            histogram, test_latency_columns[i].percentile);
+    }
+    latency->mean = histogram->samples > 0
+                    ? histogram->total / histogram->samples : 0;
+}
+
+/**
+ * Step a <code>MEASURE_LATENCY</code> block: record the latency of the
+ * iteration that just completed, if any, and start timing the next one.
+ *
+ * @param histogram The histogram of the block.
+ * @return Nonzero if the block is to run again, or 0 once it is done.
+ */
+static int _TEST_UNUSED test_histogram_step(struct test_histogram *histogram) {
+    test_ns_t ns;
+
+    if (histogram->timing) {
+        ns = test_clock_ns() - histogram->start;
+        histogram->counts[test_histogram_bucket(ns)]++;
+        histogram->samples++;
+        histogram->total += (double) ns;
+        if (ns < histogram->min) {
+            histogram->min = ns;
+        }
+        if (ns > histogram->max) {
+            histogram->max = ns;
+        }
+    }
+    if (histogram->remaining == 0) {
+        histogram->timing = 0;
+        test_histogram_report(histogram);
+        return 0;
+    }
+    histogram->remaining--;
+    histogram->timing = 1;
+    histogram->start = test_clock_ns();
+    return 1;
+}
+
+/**
+ * Check that the latency at the specified percentile of a histogram is below
+ * the specified limit, recording a failure if it is not, or if the histogram
+ * is empty.
+ *
+ * @param file The source file of the check.
+ * @param line The source line of the check.
+ * @param expression A description of the check.
+ * @param fatal Whether a failure ends the test.
+ * @param histogram The histogram.
+ * @param percentile The percentile, from 0 to 100.
+ * @param limit The limit in nanoseconds.
+ * @return Nonzero if the latency is below the limit.
+ */
+static int _TEST_UNUSED test_latency_below(
+        const char *file, unsigned line, const char *expression, int fatal,
+        const struct test_histogram *histogram, double percentile,
+        double limit) {
+    test_ns_t latency = test_histogram_percentile(histogram, percentile);
+
+    if (_TEST_UNLIKELY(histogram->samples == 0)) {
+        test_record_failure(file, line, expression, fatal, "%s",
+                            "Below %.0f ns", "No latencies measured", limit);
+        return 0;
+    } else if (_TEST_UNLIKELY((double) latency >= limit)) {
+        test_record_failure(file, line, expression, fatal,
+                            "%.0f ns at p%g of %lu latencies",
+                            "Below %.0f ns", (double) latency, percentile,
+                            histogram->samples, limit);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Run the block of code following this directive the specified number of
+ * times, recording the latency of each run in the specified histogram, a
+ * <code>struct test_histogram</code> that is emptied first.  The latencies
+ * are reported under the specified name, a string describing what the block
+ * measures.  Example:
+ *
+ * @code{.c}
+ * TEST(Lookup_latency, Some_fixture) {
+ *     struct test_histogram latency;
+ *     MEASURE_LATENCY("table_lookup", latency, 10000) {
+ *         table_lookup(&TEST->table, "key");
+ *     }
+ *     ASSERT_P99_BELOW(latency, 2000);
+ * }
+ * @endcode
+ *
+ * Each latency is recorded in a bucket at most 1/64 of it wide, and the
+ * percentiles of the histogram are rounded up to the tops of their buckets.
+ * The table of percentiles of each block run by a test is reported along with
+ * the test.  <code>continue</code> ends the current run of the block, while
+ * <code>break</code> leaves the block without recording it or reporting the
+ * table.
+ */
+#define MEASURE_LATENCY(NAME, HISTOGRAM, ITERATIONS)                          \
+    for (test_histogram_begin(&(HISTOGRAM), (ITERATIONS), (NAME), __FILE__,  \
+                              __LINE__);                                      \
+         test_histogram_step(&(HISTOGRAM)); )
+
+/* Check that the latency at the specified percentile of the specified
+ * histogram is below the specified limit, described by the specified name of
+ * the percentile. */
+#define _TEST_LATENCY_BELOW(HISTOGRAM, PERCENTILE, NS, FATAL, EXPRESSION)    \
+    test_latency_below(__FILE__, __LINE__, EXPRESSION, FATAL, &(HISTOGRAM),  \
+                       (PERCENTILE), (double) (NS))
+
+/**
+ * Assert that the specified percentage of the latencies recorded in the
+ * specified histogram are below the specified number of nanoseconds.
+ */
+#define ASSERT_PERCENTILE_BELOW(HISTOGRAM, PERCENTILE, NS)                    \
+    do {                                                                      \
+        if (!_TEST_LATENCY_BELOW(HISTOGRAM, PERCENTILE, NS, 1,                \
+                                 "p(" #PERCENTILE ") of (" #HISTOGRAM         \
+                                 ") below (" #NS ") ns")) {                   \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
+
+/**
+ * Assert that 99% of the latencies recorded in the specified histogram are
+ * below the specified number of nanoseconds.
+ */
+#define ASSERT_P99_BELOW(HISTOGRAM, NS)                                       \
+    do {                                                                      \
+        if (!_TEST_LATENCY_BELOW(HISTOGRAM, 99, NS, 1, "p99 of ("             \
+                                 #HISTOGRAM ") below (" #NS ") ns")) {        \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
+
+/**
+ * Assert that every latency recorded in the specified histogram is below the
+ * specified number of nanoseconds.
+ */
+#define ASSERT_MAX_BELOW(HISTOGRAM, NS)                                       \
+    do {                                                                      \
+        if (!_TEST_LATENCY_BELOW(HISTOGRAM, 100, NS, 1, "Maximum of ("        \
+                                 #HISTOGRAM ") below (" #NS ") ns")) {        \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
+
+/**
+ * Expect that the specified percentage of the latencies recorded in the
+ * specified histogram are below the specified number of nanoseconds.
+ */
+#define EXPECT_PERCENTILE_BELOW(HISTOGRAM, PERCENTILE, NS)                    \
+    ((void) _TEST_LATENCY_BELOW(HISTOGRAM, PERCENTILE, NS, 0,                 \
+                                "p(" #PERCENTILE ") of (" #HISTOGRAM          \
+                                ") below (" #NS ") ns"))
+
+/**
+ * Expect that 99% of the latencies recorded in the specified histogram are
+ * below the specified number of nanoseconds.
+ */
+#define EXPECT_P99_BELOW(HISTOGRAM, NS)                                       \
+    ((void) _TEST_LATENCY_BELOW(HISTOGRAM, 99, NS, 0, "p99 of (" #HISTOGRAM   \
+                                ") below (" #NS ") ns"))
+
+/**
+ * Expect that every latency recorded in the specified histogram is below the
+ * specified number of nanoseconds.
+ */
+#define EXPECT_MAX_BELOW(HISTOGRAM, NS)                                       \
+    ((void) _TEST_LATENCY_BELOW(HISTOGRAM, 100, NS, 0, "Maximum of ("         \
+                                #HISTOGRAM ") below (" #NS ") ns"))
+
+/* ******************************* PROPERTIES ******************************* */
+
+/* The most choices that the generators of a property can make for one case;
+ * any further choices are all 0. */
+#define _TEST_MAX_CHOICES 65536
+
+/* The most cases run in shrinking a counterexample to a property. */
+#define _TEST_MAX_SHRINKS 10000
+
+/* The most choices of a counterexample printed when it is reported. */
+#define _TEST_MAX_PRINTED_CHOICES 32
+
+/**
+ * A sequence of choices, from which the generators of a property make the
+ * inputs of a case: random bytes while cases are generated, and the bytes of a
+ * counterexample, or of an input from libFuzzer, when a case is replayed.
+ * Shrinking a counterexample is then simply a matter of finding a shorter, or
+ * smaller, sequence of choices on which the property still fails.
+ */
+struct test_choices {
+    unsigned char *bytes;    /**< The choices made, or to be replayed. */
+    unsigned long length;    /**< The number of choices in the buffer. */
+    unsigned long used;      /**< The number of choices drawn so far. */
+    unsigned long capacity;  /**< The size of the buffer. */
+    unsigned long state;     /**< State of the generator of new choices, or 0
+                                  if the choices are being replayed. */
+};
+
+/* The choices of the current case of a property, and the simplest
+ * counterexample found so far while shrinking. */
+_TEST_SHARED struct test_choices test_choices;
+_TEST_SHARED struct test_choices test_counterexample;
+
+/* The input given to the properties by libFuzzer, or NULL. */
+_TEST_SHARED const unsigned char *test_fuzz_input;
+_TEST_SHARED unsigned long test_fuzz_size;
+
+/**
+ * Grow the specified sequence of choices to hold at least the specified number
+ * of choices.
+ *
+ * @param choices The choices to grow.
+ * @param length The number of choices to hold.
+ * @return Nonzero if the choices could be grown.
+ */
+static int test_reserve_choices(struct test_choices *choices,
+                                unsigned long length) {
+    unsigned char *grown;
+    unsigned long capacity = choices->capacity * 2 + 256;
+
+    if (length <= choices->capacity) {
+        return 1;
+    } else if (capacity < length) {
+        capacity = length;
+    }
+    grown = (unsigned char *) test_runner_realloc(choices->bytes, capacity);
+    if (grown == NULL) {
+        return 0;
+    }
+    choices->bytes = grown;
+    choices->capacity = capacity;
+    return 1;
+}
+
+/**
+ * Draw the next choice of the current case of a property.  New choices are
+ * random while cases are being generated, and 0 beyond the end of the choices
+ * of a case being replayed.
+ *
+ * @return The choice, from 0 to 255.
+ */
+static unsigned test_draw_byte(void) {
+    struct test_choices *choices = &test_choices;
+    unsigned long state = choices->state;
+
+    if (choices->used < choices->length) {
+        return choices->bytes[choices->used++];
+    } else if (state == 0 || choices->length == _TEST_MAX_CHOICES
+               || !test_reserve_choices(choices, choices->length + 1)) {
+        return 0;
+    }
+    state ^= (state << 13) & 0xFFFFFFFFUL;
+    state ^= state >> 17;
+    state ^= (state << 5) & 0xFFFFFFFFUL;
+    choices->state = state;
+    choices->bytes[choices->length++] = (unsigned char) (state >> 24);
+    return choices->bytes[choices->used++];
+}
+
+/**
+ * Draw an integer between the specified bounds, inclusive.  The choices are
+ * mapped to integers such that smaller choices give integers closer to 0 (or
+ * to the bound nearest 0), alternating between positive and negative, so that
+ * shrinking the choices shrinks the integer.
+ *
+ * @param min The lower bound.
+ * @param max The upper bound, no less than the lower bound.
+ * @return The integer.
+ */
+static _TEST_UNUSED long test_draw_int(long min, long max) {
+    unsigned long range = (unsigned long) max - (unsigned long) min;
+    unsigned long raw = 0, span, negatives, positives, fewer;
+
+    if (max <= min) {
+        return min;
+    }
+    /* Only as many choices are drawn as the range needs. */
+    for (span = range; span > 0; span >>= 8) {
+        raw = (raw << 8) | test_draw_byte();
+    }
+    if (range != (unsigned long) -1) {
+        raw %= range + 1;
+    }
+    if (min >= 0) {
+        return (long) ((unsigned long) min + raw);
+    } else if (max <= 0) {
+        return (long) ((unsigned long) max - raw);
+    }
+    /* 0, -1, 1, -2, 2, and so on, until one side runs out. */
+    negatives = 0UL - (unsigned long) min;
+    positives = (unsigned long) max;
+    fewer = negatives < positives ? negatives : positives;
+    if (raw <= 2 * fewer) {
+        return raw % 2 == 0 ? (long) (raw / 2) : (long) (0UL - (raw + 1) / 2);
+    }
+    return positives > negatives ? (long) (raw - negatives)
+                                 : (long) (0UL - (raw - positives));
+}
+
+/**
+ * Draw a buffer of bytes of up to the specified length.
+ *
+ * @param buffer The buffer to fill, of at least the specified length.
+ * @param max_length The longest buffer to draw.
+ * @return The length of the buffer drawn.
+ */
+static _TEST_UNUSED unsigned long test_draw_bytes(unsigned char *buffer,
+                                                  unsigned long max_length) {
+    unsigned long length = (unsigned long) test_draw_int(0, (long) max_length);
+    unsigned long i;
+    for (i = 0; i < length; i++) {
+        buffer[i] = (unsigned char) test_draw_byte();
+    }
+    return length;
+}
+
+/**
+ * Draw a string of printable ASCII characters of up to the specified length,
+ * shrinking towards strings of <code>a</code>.
+ *
+ * @param buffer The buffer to fill, of at least the specified length plus one
+ *               for the terminating NUL.
+ * @param max_length The longest string to draw.
+ * @return The length of the string drawn.
+ */
+static _TEST_UNUSED unsigned long test_draw_string(char *buffer,
+                                                   unsigned long max_length) {
+    unsigned long length = (unsigned long) test_draw_int(0, (long) max_length);
+    unsigned long i;
+    for (i = 0; i < length; i++) {
+        buffer[i] = (char) (' ' + (test_draw_byte() + 'a' - ' ') % 95);
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+/**
+ * Generate an integer between the specified bounds, inclusive, in the body of
+ * a property.  Counterexamples shrink towards 0, or the bound nearest to it.
+ */
+#define GEN_INT(MIN, MAX) test_draw_int((long) (MIN), (long) (MAX))
+
+/**
+ * Generate a buffer of bytes of up to the specified length in the body of a
+ * property, evaluating to the length of the buffer generated.
+ */
+#define GEN_BYTES(BUFFER, MAX_LENGTH) \
+    test_draw_bytes((unsigned char *) (BUFFER), (unsigned long) (MAX_LENGTH))
+
+/**
+ * Generate a NUL-terminated string of printable characters of up to the
+ * specified length in the body of a property, evaluating to its length.  The
+ * buffer must have room for the terminator.
+ */
+#define GEN_STRING(BUFFER, MAX_LENGTH) \
+    test_draw_string((char *) (BUFFER), (unsigned long) (MAX_LENGTH))
+
+/**
+ * Generate an array of up to the specified length in the body of a property,
+ * storing its length in the specified lvalue and evaluating the specified
+ * expression, typically another generator, for each of its elements:
+ *
+ * @code{.c}
+ * int numbers[16];
+ * unsigned long count;
+ * GEN_ARRAY(numbers, count, 16, GEN_INT(-1000, 1000));
+ * @endcode
+ */
+#define GEN_ARRAY(ARRAY, LENGTH, MAX_LENGTH, ELEMENT)                    \
+    do {                                                                 \
+        unsigned long test_element_;                                     \
+        (LENGTH) = GEN_INT(0, MAX_LENGTH);                               \
+        for (test_element_ = 0; test_element_ < (unsigned long) (LENGTH);\
+             test_element_++) {                                          \
+            (ARRAY)[test_element_] = (ELEMENT);                          \
+        }                                                                \
+    } while (0)
+
+/**
+ * Mix the bits of the specified 32-bit value, so that nearby values give
+ * unrelated results.
+ *
+ * @param value The value to mix.
+ * @return The mixed value, of 32 bits.
+ */
+static unsigned long test_mix(unsigned long value) {
+    value &= 0xFFFFFFFFUL;
+    value ^= value >> 16;
+    value = (value * 0x7FEB352DUL) & 0xFFFFFFFFUL;
+    value ^= value >> 15;
+    value = (value * 0x846CA68BUL) & 0xFFFFFFFFUL;
+    return value ^ (value >> 16);
+}
+
+/**
+ * Run the specified property on the case whose choices are in
+ * <code>test_choices</code>, recording its failures as those of the test.
+ *
+ * @param property The body of the property.
+ * @param data The fixture data of the property.
+ * @param shared The shared state of its fixture.
+ * @return The outcome of the case: a case that skips itself is discarded.
+ */
+static enum test_status test_property_case(test_fn_t property, void *data,
+                                           const void *shared) {
+    test_reset_failures();
+    test_last_status = TEST_PASSED;
+    test_choices.used = 0;
+    property(data, shared);
+    return test_last_status;
+}
+
+/**
+ * Search for a case on which the specified property fails among every
+ * <code>step</code>-th of the cases of the test run, starting with the
+ * specified case.  The choices of each case are generated from its index, so
+ * any process can generate any case.
+ *
+ * @param property The body of the property.
+ * @param data The fixture data of the property.
+ * @param shared The shared state of its fixture.
+ * @param seed The seed of the cases of the property.
+ * @param first The index of the first case to run.
+ * @param step The distance between the cases to run.
+ * @param discarded Incremented for each case discarded.
+ * @return The index of the first case that failed, or the number of cases if
+ *         none did.
+ */
+static unsigned long test_property_search(test_fn_t property, void *data,
+                                          const void *shared,
+                                          unsigned long seed,
+                                          unsigned long first,
+                                          unsigned long step,
+                                          unsigned long *discarded) {
+    unsigned long index;
+    enum test_status status;
+
+    for (index = first; index < test_options.property_cases; index += step) {
+        test_choices.state = test_mix(seed ^ test_mix(index)) | 1;
+        test_choices.length = 0;
+        if ((status = test_property_case(property, data, shared))
+            == TEST_FAILED) {
+            return index;
+        }
+        *discarded += status == TEST_SKIPPED;
+    }
+    return test_options.property_cases;
+}
+
+#ifdef _TEST_FORK
+/**
+ * Search for a case on which the specified property fails with several
+ * processes, each of which runs an equal share of the cases and reports the
+ * first of them that failed.  If any process crashes, the search is repeated
+ * in this process, so that the crash is reported as that of the test.
+ *
+ * @param property The body of the property.
+ * @param data The fixture data of the property.
+ * @param shared The shared state of its fixture.
+ * @param seed The seed of the cases of the property.
+ * @param discarded Incremented for each case discarded.
+ * @return The index of the first case that failed, or the number of cases if
+ *         none did.
+ */
+static unsigned long test_property_search_parallel(test_fn_t property,
+                                                   void *data,
+                                                   const void *shared,
+                                                   unsigned long seed,
+                                                   unsigned long *discarded) {
+    unsigned long jobs = test_options.property_jobs, started, reported = 0;
+    unsigned long outcome[2], first = test_options.property_cases;
+    pid_t *workers;
+    int channel[2], status;
+
+    if (jobs > test_options.property_cases) {
+        jobs = test_options.property_cases;
+    }
+    workers = (pid_t *) test_runner_realloc(NULL, jobs * sizeof(*workers));
+    if (workers == NULL || pipe(channel) != 0) {
+        test_runner_free(workers);
+        return test_property_search(property, data, shared, seed, 0, 1,
+                                    discarded);
+    }
+    for (started = 0; started < jobs; started++) {
+        if ((workers[started] = fork()) < 0) {
+            break;
+        } else if (workers[started] == 0) {
+            close(channel[0]);
+            outcome[1] = 0;
+            outcome[0] = test_property_search(property, data, shared, seed,
+                                              started, jobs, &outcome[1]);
+            _exit(write(channel[1], outcome, sizeof(outcome))
+                  != (ssize_t) sizeof(outcome));
+        }
+    }
+    close(channel[1]);
+
+    /* The first case that failed is found by the earliest of the reports. */
+    while (read(channel[0], outcome, sizeof(outcome))
+           == (ssize_t) sizeof(outcome)) {
+        if (outcome[0] < first) {
+            first = outcome[0];
+        }
+        *discarded += outcome[1];
+        reported++;
+    }
+    close(channel[0]);
+    while (started > 0) {
+        waitpid(workers[--started], &status, 0);
+    }
+    if (reported < jobs) {
+        *discarded = 0;
+        first = test_property_search(property, data, shared, seed, 0, 1,
+                                     discarded);
+    }
+    test_runner_free(workers);
+    return first;
+}
+#endif
+
+/**
+ * Replace the counterexample with the case whose choices are in
+ * <code>test_choices</code> if the specified property fails on it, and it is
+ * simpler: shorter, or as long but made of smaller choices.
+ *
+ * @param property The body of the property.
+ * @param data The fixture data of the property.
+ * @param shared The shared state of its fixture.
+ * @return Nonzero if the case replaced the counterexample.
+ */
+static int test_property_simpler(test_fn_t property, void *data,
+                                 const void *shared) {
+    struct test_choices *best = &test_counterexample;
+    unsigned long used;
+
+    test_choices.state = 0;
+    if (test_property_case(property, data, shared) != TEST_FAILED) {
+        return 0;
+    }
+    used = test_choices.used;
+    if (used > best->length
+        || (used == best->length
+            && memcmp(test_choices.bytes, best->bytes, used) >= 0)) {
+        return 0;
+    }
+    memcpy(best->bytes, test_choices.bytes, used);
+    best->length = used;
+    return 1;
+}
+
+/**
+ * Shrink the counterexample to the specified property, replaying it with runs
+ * of its choices removed, with runs of them set to 0, and with each choice
+ * made smaller in turn, until none of these simplifications keeps the
+ * property failing or the shrinking budget is spent.
+ *
+ * @param property The body of the property.
+ * @param data The fixture data of the property.
+ * @param shared The shared state of its fixture.
+ * @return The number of simplifications made.
+ */
+static unsigned long test_property_shrink(test_fn_t property, void *data,
+                                          const void *shared) {
+    struct test_choices *best = &test_counterexample;
+    unsigned char *bytes = test_choices.bytes;
+    unsigned long shrinks = 0, runs = 0, size, i, low, high;
+    unsigned long previous;
+
+    do {
+        previous = shrinks;
+        for (size = 8; size > 0; size /= 2) {
+            for (i = 0; i + size <= best->length && runs < _TEST_MAX_SHRINKS;
+                 runs++) {
+                memcpy(bytes, best->bytes, i);
+                memcpy(bytes + i, best->bytes + i + size,
+                       best->length - i - size);
+                test_choices.length = best->length - size;
+                if (test_property_simpler(property, data, shared)) {
+                    shrinks++;
+                } else {
+                    i++;
+                }
+            }
+        }
+        for (size = 8; size > 0; size /= 2) {
+            for (i = 0; i + size <= best->length && runs < _TEST_MAX_SHRINKS;
+                 i++) {
+                for (low = i; low < i + size && best->bytes[low] == 0; low++) {
+                }
+                if (low == i + size) {
+                    continue;
+                }
+                memcpy(bytes, best->bytes, best->length);
+                memset(bytes + i, 0, size);
+                test_choices.length = best->length;
+                shrinks += test_property_simpler(property, data, shared);
+                runs++;
+            }
+        }
+        /* The smallest choice that keeps the property failing is found by
+         * bisection. */
+        for (i = 0; i < best->length && runs < _TEST_MAX_SHRINKS; i++) {
+            low = 0;
+            high = best->bytes[i];
+            while (low < high && i < best->length
+                   && runs < _TEST_MAX_SHRINKS) {
+                memcpy(bytes, best->bytes, best->length);
+                bytes[i] = (unsigned char) ((low + high) / 2);
+                test_choices.length = best->length;
+                if (test_property_simpler(property, data, shared)) {
+                    high = (low + high) / 2;
+                    shrinks++;
+                } else {
+                    low = (low + high) / 2 + 1;
+                }
+                runs++;
+            }
+        }
+    } while (shrinks > previous && runs < _TEST_MAX_SHRINKS);
+    return shrinks;
+}
+
+/**
+ * Report the counterexample to a property as a failure of its test, after
+ * those found by replaying it.
+ *
+ * @param file The file in which the property was declared.
+ * @param line The line on which it was declared.
+ * @param found A description of how the counterexample was found.
+ * @param shrinks The number of simplifications made to the counterexample.
+ */
+static _TEST_COLD void test_property_report(const char *file, unsigned line,
+                                            const char *found,
+                                            unsigned long shrinks) {
+    const struct test_choices *best = &test_counterexample;
+    char printed[3 * _TEST_MAX_PRINTED_CHOICES + 5];
+    unsigned long i;
+
+    printed[0] = '\0';
+    for (i = 0; i < best->length && i < _TEST_MAX_PRINTED_CHOICES; i++) {
+        sprintf(printed + 3 * i, " %02x", best->bytes[i]);
+    }
+    if (best->length > _TEST_MAX_PRINTED_CHOICES) {
+        strcat(printed, " ...");
+    }
+    test_record_failure(file, line, "Property falsified", 1, "%s",
+                        "choices [%s ] after %lu shrink(s)", found, printed,
+                        shrinks);
+}
+
+/**
+ * Run the specified property on the cases of the test run, generated from the
+ * seed of the test run and the identifier of the property.  If it fails on
+ * any of them, the first such case is shrunk to a minimal counterexample,
+ * which is replayed, so that the failures of the test are those of the
+ * counterexample.  When the properties are fuzzed, the property is instead run
+ * on the input from libFuzzer alone.
+ *
+ * @param property The body of the property.
+ * @param data The fixture data of the property.
+ * @param shared The shared state of its fixture.
+ * @param id The identifier of the property.
+ * @param file The file in which the property was declared.
+ * @param line The line on which it was declared.
+ */
+static _TEST_UNUSED void test_property_run(test_fn_t property, void *data,
+                                           const void *shared, const char *id,
+                                           const char *file, unsigned line) {
+    unsigned long cases = test_options.property_cases, hash = 2166136261UL;
+    unsigned long seed, first, discarded = 0, shrinks;
+    char found[128];
+
+    if (test_fuzz_input != NULL) {
+        test_choices.length = test_fuzz_size < _TEST_MAX_CHOICES
+                              ? test_fuzz_size : _TEST_MAX_CHOICES;
+        if (!test_reserve_choices(&test_choices, test_choices.length + 1)
+            || !test_reserve_choices(&test_counterexample,
+                                     test_choices.length + 1)) {
+            return;
+        }
+        memcpy(test_choices.bytes, test_fuzz_input, test_choices.length);
+        test_choices.state = 0;
+        if (test_property_case(property, data, shared) == TEST_FAILED) {
+            memcpy(test_counterexample.bytes, test_choices.bytes,
+                   test_choices.used);
+            test_counterexample.length = test_choices.used;
+            test_property_report(file, line, "input from libFuzzer", 0);
+        }
+        return;
+    }
+
+    for (; *id != '\0'; id++) {
+        hash = ((hash ^ (unsigned char) *id) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    seed = test_mix(test_options.property_seed ^ hash);
+#ifdef _TEST_FORK
+    if (test_options.property_jobs > 1 && cases > 1) {
+        first = test_property_search_parallel(property, data, shared, seed,
+                                              &discarded);
+    } else {
+        first = test_property_search(property, data, shared, seed, 0, 1,
+                                     &discarded);
+    }
+#else
+    first = test_property_search(property, data, shared, seed, 0, 1,
+                                 &discarded);
+#endif
+    if (first == cases) {
+        test_reset_failures();
+        test_last_status = TEST_PASSED;
+        if (cases > 0 && discarded == cases) {
+            sprintf(test_failure_message, "All %lu cases of the property "
+                    "were discarded.", cases);
+            test_last_status = TEST_SKIPPED;
+        }
+        return;
+    }
+
+    /* The case may have failed in another process, so it is generated here
+     * once more before it is shrunk. */
+    test_choices.state = test_mix(seed ^ test_mix(first)) | 1;
+    test_choices.length = 0;
+    test_property_case(property, data, shared);
+    if (!test_reserve_choices(&test_counterexample, test_choices.used + 1)) {
+        return;
+    }
+    memcpy(test_counterexample.bytes, test_choices.bytes, test_choices.used);
+    test_counterexample.length = test_choices.used;
+    shrinks = test_property_shrink(property, data, shared);
+
+    /* Replay the counterexample, so that its failures are reported. */
+    memcpy(test_choices.bytes, test_counterexample.bytes,
+           test_counterexample.length);
+    test_choices.length = test_counterexample.length;
+    test_choices.state = 0;
+    test_property_case(property, data, shared);
+    sprintf(found, "case %lu of %lu with --property-seed=%lu", first + 1,
+            cases, test_options.property_seed);
+    test_property_report(file, line, found, shrinks);
+}
+
+/**
+ * Declare a property with the specified name, belonging to the specified
+ * fixture: a test whose body is run on many generated cases, and fails if any
+ * assertion fails on any of them.  The inputs of each case are generated in
+ * the body with <code>GEN_INT</code>, <code>GEN_BYTES</code>,
+ * <code>GEN_STRING</code>, and <code>GEN_ARRAY</code>:
+ *
+ * @code{.c}
+ * PROPERTY(Reverse_twice, Some_fixture) {
+ *     char string[33], reversed[33];
+ *     unsigned long length = GEN_STRING(string, 32), i;
+ *     for (i = 0; i < length; i++) {
+ *         reversed[i] = string[length - 1 - i];
+ *     }
+ *     reversed[length] = '\0';
+ *     reverse(reversed);
+ *     ASSERT_STREQ(reversed, string);
+ * }
+ * @endcode
+ *
+ * Each property is run on the number of cases given by the
+ * <code>--property-cases</code> option, 100 by default, which are generated
+ * from the seed given by the <code>--property-seed</code> option, a new one in
+ * every run by default, and may be spread across the number of processes
+ * given by <code>--property-jobs</code>.  The first case on which the property
+ * fails is shrunk to a minimal counterexample, whose failures are reported
+ * along with the seed that reproduces it.  A case that skips itself (with
+ * <code>SKIP_IF</code>, for instance) is discarded.  The fixture is set up
+ * once for all of the cases of a property.
+ *
+ * When the test suite is compiled with <code>TEST_FUZZ</code> defined and
+ * <code>-fsanitize=fuzzer</code>, libFuzzer runs the properties selected by
+ * <code>TEST_FILTER</code> on its inputs instead of the runner running the
+ * tests.  This directive must be written within a <code>TEST_START</code>,
+ * <code>TEST_END</code> block.
+ */
+#define PROPERTY(NAME, FIXTURE)                                               \
+    /* Forward declare the body to allow standard function syntax. */         \
+    static void FIXTURE ## _ ## NAME ## _property(                            \
+            struct FIXTURE ## _fixture_data *,                                \
+            const struct FIXTURE ## _fixture_shared *);                       \
+    /* The test function run by the runner: runs the body on every case. */   \
+    static void FIXTURE ## _ ## NAME ## _test(void *data,                     \
+                                              const void *shared) {           \
+        test_property_run((test_fn_t) FIXTURE ## _ ## NAME ## _property,      \
+                          data, shared, #FIXTURE "." #NAME, __FILE__,         \
+                          __LINE__);                                          \
+    }                                                                         \
+    _TEST_DECLARE(FIXTURE ## _ ## NAME ## _case, #NAME, FIXTURE, NULL,        \
+                  FIXTURE ## _ ## NAME ## _test, _TEST_PROPERTY, NULL)        \
+    /* And finally, the user-declared body of the property. */                \
+    static void FIXTURE ## _ ## NAME ## _property(                            \
+            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED,               \
+            const struct FIXTURE ## _fixture_shared *SHARED _TEST_UNUSED)
+
+/* The reporters and the runner are only needed by the unit that runs the
+ * tests. */
+#ifdef _TEST_HAS_RUNNER
+
+/* ******************************* REPORTERS ******************************** */
+
+/* The size beyond which buffered output is written to its stream, unless the
+ * stream is interactive, in which case every record is written at once. */
+#define _TEST_OUTPUT_CHUNK 65536
+
+/* The size of the chunks of output written by parallel workers, which must not
+ * exceed the size of writes to pipes that are guaranteed to be atomic. */
+#define _TEST_ATOMIC_CHUNK 4096
+
+/** Output buffered in memory until it is written to its stream in one piece. */
+struct test_buffer {
+    char *data;               /**< The buffered output. */
+    unsigned long length;     /**< Number of characters buffered. */
+    unsigned long committed;  /**< Number of characters of complete records. */
+    unsigned long capacity;   /**< Size of the allocated buffer. */
+};
+
+/** The buffer to which output is currently being formatted. */
+static struct test_buffer *test_output = NULL;
+
+/**
+ * Append formatted output to the current output buffer.
+ *
+ * @param format The printf format of the output.
+ * @param ... The values to format.
+ */
+static void test_printf(const char *format, ...) {
+    struct test_buffer *output = test_output;
+    va_list args;
+    int written;
+    char *grown;
+
+    for (;;) {
+        if (output->capacity - output->length > 1) {
+            va_start(args, format);
+            written = vsnprintf(output->data + output->length,
+                                output->capacity - output->length, format,
+                                args);
+            va_end(args);
+            if (written >= 0 && (unsigned long) written
+                    < output->capacity - output->length) {
+                output->length += written;
+                return;
+            }
+        }
+
+        /* Out of space (older C libraries report this as a negative result):
+         * grow the buffer and try again. */
+        grown = (char *) realloc(output->data, output->capacity * 2 + 4096);
+        if (grown == NULL) {
+            return;
+        }
+        output->data = grown;
+        output->capacity = output->capacity * 2 + 4096;
+    }
+}
+
+/**
+ * Remove terminal control sequences from the specified range of a buffer, for
+ * output that is not written to a terminal.  ANSI escape sequences are dropped,
+ * and a carriage return not followed by a newline discards the line written
+ * before it, just as the line would have been overwritten on a terminal.
+ *
+ * @param buffer The buffer to filter.
+ * @param start The index of the first character to filter.
+ */
+static void test_strip(struct test_buffer *buffer, unsigned long start) {
+    char *read = buffer->data + start, *write = read, *line = read;
+    char *end = buffer->data + buffer->length;
+
+    while (read < end) {
+        if (*read == '\x1B' && read + 1 < end && read[1] == '[') {
+            for (read += 2; read < end && (*read < '@' || *read > '~');
+                 read++) {
+                continue;
+            }
+            read++;
+        } else if (*read == '\r' && (read + 1 == end || read[1] != '\n')) {
+            write = line;
+            read++;
+        } else {
+            if (*read == '\n') {
+                line = write + 1;
+            }
+            *write++ = *read++;
+        }
+    }
+    buffer->length = write - buffer->data;
+}
+
+/** A format in which the outcome of the test run is reported. */
+struct test_reporter {
+    const char *name;  /**< Name of the format, as given to --reporter. */
+    /** Report the start of the test run, given the number of tests. */
+    void (*begin)(unsigned long count);
+    /** Report that a test is about to run, on a terminal only.  The output is
+     * written along with that of <code>report</code>, so as not to interleave
+     * with others. */
+    void (*start)(const struct test_case *test_case);
+    /** Report the outcome of the test with the specified index in the run. */
+    void (*report)(const struct test_result *result, unsigned long index);
+    /** Report the end of the test run, once all results have been tallied. */
+    void (*end)(void);
+};
+
+/**
+ * Append the specified string to the current output as a double-quoted JSON
+ * string, which is also a valid YAML scalar, or as <code>null</code> if the
+ * string is NULL.
+ *
+ * @param text The string to append.
+ */
+static void test_print_json(const char *text) {
+    const unsigned char *c = (const unsigned char *) text;
+    size_t span;
+
+    if (text == NULL) {
+        test_printf("null");
+        return;
+    }
+    test_printf("\"");
+    while (*c != '\0') {
+        /* Copy runs of characters that need no escaping in one go. */
+        for (span = 0; c[span] >= 0x20 && c[span] != 0x7F && c[span] != '"'
+                       && c[span] != '\\'; span++) {
+            continue;
+        }
+        test_printf("%.*s", (int) span, (const char *) c);
+        c += span;
+        if (*c == '"' || *c == '\\') {
+            test_printf("\\%c", *c++);
+        } else if (*c == '\n') {
+            test_printf("\\n");
+            c++;
+        } else if (*c != '\0') {
+            test_printf("\\u%04x", *c++);
+        }
+    }
+    test_printf("\"");
+}
+
+/**
+ * Append the specified counts of hardware events to the current output, as a
+ * list of counts followed by the names of their events, or as a JSON object
+ * mapping the names of the events to their counts.  The number of
+ * instructions per cycle is given along with the counts of both.
+ *
+ * @param counters The counts to append.
+ * @param per_op Whether the counts are per iteration of a benchmark, and hence
+ *               fractional.
+ * @param json Whether to append the counts as a JSON object.
+ */
+static void test_print_counters(const struct test_counters *counters,
+                                int per_op, int json) {
+    double count;
+    int i, listed = 0;
+
+    test_printf(json ? "{" : "");
+    for (i = 0; i < _TEST_COUNTER_EVENTS; i++) {
+        count = _TEST_COUNTER(counters, i);
+        if (json) {
+            test_printf("%s\"%s\":", i > 0 ? "," : "",
+                        test_counter_fields[i].name);
+        } else if (count < 0) {
+            continue;
+        } else {
+            test_printf("%s", listed++ > 0 ? ", " : " ");
+        }
+        if (count < 0) {
+            test_printf("null");
+        } else {
+            test_printf(per_op ? "%.3f" : "%.0f", count);
+        }
+        if (!json) {
+            test_printf(" %s", test_counter_fields[i].name);
+        }
+        if (!json && i == 1 && counters->cycles > 0) {
+            test_printf(" (%.2f IPC)", count / counters->cycles);
+        }
+    }
+    if (json && counters->cycles > 0 && counters->instructions >= 0) {
+        test_printf(",\"ipc\":%.17g", counters->instructions
+                                       / counters->cycles);
+    }
+    test_printf(json ? "}" : _TEST_NEWLINE);
+}
+
+/**
+ * Total the iterations of the threads of the last threaded test.
+ *
+ * @param elapsed_ns Output parameter for the time taken by the slowest thread.
+ * @return The number of iterations of all of the threads.
+ */
+static unsigned long test_threads_total(test_ns_t *elapsed_ns) {
+    const struct test_threads *run = &test_last_threads;
+    unsigned long iterations = 0;
+    unsigned i;
+
+    *elapsed_ns = 0;
+    for (i = 0; i < run->count; i++) {
+        iterations += run->threads[i].iterations;
+        if (run->threads[i].elapsed_ns > *elapsed_ns) {
+            *elapsed_ns = run->threads[i].elapsed_ns;
+        }
+    }
+    return iterations;
+}
+
+/**
+ * Append the threads of the last threaded test to the current output, as a
+ * list of the rate at which each got through its iterations, noting those on
+ * which checks failed, or as a JSON array of objects giving the iterations,
+ * time, and failures of each.
+ *
+ * @param json Whether to append the threads as a JSON array.
+ */
+static void test_print_threads(int json) {
+    const struct test_threads *run = &test_last_threads;
+    const struct test_thread *thread;
+    char rate[32];
+    unsigned i;
+
+    test_printf(json ? "[" : "");
+    for (i = 0; i < run->count; i++) {
+        thread = &run->threads[i];
+        if (json) {
+            test_printf("%s{\"iterations\":%lu,\"elapsed_ns\":%.0f,"
+                        "\"failures\":%lu}", i > 0 ? "," : "",
+                        thread->iterations, (double) thread->elapsed_ns,
+                        thread->failures);
+            continue;
+        }
+        test_printf("%s%u: %s", i > 0 ? ", " : " ", i,
+                    test_format_rate((double) thread->iterations,
+                                     thread->elapsed_ns, rate));
+        if (thread->failures > 0) {
+            test_printf(" (%lu failed)", thread->failures);
+        }
+    }
+    test_printf(json ? "]" : "");
+}
+
+/**
+ * Append the distributions of latencies measured by the last test to the
+ * current output, as a JSON array of objects giving the latency in nanoseconds
+ * at each column of their tables.
+ */
+static void test_print_latencies(void) {
+    const struct test_latency *latency;
+    unsigned i, column;
+
+    test_printf("[");
+    for (i = 0; i < test_latency_count; i++) {
+        latency = &test_latencies[i];
+        test_printf("%s{\"name\":", i > 0 ? "," : "");
+        test_print_json(latency->name);
+        test_printf(",\"file\":");
+        test_print_json(latency->file);
+        test_printf(",\"line\":%u,\"samples\":%lu", latency->line,
+                    latency->samples);
+        for (column = 0; column < _TEST_LATENCY_COLUMNS; column++) {
+            test_printf(",\"%s_ns\":%.0f", test_latency_columns[column].name,
+                        (double) latency->columns[column]);
+        }
+        test_printf(",\"mean_ns\":%.17g}", latency->mean);
+    }
+    test_printf("]");
+}
+
+/**
+ * Append the specified string to the current output, escaped for use in XML
+ * text and attribute values.  Control characters that XML cannot represent
+ * are replaced by question marks.
+ *
+ * @param text The string to append.
+ */
+static void test_print_xml(const char *text) {
+    const unsigned char *c = (const unsigned char *) text;
+    size_t span;
+
+    for (; *c != '\0'; c++) {
+        /* Copy runs of characters that need no escaping in one go. */
+        for (span = 0; c[span] >= 0x20 && strchr("&<>\"", c[span]) == NULL;
+             span++) {
+            continue;
+        }
+        test_printf("%.*s", (int) span, (const char *) c);
+        c += span;
+        if (*c == '\0') {
+            break;
+        }
+        switch (*c) {
+            case '&': test_printf("&amp;"); break;
+            case '<': test_printf("&lt;"); break;
+            case '>': test_printf("&gt;"); break;
+            case '"': test_printf("&quot;"); break;
+            case '\n': test_printf("&#10;"); break;
+            case '\t': test_printf("&#9;"); break;
+            default: test_printf("%c", *c < 0x20 ? '?' : *c); break;
+        }
+    }
+}
+
+/**
+ * Console reporter: print the banner of the test run.
+ */
+static void test_console_begin(unsigned long count) {
+    (void) count;
+    if (!test_options.quiet) {
+        test_printf(_TEST_COLOUR_HEADER
+             "================================ BEGIN TEST RUN ================================"
+             _TEST_COLOUR_RESET "\n");
+    }
+    /* The seed is needed to reproduce any failure, so it is always shown. */
+    if (test_options.shuffle) {
+        test_printf("Tests shuffled with seed %lu.\n", test_options.seed);
+    }
+}
+
+/**
+ * Console reporter: print the name of a test that is about to run.  Once it
+ * completes, its status overwrites the start marker.
+ */
+static void test_console_start(const struct test_case *test_case) {
+    if (!test_options.quiet) {
+        test_printf(_TEST_COLOUR_START "[ START      ]" _TEST_COLOUR_RESET
+                    " %s", test_case->name);
+    }
+}
+
+/* Format and printf arguments for the allocations made by the current test,
+ * which are only reported if they are counted. */
+#ifdef _TEST_ALLOC_COUNTING
+#define _TEST_ALLOC_DIAGNOSTICS ", %lu allocs, %lu bytes"
+#define _TEST_ALLOC_ARGUMENTS result->allocations, result->allocated_bytes,
+#else
+#define _TEST_ALLOC_DIAGNOSTICS
+#define _TEST_ALLOC_ARGUMENTS
+#endif
+
+/* printf arguments for the runtime details of the current test: the wall and
+ * CPU time of the test itself, and the wall time of its setup and teardown. */
+#define _TEST_DIAGNOSTICS                                                    \
+    _TEST_COLOUR_RUNTIME " (%s wall, %s cpu, %s setup, %s teardown"          \
+    _TEST_ALLOC_DIAGNOSTICS ")" _TEST_COLOUR_RESET " %s" _TEST_NEWLINE,      \
+    test_format_duration(result->body_ns, durations[0]),                     \
+    test_format_duration(result->cpu_ns, durations[1]),                      \
+    test_format_duration(result->setup_ns, durations[2]),                    \
+    test_format_duration(result->teardown_ns, durations[3]),                 \
+    _TEST_ALLOC_ARGUMENTS name
+
+/**
+ * Console reporter: print the status and timings of a completed test, along
+ * with the details of its failure or skip, its benchmark measurements, the
+ * rates of its threads, and the tables of its latencies.
+ */
+static void test_console_report(const struct test_result *result,
+                                unsigned long index) {
+    const struct test_benchmark *benchmark = &test_last_benchmark;
+    const struct test_threads *threads = &test_last_threads;
+    const struct test_latency *latency;
+    const struct test_failure *failure;
+    const char *name = result->test_case->name;
+    char durations[4][16], rate[32];
+    unsigned long i, iterations;
+    unsigned column;
+    test_ns_t elapsed;
+    (void) index;
+
+    /* In quiet mode, only failures are reported. */
+    if (test_options.quiet && (result->status == TEST_PASSED
+                               || result->status == TEST_SKIPPED)) {
+        return;
+    }
+
+    /* Print results depending on the test function return status. */
+    switch (result->status) {
+        case TEST_PASSED: {
+            test_printf(_TEST_COLOUR_PASS "\r[       PASS ]" _TEST_DIAGNOSTICS);
+            break;
+        } case TEST_SKIPPED: {
+            test_printf(_TEST_COLOUR_SKIP "\r[       SKIP ]" _TEST_COLOUR_MUTE
+                        " %s: %s" _TEST_COLOUR_RESET _TEST_NEWLINE, name,
+                        test_failure_message);
+            break;
+        } case TEST_FAILED: {
+            for (i = 0; i < test_failure_count; i++) {
+                failure = &test_failures[i];
+                test_printf(_TEST_NEWLINE _TEST_COLOUR_FAIL "%s failed!"
+                            _TEST_COLOUR_RESET " %s" _TEST_NEWLINE
+                            _TEST_COLOUR_VALUE "    Value 1: "
+                            _TEST_COLOUR_RESET "%s" _TEST_NEWLINE
+                            _TEST_COLOUR_VALUE "    Value 2: "
+                            _TEST_COLOUR_RESET "%s" _TEST_NEWLINE
+                            _TEST_COLOUR_FAIL "File: " _TEST_COLOUR_RESET
+                            "%s:%u" _TEST_NEWLINE,
+                            failure->fatal ? "Assertion" : "Expectation",
+                            failure->expression,
+                            test_failure_text + failure->value_1,
+                            test_failure_text + failure->value_2,
+                            failure->file, failure->line);
+            }
+            if (test_failures_omitted > 0) {
+                test_printf(_TEST_NEWLINE _TEST_COLOUR_FAIL "%lu further "
+                            "failure(s) not recorded." _TEST_COLOUR_RESET
+                            _TEST_NEWLINE, test_failures_omitted);
+            } else if (test_failure_count == 0) {
+                test_printf(_TEST_NEWLINE _TEST_COLOUR_FAIL "%s"
+                            _TEST_COLOUR_RESET _TEST_NEWLINE,
+                            test_failure_message);
+            }
+            test_printf(_TEST_COLOUR_FAIL "[       FAIL ]" _TEST_DIAGNOSTICS);
+            break;
+        } case TEST_TIMED_OUT: {
+            test_printf(_TEST_COLOUR_FAIL "\r[    TIMEOUT ]"
+                        _TEST_COLOUR_RUNTIME " (%s elapsed)"
+                        _TEST_COLOUR_RESET " %s: %s"
+                        _TEST_NEWLINE, test_format_duration(result->body_ns,
+                                                            durations[0]),
+                        name, test_failure_message);
+            break;
+        } default: {
+            /* This branch should never run. */
+            break;
+        }
+    }
+
+    if (result->counted && result->status != TEST_SKIPPED) {
+        test_printf(_TEST_COLOUR_VALUE "    counters:" _TEST_COLOUR_RESET);
+        test_print_counters(&result->counters, 0, 0);
+    }
+    if (benchmark->measured) {
+        test_printf(_TEST_COLOUR_VALUE "    ns/op:" _TEST_COLOUR_RESET
+                    " %.3f median, %.3f mean, %.3f min, %.3f p99, %.3f stddev"
+                    " (%lu x %lu iterations)" _TEST_NEWLINE, benchmark->median,
+                    benchmark->mean, benchmark->min, benchmark->p99,
+                    benchmark->stddev, benchmark->repetitions,
+                    benchmark->iterations);
+    }
+    if (benchmark->measured && benchmark->counted) {
+        test_printf(_TEST_COLOUR_VALUE "    events/op:" _TEST_COLOUR_RESET);
+        test_print_counters(&benchmark->counters, 1, 0);
+    }
+    if (benchmark->measured && benchmark->compared) {
+        test_printf(_TEST_COLOUR_VALUE "    baseline:" _TEST_COLOUR_RESET
+                    " %.3f median on %s (%+.1f%%, z = %.2f)" _TEST_NEWLINE,
+                    benchmark->baseline_median, benchmark->baseline_tag,
+                    benchmark->change, benchmark->z);
+    }
+    if (threads->measured) {
+        iterations = test_threads_total(&elapsed);
+        test_printf(_TEST_COLOUR_VALUE "    threads:" _TEST_COLOUR_RESET
+                    " %u thread(s), %lu iterations in %.3f ms, %s",
+                    threads->count, iterations, (double) elapsed / 1e6,
+                    test_format_rate((double) iterations, elapsed, rate));
+        if (threads->failures > 0) {
+            test_printf("; first failure on thread %u",
+                        threads->failed_thread);
+        }
+        test_printf(_TEST_NEWLINE _TEST_COLOUR_VALUE "    per thread:"
+                    _TEST_COLOUR_RESET);
+        test_print_threads(0);
+        test_printf(_TEST_NEWLINE);
+    }
+    for (i = 0; i < test_latency_count; i++) {
+        latency = &test_latencies[i];
+        test_printf(_TEST_COLOUR_VALUE "    latency of %s:" _TEST_COLOUR_RESET
+                    " %lu samples (%s:%u)" _TEST_NEWLINE _TEST_COLOUR_MUTE
+                    "   ", latency->name, latency->samples, latency->file,
+                    latency->line);
+        for (column = 0; column < _TEST_LATENCY_COLUMNS; column++) {
+            test_printf(" %10s", test_latency_columns[column].name);
+        }
+        test_printf(" %10s" _TEST_COLOUR_RESET _TEST_NEWLINE "   ", "mean");
+        for (column = 0; column < _TEST_LATENCY_COLUMNS; column++) {
+            test_printf(" %s", test_format_duration(latency->columns[column],
+                                                    durations[0]));
+        }
+        test_printf(" %s" _TEST_NEWLINE,
+                    test_format_duration((test_ns_t) latency->mean,
+                                         durations[0]));
+    }
+}
+
+/**
+ * Console reporter: print a summary of the test suite, describing the number
+ * of tests passed, failed, and skipped.
+ */
+static void test_console_end(void) {
+    test_printf(_TEST_NEWLINE _TEST_COLOUR_HEADER
+         "================================= TEST SUMMARY ================================="
+         _TEST_COLOUR_RESET "\n");
+
+    if (test_failed_tests == 0) {
+        test_printf(_TEST_COLOUR_PASS "All %lu tests passed!"
+                    _TEST_COLOUR_RESET _TEST_NEWLINE, test_passed_tests);
+    } else {
+        test_printf(_TEST_COLOUR_PASS "Test(s) passed:" _TEST_COLOUR_RESET
+                    " %lu" _TEST_NEWLINE, test_passed_tests);
+        test_printf(_TEST_COLOUR_FAIL "Test(s) failed:" _TEST_COLOUR_RESET
+                    " %lu" _TEST_NEWLINE, test_failed_tests);
+    }
+
+    if (test_skipped_tests > 0) {
+        test_printf(_TEST_COLOUR_VALUE "Test(s) skipped:" _TEST_COLOUR_RESET
+                    " %lu" _TEST_NEWLINE, test_skipped_tests);
+    }
+    if (test_options.shard_count > 0) {
+        test_printf(_TEST_COLOUR_VALUE "Shard:" _TEST_COLOUR_RESET
+                    " %lu of shards 0-%lu" _TEST_NEWLINE,
+                    test_options.shard_index, test_options.shard_count - 1);
+    }
+}
+
+/**
+ * JUnit XML reporter: open the document and the suite of all tests.  The suite
+ * is streamed one test case at a time, so it carries no totals.
+ */
+static void test_junit_begin(unsigned long count) {
+    test_printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n"
+                "  <testsuite name=\"test.h");
+    if (test_options.shard_count > 0) {
+        test_printf(" (shard %lu of %lu)", test_options.shard_index,
+                    test_options.shard_count);
+    }
+    test_printf("\" tests=\"%lu\">\n", count);
+    if (test_options.shuffle) {
+        test_printf("    <properties>\n      <property name=\"seed\" "
+                    "value=\"%lu\"/>\n    </properties>\n",
+                    test_options.seed);
+    }
+}
+
+/**
+ * JUnit XML reporter: write a <code>testcase</code> element for a completed
+ * test, whose time is that of its setup, body, and teardown combined.
+ */
+static void test_junit_report(const struct test_result *result,
+                              unsigned long index) {
+    const struct test_benchmark *benchmark = &test_last_benchmark;
+    const struct test_threads *threads = &test_last_threads;
+    const struct test_case *test_case = result->test_case;
+    const struct test_latency *latency;
+    const struct test_failure *failure;
+    unsigned long i, iterations;
+    unsigned column;
+    test_ns_t elapsed;
+    char rate[32];
+    (void) index;
+
+    test_printf("    <testcase classname=\"");
+    test_print_xml(test_case->fixture->name);
+    test_printf("\" name=\"");
+    test_print_xml(test_case->name);
+    test_printf("\" file=\"");
+    test_print_xml(test_case->file);
+    test_printf("\" line=\"%u\" time=\"%.9f\">\n", test_case->line,
+                (double) (result->setup_ns + result->body_ns
+                          + result->teardown_ns) / 1e9);
+
+    if (result->status == TEST_SKIPPED) {
+        test_printf("      <skipped message=\"");
+        test_print_xml(test_failure_message);
+        test_printf("\"/>\n");
+    } else if (result->status == TEST_FAILED && test_failure_count > 0) {
+        /* The first failure names the element; its body lists them all. */
+        test_printf("      <failure type=\"assertion\" message=\"");
+        test_print_xml(test_failures[0].expression);
+        test_printf("\">");
+        for (i = 0; i < test_failure_count; i++) {
+            failure = &test_failures[i];
+            if (i > 0) {
+                test_printf("&#10;&#10;");
+            }
+            test_print_xml(failure->file);
+            test_printf(":%u: ", failure->line);
+            test_print_xml(failure->expression);
+            test_printf("&#10;Value 1: ");
+            test_print_xml(test_failure_text + failure->value_1);
+            test_printf("&#10;Value 2: ");
+            test_print_xml(test_failure_text + failure->value_2);
+        }
+        if (test_failures_omitted > 0) {
+            test_printf("&#10;&#10;%lu further failure(s) not recorded.",
+                        test_failures_omitted);
+        }
+        test_printf("</failure>\n");
+    } else if (result->status != TEST_PASSED) {
+        test_printf("      <failure type=\"%s\" message=\"",
+                    result->status == TEST_TIMED_OUT ? "timeout" : "error");
+        test_print_xml(test_failure_message);
+        test_printf("\"/>\n");
+    }
+
+    if (benchmark->measured) {
+        test_printf("      <system-out>ns/op: %.3f median, %.3f mean, %.3f min,"
+                    " %.3f p99, %.3f stddev (%lu x %lu iterations)",
+                    benchmark->median, benchmark->mean, benchmark->min,
+                    benchmark->p99, benchmark->stddev, benchmark->repetitions,
+                    benchmark->iterations);
+        if (benchmark->compared) {
+            test_printf("&#10;baseline: %.3f median on ",
+                        benchmark->baseline_median);
+            test_print_xml(benchmark->baseline_tag);
+            test_printf(" (%+.1f%%, z = %.2f)", benchmark->change,
+                        benchmark->z);
+        }
+        test_printf("</system-out>\n");
+    }
+    if (threads->measured) {
+        iterations = test_threads_total(&elapsed);
+        test_printf("      <system-out>threads: %u thread(s), %lu iterations"
+                    " in %.3f ms, %s&#10;per thread:", threads->count,
+                    iterations, (double) elapsed / 1e6,
+                    test_format_rate((double) iterations, elapsed, rate));
+        test_print_threads(0);
+        test_printf("</system-out>\n");
+    }
+    for (i = 0; i < test_latency_count; i++) {
+        latency = &test_latencies[i];
+        test_printf("      <system-out>latency of ");
+        test_print_xml(latency->name);
+        test_printf(": %lu samples (", latency->samples);
+        test_print_xml(latency->file);
+        test_printf(":%u)", latency->line);
+        for (column = 0; column < _TEST_LATENCY_COLUMNS; column++) {
+            test_printf(", %s %.0f ns", test_latency_columns[column].name,
+                        (double) latency->columns[column]);
+        }
+        test_printf(", mean %.0f ns</system-out>\n", latency->mean);
+    }
+    test_printf("    </testcase>\n");
+}
+
+/**
+ * JUnit XML reporter: close the suite and the document.
+ */
+static void test_junit_end(void) {
+    test_printf("  </testsuite>\n</testsuites>\n");
+}
+
+/**
+ * JSON Lines reporter: write a record announcing the number of tests.
+ */
+static void test_jsonl_begin(unsigned long count) {
+    test_printf("{\"event\":\"begin\",\"tests\":%lu", count);
+    if (test_options.shard_count > 0) {
+        test_printf(",\"shard\":%lu,\"shards\":%lu", test_options.shard_index,
+                    test_options.shard_count);
+    }
+    if (test_options.shuffle) {
+        test_printf(",\"seed\":%lu", test_options.seed);
+    }
+    test_printf("}\n");
+}
+
+/**
+ * JSON Lines reporter: write a record of a completed test on a single line.
+ * Durations are given in nanoseconds and benchmark measurements in ns/op, and
+ * the threads of threaded tests are listed in order of their indices.
+ */
+static void test_jsonl_report(const struct test_result *result,
+                              unsigned long index) {
+    static const char *const statuses[] = {
+        "passed", "failed", "skipped", "timeout"
+    };
+    const struct test_benchmark *benchmark = &test_last_benchmark;
+    const struct test_threads *threads = &test_last_threads;
+    const struct test_case *test_case = result->test_case;
+    const struct test_failure *failure;
+    unsigned long i, iterations;
+    test_ns_t elapsed;
+
+    test_printf("{\"event\":\"test\",\"index\":%lu,\"fixture\":", index);
+    test_print_json(test_case->fixture->name);
+    test_printf(",\"name\":");
+    test_print_json(test_case->name);
+    test_printf(",\"file\":");
+    test_print_json(test_case->file);
+    test_printf(",\"line\":%u,\"status\":\"%s\",\"setup_ns\":%.0f,"
+                "\"body_ns\":%.0f,\"teardown_ns\":%.0f,\"cpu_ns\":%.0f",
+                test_case->line, statuses[result->status],
+                (double) result->setup_ns, (double) result->body_ns,
+                (double) result->teardown_ns, (double) result->cpu_ns);
+#ifdef _TEST_ALLOC_COUNTING
+    test_printf(",\"allocations\":%lu,\"allocated_bytes\":%lu",
+                result->allocations, result->allocated_bytes);
+#endif
+
+    if (result->status == TEST_FAILED && test_failure_count > 0) {
+        test_printf(",\"failures\":[");
+        for (i = 0; i < test_failure_count; i++) {
+            failure = &test_failures[i];
+            test_printf("%s{\"file\":", i > 0 ? "," : "");
+            test_print_json(failure->file);
+            test_printf(",\"line\":%u,\"fatal\":%s,\"expression\":",
+                        failure->line, failure->fatal ? "true" : "false");
+            test_print_json(failure->expression);
+            test_printf(",\"value_1\":");
+            test_print_json(test_failure_text + failure->value_1);
+            test_printf(",\"value_2\":");
+            test_print_json(test_failure_text + failure->value_2);
+            test_printf("}");
+        }
+        test_printf("],\"omitted\":%lu", test_failures_omitted);
+    } else if (result->status != TEST_PASSED) {
+        test_printf(",\"reason\":");
+        test_print_json(test_failure_message);
+    }
+    if (result->counted) {
+        test_printf(",\"counters\":");
+        test_print_counters(&result->counters, 0, 1);
+    }
+
+    if (benchmark->measured) {
+        test_printf(",\"benchmark\":{\"iterations\":%lu,\"repetitions\":%lu,"
+                    "\"median\":%.17g,\"mean\":%.17g,\"min\":%.17g,"
+                    "\"p99\":%.17g,\"stddev\":%.17g", benchmark->iterations,
+                    benchmark->repetitions, benchmark->median,
+                    benchmark->mean, benchmark->min, benchmark->p99,
+                    benchmark->stddev);
+        if (benchmark->compared) {
+            test_printf(",\"baseline\":{\"median\":%.17g,\"change\":%.17g,"
+                        "\"z\":%.17g,\"tag\":", benchmark->baseline_median,
+                        benchmark->change, benchmark->z);
+            test_print_json(benchmark->baseline_tag);
+            test_printf("}");
+        }
+        if (benchmark->counted) {
+            test_printf(",\"counters\":");
+            test_print_counters(&benchmark->counters, 1, 1);
+        }
+        test_printf("}");
+    }
+    if (threads->measured) {
+        iterations = test_threads_total(&elapsed);
+        test_printf(",\"threads\":{\"count\":%u,\"iterations\":%lu,"
+                    "\"elapsed_ns\":%.0f,", threads->count, iterations,
+                    (double) elapsed);
+        if (threads->failures > 0) {
+            test_printf("\"failed_thread\":%u,", threads->failed_thread);
+        }
+        test_printf("\"per_thread\":");
+        test_print_threads(1);
+        test_printf("}");
+    }
+    if (test_latency_count > 0) {
+        test_printf(",\"latency\":");
+        test_print_latencies();
+    }
+    test_printf("}\n");
+}
+
+/**
+ * JSON Lines reporter: write a record of the totals of the test run.
+ */
+static void test_jsonl_end(void) {
+    test_printf("{\"event\":\"end\",\"passed\":%lu,\"failed\":%lu,"
+                "\"skipped\":%lu}\n", test_passed_tests, test_failed_tests,
+                test_skipped_tests);
+}
+
+/**
+ * TAP reporter: write the version and the plan of the test run.
+ */
+static void test_tap_begin(unsigned long count) {
+    test_printf("TAP version 13\n1..%lu\n", count);
+    if (test_options.shard_count > 0) {
+        test_printf("# shard %lu of %lu\n", test_options.shard_index,
+                    test_options.shard_count);
+    }
+    if (test_options.shuffle) {
+        test_printf("# seed %lu\n", test_options.seed);
+    }
+}
+
+/**
+ * TAP reporter: write the test line of a completed test, followed by a YAML
+ * block with the details of its failure, its benchmark measurements, its
+ * threads, or its latencies.  Tests
+ * are numbered in the order in which they were selected, so those run in
+ * parallel may be reported out of order.
+ */
+static void test_tap_report(const struct test_result *result,
+                            unsigned long index) {
+    const struct test_benchmark *benchmark = &test_last_benchmark;
+    const struct test_threads *threads = &test_last_threads;
+    const struct test_case *test_case = result->test_case;
+    const struct test_failure *failure;
+    const struct test_thread *thread;
+    unsigned long i, iterations;
+    test_ns_t elapsed;
+
+    test_printf("%s %lu - %s.%s", result->status == TEST_FAILED
+                || result->status == TEST_TIMED_OUT ? "not ok" : "ok",
+                index + 1, test_case->fixture->name, test_case->name);
+    if (result->status == TEST_SKIPPED) {
+        test_printf(" # SKIP %s\n", test_failure_message);
+        return;
+    }
+    test_printf("\n");
+    if (result->status == TEST_PASSED && !benchmark->measured
+        && !threads->measured && test_latency_count == 0) {
+        return;
+    }
+
+    test_printf("  ---\n  duration_ms: %.6f\n",
+                (double) (result->setup_ns + result->body_ns
+                          + result->teardown_ns) / 1e6);
+    if (result->status == TEST_FAILED && test_failure_count > 0) {
+        test_printf("  message: ");
+        test_print_json(test_failures[0].expression);
+        test_printf("\n  failures:\n");
+        for (i = 0; i < test_failure_count; i++) {
+            failure = &test_failures[i];
+            test_printf("    - expression: ");
+            test_print_json(failure->expression);
+            test_printf("\n      file: ");
+            test_print_json(failure->file);
+            test_printf("\n      line: %u\n      fatal: %s\n      value_1: ",
+                        failure->line, failure->fatal ? "true" : "false");
+            test_print_json(test_failure_text + failure->value_1);
+            test_printf("\n      value_2: ");
+            test_print_json(test_failure_text + failure->value_2);
+            test_printf("\n");
+        }
+        if (test_failures_omitted > 0) {
+            test_printf("  omitted: %lu\n", test_failures_omitted);
+        }
+    } else if (result->status != TEST_PASSED) {
+        test_printf("  message: ");
+        test_print_json(test_failure_message);
+        test_printf("\n");
+    }
+    if (benchmark->measured) {
+        test_printf("  ns_per_op:\n    median: %.3f\n    mean: %.3f\n"
+                    "    min: %.3f\n    p99: %.3f\n    stddev: %.3f\n"
+                    "  iterations: %lu\n  repetitions: %lu\n",
+                    benchmark->median, benchmark->mean, benchmark->min,
+                    benchmark->p99, benchmark->stddev, benchmark->iterations,
+                    benchmark->repetitions);
+    }
+    if (benchmark->measured && benchmark->compared) {
+        test_printf("  baseline:\n    median: %.3f\n    change_percent: %.1f\n"
+                    "    z: %.2f\n    tag: ", benchmark->baseline_median,
+                    benchmark->change, benchmark->z);
+        test_print_json(benchmark->baseline_tag);
+        test_printf("\n");
+    }
+    if (threads->measured) {
+        iterations = test_threads_total(&elapsed);
+        test_printf("  threads:\n    count: %u\n    iterations: %lu\n"
+                    "    elapsed_ms: %.6f\n    per_thread:\n",
+                    threads->count, iterations, (double) elapsed / 1e6);
+        for (i = 0; i < threads->count; i++) {
+            thread = &threads->threads[i];
+            test_printf("      - {iterations: %lu, elapsed_ms: %.6f, "
+                        "failures: %lu}\n", thread->iterations,
+                        (double) thread->elapsed_ns / 1e6, thread->failures);
+        }
+    }
+    if (test_latency_count > 0) {
+        test_printf("  latency: ");
+        test_print_latencies();
+        test_printf("\n");
+    }
+    test_printf("  ...\n");
+}
+
+/** The formats in which the test run can be reported, console first. */
+static const struct test_reporter test_reporter_table[] = {
+    { "console", test_console_begin, test_console_start, test_console_report,
+      test_console_end },
+    { "junit", test_junit_begin, NULL, test_junit_report, test_junit_end },
+    { "jsonl", test_jsonl_begin, NULL, test_jsonl_report, test_jsonl_end },
+    { "tap", test_tap_begin, NULL, test_tap_report, NULL }
+};
+
+/* The maximum number of reporters active at once: the console reporter and one
+ * writing to a file. */
+#define _TEST_MAX_REPORTERS 2
+
+/** A reporter of the test run and the stream to which it writes. */
+struct test_report_stream {
+    const struct test_reporter *reporter;  /**< Format of the report. */
+    FILE *stream;                /**< Stream to which the report is written. */
+    int plain;                   /**< Whether to strip control sequences. */
+    int interactive;             /**< Whether to write records immediately. */
+    struct test_buffer buffer;   /**< Output yet to be written. */
+};
+
+/** The reporters of the test run. */
+static struct test_report_stream test_reporters[_TEST_MAX_REPORTERS];
+/** The size beyond which buffered records are written to their stream. */
+static unsigned long test_output_chunk = _TEST_OUTPUT_CHUNK;
+/** The number of reporters of the test run. */
+static unsigned test_reporter_count = 0;
+
+/**
+ * Write the complete records buffered by the specified reporter to its stream
+ * in one piece, keeping any incomplete record in the buffer.
+ *
+ * @param report The reporter whose output to write.
+ */
+static void test_drain(struct test_report_stream *report) {
+    struct test_buffer *buffer = &report->buffer;
+    if (buffer->committed == 0) {
+        return;
+    }
+    fwrite(buffer->data, 1, buffer->committed, report->stream);
+    fflush(report->stream);
+    memmove(buffer->data, buffer->data + buffer->committed,
+            buffer->length - buffer->committed);
+    buffer->length -= buffer->committed;
+    buffer->committed = 0;
+}
+
+/**
+ * Write the complete records buffered by all reporters to their streams.
+ */
+static void test_drain_all(void) {
+    unsigned i;
+    for (i = 0; i < test_reporter_count; i++) {
+        test_drain(&test_reporters[i]);
+    }
+}
+
+#ifdef _TEST_POSIX
+/**
+ * Write the complete records buffered by all reporters straight to the files
+ * underlying their streams, for a process that is about to end without
+ * returning from a signal handler, in which the streams are not safe to use.
+ */
+static void test_write_committed(void) {
+    const char *data;
+    size_t remaining;
+    ssize_t written;
+    unsigned i;
+
+    for (i = 0; i < test_reporter_count; i++) {
+        data = test_reporters[i].buffer.data;
+        remaining = test_reporters[i].buffer.committed;
+        while (remaining > 0
+               && (written = write(fileno(test_reporters[i].stream), data,
+                                   remaining)) > 0) {
+            data += written;
+            remaining -= written;
+        }
+    }
+}
+#endif
+
+/**
+ * Mark the output buffered by the specified reporter as complete records, and
+ * write it to the reporter's stream if the stream is interactive or enough
+ * output has been buffered.  Records are never split across chunks, so
+ * chunks from different processes are never interleaved mid-record.
+ *
+ * @param report The reporter whose output to commit.
+ */
+static void test_commit(struct test_report_stream *report) {
+    struct test_buffer *buffer = &report->buffer;
+    if (report->plain) {
+        test_strip(buffer, buffer->committed);
+    }
+    if (buffer->committed > 0 && buffer->length > test_output_chunk) {
+        test_drain(report);
+    }
+    buffer->committed = buffer->length;
+    if (report->interactive || buffer->committed >= test_output_chunk) {
+        test_drain(report);
+    }
+}
+
+/**
+ * Report the start of the test run to all reporters.
+ *
+ * @param count The number of tests that will be run.
+ */
+static void test_report_begin(unsigned long count) {
+    unsigned i;
+    for (i = 0; i < test_reporter_count; i++) {
+        test_output = &test_reporters[i].buffer;
+        if (test_reporters[i].reporter->begin != NULL) {
+            test_reporters[i].reporter->begin(count);
+        }
+        test_commit(&test_reporters[i]);
+    }
+}
+
+/**
+ * Report to all reporters writing to a terminal that the specified test is
+ * about to run.  Nothing is written until the outcome of the test is reported,
+ * which on a terminal overwrites the start of the test; a report written
+ * anywhere else records only the outcome.
+ *
+ * @param test_case The test about to run.
+ */
+static void test_report_start(const struct test_case *test_case) {
+    unsigned i;
+    for (i = 0; i < test_reporter_count; i++) {
+        test_output = &test_reporters[i].buffer;
+        if (test_reporters[i].interactive
+            && test_reporters[i].reporter->start != NULL) {
+            test_reporters[i].reporter->start(test_case);
+        }
+    }
+}
+
+/**
+ * Report the outcome of a test to all reporters, each record being written in
+ * one piece.  The details of the test's failure and benchmark measurements are
+ * taken from <code>test_failures</code>, <code>test_failure_message</code>,
+ * and <code>test_last_benchmark</code>.
+ *
+ * @param result The outcome of the test.
+ * @param index The index of the test in the test run.
+ */
+static void test_report(const struct test_result *result, unsigned long index) {
+    unsigned i;
+    for (i = 0; i < test_reporter_count; i++) {
+        test_output = &test_reporters[i].buffer;
+        if (test_reporters[i].reporter->report != NULL) {
+            test_reporters[i].reporter->report(result, index);
+        }
+        test_commit(&test_reporters[i]);
+    }
+}
+
+/**
+ * Report the end of the test run to all reporters, and write out everything
+ * that they have buffered.
+ */
+static void test_report_end(void) {
+    unsigned i;
+    for (i = 0; i < test_reporter_count; i++) {
+        test_output = &test_reporters[i].buffer;
+        if (test_reporters[i].reporter->end != NULL) {
+            test_reporters[i].reporter->end();
+        }
+        test_commit(&test_reporters[i]);
+    }
+    test_drain_all();
+}
+
+/* ****************************** TEST RUNNER ******************************* */
+
+#pragma _TEST_RUNNER_START
+
+/**
+ * Retrieve the command-line arguments of the process.  Since tests are run
+ * before <code>main()</code>, the arguments are recovered from the operating
+ * system rather than passed to us.
+ *
+ * @param argc Output parameter for the number of arguments.
+ * @return The arguments, or NULL if they are not available on this platform.
+ */
+static char **test_arguments(int *argc) {
+#if defined(_WIN32)
+    *argc = __argc;
+    return __argv;
+#elif defined(__APPLE__)
+    *argc = *_NSGetArgc();
+    return *_NSGetArgv();
+#elif defined(__linux__)
+    /* The arguments are NUL-separated in /proc/self/cmdline.  They are kept
+     * for the lifetime of the process, as options may point into them. */
+    static char *contents = NULL;
+    static char **arguments = NULL;
+    static int count = 0;
+    unsigned long length = 0, capacity = 0, i;
+    size_t read;
+    char *grown;
+    FILE *cmdline;
+
+    if (arguments != NULL
+        || (cmdline = fopen("/proc/self/cmdline", "rb")) == NULL) {
+        *argc = count;
+        return arguments;
+    }
+    do {
+        if (length == capacity) {
+            grown = (char *) realloc(contents, capacity * 2 + 4096);
+            if (grown == NULL) {
+                break;
+            }
+            contents = grown;
+            capacity = capacity * 2 + 4096;
+        }
+        read = fread(contents + length, 1, capacity - length, cmdline);
+        length += read;
+    } while (read > 0);
+    fclose(cmdline);
+
+    if (length > 0
+        && (arguments = (char **) malloc((length + 1) * sizeof(char *)))
+           != NULL) {
+        for (i = 0; i < length; i += strlen(contents + i) + 1) {
+            arguments[count++] = contents + i;
+        }
+        arguments[count] = NULL;
+    }
+    *argc = count;
+    return arguments;
+#else
+    *argc = 0;
+    return NULL;
+#endif
+}
+
+/**
+ * Determine whether argument <code>*index</code> of the specified arguments is
+ * the option with the specified long or short name, and if so, retrieve its
+ * value.  Values may be given as <code>--name=value</code>,
+ * <code>--name value</code>, <code>-nvalue</code>, or <code>-n value</code>.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @param index Index of the argument to examine, advanced past the value if it
+ *              was given as a separate argument.
+ * @param long_name The long name of the option, including leading dashes.
+ * @param short_name The short name of the option, or NULL if it has none.
+ * @return The value of the option, or NULL if the argument is not the option.
+ */
+static const char *test_option(int argc, char **argv, int *index,
+                               const char *long_name, const char *short_name) {
+    const char *argument = argv[*index];
+    size_t length = strlen(long_name);
+
+    if (strncmp(argument, long_name, length) == 0) {
+        argument += length;
+        if (*argument == '=') {
+            return argument + 1;
+        } else if (*argument != '\0') {
+            return NULL;
+        }
+    } else if (short_name != NULL
+               && strncmp(argument, short_name, strlen(short_name)) == 0) {
+        /* Short options may be directly followed by their value. */
+        argument += strlen(short_name);
+        if (*argument != '\0') {
+            return argument;
+        }
+    } else {
+        return NULL;
+    }
+    return *index + 1 < argc ? argv[++*index] : NULL;
+}
+
+/**
+ * Parse the value of the colour option.
+ *
+ * @param value <code>always</code>, <code>never</code>, or <code>auto</code>.
+ * @return The value of the <code>colour</code> field of the options.
+ */
+static int test_colour_option(const char *value) {
+    if (strcmp(value, "always") == 0) {
+        return 1;
+    } else if (strcmp(value, "never") == 0) {
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * Populate the options of the test run, first from the environment and then
+ * from the command line.  Unrecognised arguments are ignored, as they may be
+ * intended for the test suite's own <code>main()</code>.
+ */
+static void test_parse_options(void) {
+    static const struct test_options defaults = {
+        1, NULL, 0, 0, 10000000, 10, NULL, NULL, 5, NULL, "console", NULL, 0,
+        -1, 0, 0, 0, 0, 0, 0, NULL, 0, NULL, 0, 0, NULL, 0, 0, 100, 0, 1
+    };
+    static char failed_file[1024];
+    const char *value;
+    FILE *status_file;
+    char **argv;
+    int argc, i, seeded = 0, property_seeded = 0;
+
+    test_options = defaults;
+    if ((value = getenv("TEST_JOBS")) != NULL) {
+        test_options.jobs = strtoul(value, NULL, 10);
+    }
+    if ((value = getenv("TEST_FILTER")) != NULL) {
+        test_options.filter = value;
+    }
+    if ((value = getenv("TEST_LIST")) != NULL) {
+        test_options.list = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_BENCH")) != NULL) {
+        test_options.bench = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_BENCH_TIME")) != NULL) {
+        test_options.bench_ns = (test_ns_t) strtoul(value, NULL, 10) * 1000000;
+    }
+    if ((value = getenv("TEST_BENCH_REPETITIONS")) != NULL) {
+        test_options.bench_repetitions = strtoul(value, NULL, 10);
+    }
+    if ((value = getenv("TEST_BENCH_SAVE")) != NULL) {
+        test_options.bench_save = value;
+    }
+    if ((value = getenv("TEST_BENCH_BASELINE")) != NULL) {
+        test_options.bench_baseline = value;
+    }
+    if ((value = getenv("TEST_BENCH_THRESHOLD")) != NULL) {
+        test_options.bench_threshold = strtod(value, NULL);
+    }
+    if ((value = getenv("TEST_BENCH_TAG")) != NULL) {
+        test_options.bench_tag = value;
+    }
+    if ((value = getenv("TEST_REPORTER")) != NULL) {
+        test_options.reporter = value;
+    }
+    if ((value = getenv("TEST_OUTPUT")) != NULL) {
+        test_options.output = value;
+    }
+    if ((value = getenv("TEST_QUIET")) != NULL) {
+        test_options.quiet = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_COLOUR")) != NULL) {
+        test_options.colour = test_colour_option(value);
+    }
+    if ((value = getenv("TEST_POISON")) != NULL) {
+        test_options.poison = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_TIMEOUT")) != NULL) {
+        test_options.timeout_ns =
+            (test_ns_t) strtoul(value, NULL, 10) * 1000000;
+    }
+    if ((value = getenv("TEST_COUNTERS")) != NULL) {
+        test_options.counters = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_CHECK_LEAKS")) != NULL) {
+        test_options.check_leaks = strcmp(value, "0") != 0;
+    }
+    /* The variables of the Bazel test sharding protocol. */
+    if ((value = getenv("TEST_TOTAL_SHARDS")) != NULL) {
+        test_options.shard_count = strtoul(value, NULL, 10);
+    }
+    if ((value = getenv("TEST_SHARD_INDEX")) != NULL) {
+        test_options.shard_index = strtoul(value, NULL, 10);
+    }
+    if ((value = getenv("TEST_HISTORY")) != NULL) {
+        test_options.history = value;
+    }
+    if ((value = getenv("TEST_SHUFFLE")) != NULL) {
+        test_options.shuffle = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_SEED")) != NULL) {
+        test_options.seed = strtoul(value, NULL, 10);
+        test_options.shuffle = seeded = 1;
+    }
+    if ((value = getenv("TEST_FAILED_FILE")) != NULL) {
+        test_options.failed_file = value;
+    }
+    if ((value = getenv("TEST_FAILED_FIRST")) != NULL) {
+        test_options.failed_first = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_LAST_FAILED")) != NULL) {
+        test_options.last_failed = strcmp(value, "0") != 0;
+    }
+    if ((value = getenv("TEST_PROPERTY_CASES")) != NULL) {
+        test_options.property_cases = strtoul(value, NULL, 10);
+    }
+    if ((value = getenv("TEST_PROPERTY_SEED")) != NULL) {
+        test_options.property_seed = strtoul(value, NULL, 10);
+        property_seeded = 1;
+    }
+    if ((value = getenv("TEST_PROPERTY_JOBS")) != NULL) {
+        test_options.property_jobs = strtoul(value, NULL, 10);
+    }
+
+    argv = test_arguments(&argc);
+    for (i = 1; i < argc; i++) {
+        if ((value = test_option(argc, argv, &i, "--jobs", "-j")) != NULL) {
+            test_options.jobs = strtoul(value, NULL, 10);
+        } else if ((value = test_option(argc, argv, &i, "--filter", NULL))
+                   != NULL) {
+            test_options.filter = value;
+        } else if (strcmp(argv[i], "--list") == 0) {
+            test_options.list = 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            test_options.bench = 1;
+        } else if ((value = test_option(argc, argv, &i, "--bench-time", NULL))
+                   != NULL) {
+            test_options.bench_ns =
+                (test_ns_t) strtoul(value, NULL, 10) * 1000000;
+        } else if ((value = test_option(argc, argv, &i, "--bench-repetitions",
+                                        NULL)) != NULL) {
+            test_options.bench_repetitions = strtoul(value, NULL, 10);
+        } else if ((value = test_option(argc, argv, &i, "--bench-save", NULL))
+                   != NULL) {
+            test_options.bench_save = value;
+        } else if ((value = test_option(argc, argv, &i, "--bench-baseline",
+                                        NULL)) != NULL) {
+            test_options.bench_baseline = value;
+        } else if ((value = test_option(argc, argv, &i, "--bench-threshold",
+                                        NULL)) != NULL) {
+            test_options.bench_threshold = strtod(value, NULL);
+        } else if ((value = test_option(argc, argv, &i, "--bench-tag", NULL))
+                   != NULL) {
+            test_options.bench_tag = value;
+        } else if ((value = test_option(argc, argv, &i, "--reporter", NULL))
+                   != NULL) {
+            test_options.reporter = value;
+        } else if ((value = test_option(argc, argv, &i, "--output", NULL))
+                   != NULL) {
+            test_options.output = value;
+        } else if (strcmp(argv[i], "--quiet") == 0
+                   || strcmp(argv[i], "-q") == 0) {
+            test_options.quiet = 1;
+        } else if ((value = test_option(argc, argv, &i, "--colour", NULL))
+                   != NULL) {
+            test_options.colour = test_colour_option(value);
+        } else if (strcmp(argv[i], "--poison") == 0) {
+            test_options.poison = 1;
+        } else if ((value = test_option(argc, argv, &i, "--timeout", NULL))
+                   != NULL) {
+            test_options.timeout_ns =
+                (test_ns_t) strtoul(value, NULL, 10) * 1000000;
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            test_options.counters = 1;
+        } else if (strcmp(argv[i], "--check-leaks") == 0) {
+            test_options.check_leaks = 1;
+        } else if ((value = test_option(argc, argv, &i, "--shard", NULL))
+                   != NULL) {
+            if (sscanf(value, "%lu/%lu", &test_options.shard_index,
+                       &test_options.shard_count) != 2) {
+                test_options.shard_count = 0;
+            }
+        } else if ((value = test_option(argc, argv, &i, "--history", NULL))
+                   != NULL) {
+            test_options.history = value;
+        } else if (strcmp(argv[i], "--shuffle") == 0) {
+            test_options.shuffle = 1;
+        } else if ((value = test_option(argc, argv, &i, "--seed", NULL))
+                   != NULL) {
+            test_options.seed = strtoul(value, NULL, 10);
+            test_options.shuffle = seeded = 1;
+        } else if ((value = test_option(argc, argv, &i, "--failed-file",
+                                        NULL)) != NULL) {
+            test_options.failed_file = value;
+        } else if (strcmp(argv[i], "--failed-first") == 0) {
+            test_options.failed_first = 1;
+        } else if (strcmp(argv[i], "--last-failed") == 0) {
+            test_options.last_failed = 1;
+        } else if ((value = test_option(argc, argv, &i, "--property-cases",
+                                        NULL)) != NULL) {
+            test_options.property_cases = strtoul(value, NULL, 10);
+        } else if ((value = test_option(argc, argv, &i, "--property-seed",
+                                        NULL)) != NULL) {
+            test_options.property_seed = strtoul(value, NULL, 10);
+            property_seeded = 1;
+        } else if ((value = test_option(argc, argv, &i, "--property-jobs",
+                                        NULL)) != NULL) {
+            test_options.property_jobs = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "--merge") == 0) {
+            /* The remaining arguments are the reports to merge. */
+            test_options.merge = argv + i + 1;
+            test_options.merge_count = argc - i - 1;
+            break;
+        }
+    }
+
+    if (test_options.shard_count > 0
+        && test_options.shard_index >= test_options.shard_count) {
+        fprintf(stderr, "Shard %lu does not exist among shards 0-%lu."
+                _TEST_NEWLINE, test_options.shard_index,
+                test_options.shard_count - 1);
+        exit(1);
+    }
+    /* Bazel checks that the binaries it shards understand sharding by whether
+     * they touch this file. */
+    if (test_options.shard_count > 0
+        && (value = getenv("TEST_SHARD_STATUS_FILE")) != NULL
+        && (status_file = fopen(value, "a")) != NULL) {
+        fclose(status_file);
+    }
+    /* Seeds are 32 bits wide, so that a seed printed on one platform
+     * reproduces the same order on any other. */
+    if (test_options.shuffle && !seeded) {
+        test_options.seed = (unsigned long) time(NULL)
+                            ^ (unsigned long) test_clock_ns();
+    }
+    test_options.seed &= 0xFFFFFFFFUL;
+    /* Properties are tried on new cases in every run unless seeded. */
+    if (!property_seeded) {
+        test_options.property_seed = (unsigned long) time(NULL)
+                                     ^ (unsigned long) (test_clock_ns() >> 7);
+    }
+    test_options.property_seed &= 0xFFFFFFFFUL;
+    /* The tests that failed are kept next to the test binary by default, and
+     * not at all if the file is given as an empty string. */
+    if (test_options.failed_file == NULL && argc > 0
+        && strlen(argv[0]) + sizeof(".failed") <= sizeof(failed_file)) {
+        sprintf(failed_file, "%s.failed", argv[0]);
+        test_options.failed_file = failed_file;
+    } else if (test_options.failed_file != NULL
+               && *test_options.failed_file == '\0') {
+        test_options.failed_file = NULL;
+    }
+
+    /* Saving or comparing against a baseline requires measurements. */
+    if (test_options.bench_save != NULL
+        || test_options.bench_baseline != NULL) {
+        test_options.bench = 1;
+    }
+    if (test_options.bench_repetitions < 1) {
+        test_options.bench_repetitions = 1;
+    } else if (test_options.bench_repetitions > _TEST_MAX_REPETITIONS) {
+        test_options.bench_repetitions = _TEST_MAX_REPETITIONS;
+    }
+
+#ifdef _TEST_FORK
+    if (test_options.jobs == 0 || test_options.property_jobs == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        if (test_options.jobs == 0) {
+            test_options.jobs = processors > 0 ? (unsigned long) processors : 1;
+        }
+        if (test_options.property_jobs == 0) {
+            test_options.property_jobs = processors > 0
+                                         ? (unsigned long) processors : 1;
+        }
+    }
+#else
+    /* Without worker processes, every test is run on the main thread. */
+    test_options.jobs = test_options.property_jobs = 1;
+#endif
+}
+
+/**
+ * Write the identifier of the specified test, <code>FIXTURE.NAME</code>, to
+ * the specified buffer, truncating it if necessary.
+ *
+ * @param test_case The test to identify.
+ * @param buffer The buffer to which to write the identifier.
+ * @param size The size of the buffer in bytes.
+ */
+static void test_identify(const struct test_case *test_case, char *buffer,
+                          size_t size) {
+    const char *parts[3];
+    size_t length = 0, i;
+    parts[0] = test_case->fixture->name;
+    parts[1] = ".";
+    parts[2] = test_case->name;
+    for (i = 0; i < 3; i++) {
+        const char *part = parts[i];
+        while (*part != '\0' && length + 1 < size) {
+            buffer[length++] = *part++;
+        }
+    }
+    buffer[length] = '\0';
+}
+
+/**
+ * Determine whether the specified text matches the specified glob pattern, in
+ * which <code>*</code> matches any sequence of characters and <code>?</code>
+ * matches any single character.
+ *
+ * @param pattern The start of the pattern.
+ * @param pattern_end The end of the pattern (exclusive).
+ * @param text The NUL-terminated text to match.
+ * @return Nonzero if the text matches the pattern.
+ */
+static int test_glob(const char *pattern, const char *pattern_end,
+                     const char *text) {
+    /* Position after the last star seen, and the text it is matched up to. */
+    const char *star = NULL, *star_text = NULL;
+    while (*text != '\0') {
+        if (pattern < pattern_end && *pattern == '*') {
+            star = ++pattern;
+            star_text = text;
+        } else if (pattern < pattern_end
+                   && (*pattern == '?' || *pattern == *text)) {
+            pattern++;
+            text++;
+        } else if (star != NULL) {
+            /* Backtrack: let the last star swallow one more character. */
+            pattern = star;
+            text = ++star_text;
+        } else {
+            return 0;
+        }
+    }
+    while (pattern < pattern_end && *pattern == '*') {
+        pattern++;
+    }
+    return pattern == pattern_end;
+}
+
+/**
+ * Determine whether the specified identifier matches any of the
+ * colon-separated glob patterns in the specified range.
+ *
+ * @param patterns The start of the patterns.
+ * @param end The end of the patterns (exclusive).
+ * @param id The identifier to match.
+ * @return Nonzero if any pattern matches.
+ */
+static int test_glob_any(const char *patterns, const char *end,
+                         const char *id) {
+    const char *separator;
+    while (patterns < end) {
+        separator = patterns;
+        while (separator < end && *separator != ':') {
+            separator++;
+        }
+        if (test_glob(patterns, separator, id)) {
+            return 1;
+        }
+        patterns = separator + 1;
+    }
+    return 0;
+}
+
+/** The duration of a test recorded in the history file. */
+struct test_timing {
+    const char *id;  /**< Identifier of the test. */
+    double ns;       /**< Wall time of its setup, body, and teardown. */
+    int fresh;       /**< Whether the identifier was allocated by this run. */
+};
+
+/** Contents of the history file, into which the loaded timings point. */
+static char *test_history_file = NULL;
+/* The timings of the history file, sorted by identifier, followed by those of
+ * tests that it did not know. */
+static struct test_timing *test_timings = NULL;
+static unsigned long test_timing_count = 0;
+static unsigned long test_timing_capacity = 0;
+static unsigned long test_timing_sorted = 0;
+/** The estimated duration of tests missing from the history file. */
+static double test_timing_default = 1;
+
+/**
+ * Comparison function for qsort and bsearch, ordering timings by identifier.
+ */
+static int test_compare_timing(const void *a, const void *b) {
+    return strcmp(((const struct test_timing *) a)->id,
+                  ((const struct test_timing *) b)->id);
+}
+
+/**
+ * Read the whole of the specified file, which is closed.
+ *
+ * @param file The file to read.
+ * @return The contents of the file, NUL-terminated, to be freed by the caller,
+ *         or NULL if the file could not be read or memory allocated.
+ */
+static char *test_read_text(FILE *file) {
+    char *contents = NULL;
+    long size;
+
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0
+        && fseek(file, 0, SEEK_SET) == 0
+        && (contents = (char *) malloc((size_t) size + 1)) != NULL) {
+        contents[fread(contents, 1, (size_t) size, file)] = '\0';
+    }
+    fclose(file);
+    return contents;
+}
+
+/**
+ * Release the timings of the history.
+ */
+static void test_history_release(void) {
+    unsigned long i;
+    for (i = 0; i < test_timing_count; i++) {
+        if (test_timings[i].fresh) {
+            free((char *) test_timings[i].id);
+        }
+    }
+    free(test_timings);
+    free(test_history_file);
+    test_timings = NULL;
+    test_history_file = NULL;
+    test_timing_count = test_timing_capacity = test_timing_sorted = 0;
+}
+
+/**
+ * Give up on the history of the test run, which could not be read or kept in
+ * memory.  The tests are run without it, in their usual order, and the history
+ * file is left as it is.
+ *
+ * @param problem What went wrong, to be reported.
+ */
+static _TEST_COLD void test_history_drop(const char *problem) {
+    fprintf(stderr, "%s test history %s, which is left as it is."
+            _TEST_NEWLINE, problem, test_options.history);
+    test_history_release();
+    test_options.history = NULL;
+}
+
+/**
+ * Add a timing to the end of the history, growing it geometrically.  If memory
+ * cannot be allocated, the history is dropped.
+ *
+ * @return The timing, to be filled in by the caller, or NULL if the history
+ *         was dropped.
+ */
+static struct test_timing *test_history_append(void) {
+    struct test_timing *grown;
+    unsigned long capacity = test_timing_capacity * 2 + 64;
+
+    if (test_timing_count == test_timing_capacity) {
+        grown = (struct test_timing *) realloc(test_timings,
+                                               capacity * sizeof(*grown));
+        if (grown == NULL) {
+            test_history_drop("Not enough memory for");
+            return NULL;
+        }
+        test_timings = grown;
+        test_timing_capacity = capacity;
+    }
+    return &test_timings[test_timing_count++];
+}
+
+/**
+ * Load the history file named in the options, if any.  Each line of the file
+ * that does not begin with <code>#</code> records the duration of one test as
+ * tab-separated fields: its identifier and its wall time in nanoseconds.  Tests
+ * that are missing from the history are estimated to take as long as the
+ * median test in it.  A missing file is not an error, as it is created by the
+ * first run that uses it, but a file that cannot be read is reported, and the
+ * tests run in their usual order.
+ */
+static void test_history_load(void) {
+    struct test_timing *entry;
+    double *durations;
+    char *line, *field;
+    FILE *file;
+    unsigned long i;
+
+    if (test_options.history == NULL
+        || (file = fopen(test_options.history, "rb")) == NULL) {
+        return;
+    } else if ((test_history_file = test_read_text(file)) == NULL) {
+        test_history_drop("Could not read");
+        return;
+    }
+
+    for (line = strtok(test_history_file, "\r\n"); line != NULL;
+         line = strtok(NULL, "\r\n")) {
+        if (*line == '#' || (field = strchr(line, '\t')) == NULL) {
+            continue;
+        } else if ((entry = test_history_append()) == NULL) {
+            return;
+        }
+        *field++ = '\0';
+        entry->id = line;
+        entry->ns = strtod(field, NULL);
+        entry->fresh = 0;
+    }
+    test_timing_sorted = test_timing_count;
+    if (test_timing_count == 0) {
+        return;
+    }
+    qsort(test_timings, test_timing_count, sizeof(*test_timings),
+          test_compare_timing);
+
+    if ((durations = (double *) malloc(test_timing_count
+                                       * sizeof(*durations)))
+        != NULL) {
+        for (i = 0; i < test_timing_count; i++) {
+            durations[i] = test_timings[i].ns;
+        }
+        qsort(durations, test_timing_count, sizeof(*durations),
+              test_compare_double);
+        test_timing_default = durations[test_timing_count / 2];
+        free(durations);
+    }
+}
+
+/**
+ * Find the timing of the test with the specified identifier in the history
+ * file.
+ *
+ * @param id The identifier of the test.
+ * @return The timing of the test, or NULL if the history does not know it.
+ */
+static struct test_timing *test_history_find(const char *id) {
+    struct test_timing key;
+    key.id = id;
+    return test_timing_sorted == 0 ? NULL
+           : (struct test_timing *) bsearch(&key, test_timings,
+                                            test_timing_sorted,
+                                            sizeof(*test_timings),
+                                            test_compare_timing);
+}
+
+/**
+ * Estimate how long the specified test will take to run from the history.
+ *
+ * @param test_case The test whose duration to estimate.
+ * @return The estimated duration of the test in nanoseconds.
+ */
+static double test_history_estimate(const struct test_case *test_case) {
+    const struct test_timing *timing;
+    char id[512];
+    test_identify(test_case, id, sizeof(id));
+    timing = test_history_find(id);
+    return timing != NULL ? timing->ns : test_timing_default;
+}
+
+/**
+ * Record the duration of a test in the history, to be saved at the end of the
+ * test run.  Tests that did not finish, such as those whose worker crashed or
+ * whose suite could not be set up, have no duration and keep their estimate.
+ *
+ * @param id The identifier of the test.
+ * @param ns The wall time of its setup, body, and teardown.
+ */
+static void test_history_record(const char *id, double ns) {
+    struct test_timing *timing;
+    char *copy;
+
+    if (test_options.history == NULL || ns <= 0) {
+        return;
+    } else if ((timing = test_history_find(id)) != NULL) {
+        timing->ns = ns;
+        return;
+    } else if ((copy = (char *) malloc(strlen(id) + 1)) == NULL) {
+        test_history_drop("Not enough memory for");
+        return;
+    } else if ((timing = test_history_append()) == NULL) {
+        free(copy);
+        return;
+    }
+    timing->id = strcpy(copy, id);
+    timing->ns = ns;
+    timing->fresh = 1;
+}
+
+/**
+ * Save the timings of the history, both those loaded and those recorded by
+ * this test run, to the history file, and release them.  Tests that were not
+ * run keep their previous durations, so that filtered runs do not erase the
+ * history of the tests they leave out.  Shards only read the history, since
+ * each must split the tests from the same one; merging their reports saves it.
+ */
+static void test_history_save(void) {
+    FILE *file;
+    unsigned long i;
+
+    if (test_options.history != NULL
+        && (test_options.shard_count == 0 || test_options.merge != NULL)) {
+        if ((file = fopen(test_options.history, "w")) == NULL) {
+            fprintf(stderr, "Could not write test history %s." _TEST_NEWLINE,
+                    test_options.history);
+        } else {
+            fprintf(file, "# test.h duration history: id, duration (ns)\n");
+            for (i = 0; i < test_timing_count; i++) {
+                fprintf(file, "%s\t%.0f\n", test_timings[i].id,
+                        test_timings[i].ns);
+            }
+            fclose(file);
+        }
+    }
+    test_history_release();
+}
+
+/* The tests that failed in the last run, read from the file of failed tests
+ * and sorted by identifier, and whether each has been run again since. */
+static char *test_last_failed_file = NULL;
+static char **test_last_failed = NULL;
+static unsigned char *test_last_failed_run = NULL;
+static unsigned long test_last_failed_count = 0;
+/* The tests that have failed in this run. */
+static char **test_now_failed = NULL;
+static unsigned long test_now_failed_count = 0;
+static unsigned long test_now_failed_capacity = 0;
+
+/**
+ * Comparison function for qsort and bsearch, ordering identifiers.
+ */
+static int test_compare_id(const void *a, const void *b) {
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+/**
+ * Read the file of failed tests, which lists the identifier of one test on
+ * each line.  A missing file lists no tests.
+ *
+ * @param ids Output parameter for a heap-allocated array of the identifiers,
+ *            sorted, to be freed by the caller, or NULL if there are none.
+ * @param contents Output parameter for the contents of the file, into which
+ *                 the identifiers point, to be freed by the caller.
+ * @param count Output parameter for the number of identifiers.
+ * @return Nonzero on success, or 0 if the file could not be read or memory
+ *         allocated.
+ */
+static int test_failed_read(char ***ids, char **contents,
+                            unsigned long *count) {
+    unsigned long capacity = 0;
+    char **grown, *line;
+    FILE *file;
+
+    *ids = NULL;
+    *contents = NULL;
+    *count = 0;
+    if ((file = fopen(test_options.failed_file, "rb")) == NULL) {
+        return 1;
+    } else if ((*contents = test_read_text(file)) == NULL) {
+        return 0;
+    }
+
+    for (line = strtok(*contents, "\r\n"); line != NULL;
+         line = strtok(NULL, "\r\n")) {
+        if (*count == capacity) {
+            capacity = capacity * 2 + 64;
+            if ((grown = (char **) realloc(*ids, capacity * sizeof(*grown)))
+                == NULL) {
+                free(*ids);
+                free(*contents);
+                *ids = NULL;
+                *contents = NULL;
+                *count = 0;
+                return 0;
+            }
+            *ids = grown;
+        }
+        (*ids)[(*count)++] = line;
+    }
+    if (*ids != NULL) {
+        qsort(*ids, *count, sizeof(**ids), test_compare_id);
+    }
+    return 1;
+}
+
+/**
+ * Release the tests that failed, in the last run and in this one, and forget
+ * the file of failed tests.
+ */
+static void test_last_failed_release(void) {
+    unsigned long i;
+    for (i = 0; i < test_now_failed_count; i++) {
+        free(test_now_failed[i]);
+    }
+    free(test_now_failed);
+    free(test_last_failed);
+    free(test_last_failed_run);
+    free(test_last_failed_file);
+    test_now_failed = test_last_failed = NULL;
+    test_last_failed_run = NULL;
+    test_last_failed_file = NULL;
+    test_now_failed_count = test_now_failed_capacity = 0;
+    test_last_failed_count = 0;
+    test_options.failed_file = NULL;
+}
+
+/**
+ * Give up on the file of failed tests, which could not be read or whose tests
+ * could not be kept in memory.  Every test is run, in its usual order, and the
+ * file is left as it is.
+ *
+ * @param problem What went wrong, to be reported.
+ */
+static _TEST_COLD void test_last_failed_drop(const char *problem) {
+    fprintf(stderr, "%s failed tests %s, which are left as they are."
+            _TEST_NEWLINE, problem, test_options.failed_file);
+    test_last_failed_release();
+    test_options.last_failed = test_options.failed_first = 0;
+}
+
+/**
+ * Load the tests that failed in the last run from the file of failed tests, if
+ * any.  If none did, every test is run even with <code>--last-failed</code>,
+ * which is then usually what is wanted after all.
+ */
+static void test_last_failed_load(void) {
+    if (test_options.failed_file != NULL) {
+        if (!test_failed_read(&test_last_failed, &test_last_failed_file,
+                              &test_last_failed_count)) {
+            test_last_failed_drop("Could not read");
+        } else if ((test_last_failed_run = (unsigned char *)
+                    calloc(test_last_failed_count + 1, 1)) == NULL) {
+            test_last_failed_drop("Not enough memory for");
+        }
+    }
+    if (test_last_failed_count == 0) {
+        test_options.last_failed = test_options.failed_first = 0;
+    }
+}
+
+/**
+ * Find the test with the specified identifier among those that failed in the
+ * last run.
+ *
+ * @param id The identifier of the test.
+ * @return The index of the test among those that failed, or -1 if it did not
+ *         fail.
+ */
+static long test_last_failed_find(const char *id) {
+    char **found = test_last_failed_count == 0 ? NULL
+                   : (char **) bsearch(&id, test_last_failed,
+                                       test_last_failed_count,
+                                       sizeof(*test_last_failed),
+                                       test_compare_id);
+    return found != NULL ? found - test_last_failed : -1;
+}
+
+/**
+ * Record the outcome of a test in the history and among the tests that failed,
+ * to be saved at the end of the test run.
+ *
+ * @param result The outcome of the test.
+ */
+static void test_remember(const struct test_result *result) {
+    unsigned long capacity = test_now_failed_capacity * 2 + 64;
+    char id[512], **grown, *copy;
+    long last;
+
+    if (test_options.history == NULL && test_options.failed_file == NULL) {
+        return;
+    }
+    test_identify(result->test_case, id, sizeof(id));
+    test_history_record(id, (double) (result->setup_ns + result->body_ns
+                                      + result->teardown_ns));
+    if (test_options.failed_file == NULL) {
+        return;
+    } else if ((last = test_last_failed_find(id)) >= 0) {
+        test_last_failed_run[last] = 1;
+    }
+    if (result->status != TEST_FAILED && result->status != TEST_TIMED_OUT) {
+        return;
+    } else if (test_now_failed_count == test_now_failed_capacity) {
+        if ((grown = (char **) realloc(test_now_failed,
+                                       capacity * sizeof(*grown))) == NULL) {
+            test_last_failed_drop("Not enough memory for");
+            return;
+        }
+        test_now_failed = grown;
+        test_now_failed_capacity = capacity;
+    }
+    if ((copy = (char *) malloc(strlen(id) + 1)) == NULL) {
+        test_last_failed_drop("Not enough memory for");
+        return;
+    }
+    test_now_failed[test_now_failed_count++] = strcpy(copy, id);
+}
+
+/**
+ * Save the tests that failed to the file of failed tests, and release them.
+ * The file is read afresh, so that the tests of other translation units that
+ * have saved theirs in the meantime are kept, as are those that this run left
+ * out, until they are run again.  If it cannot be read, it is left as it is.
+ */
+static void test_last_failed_save(void) {
+    char **previous, *contents, *id;
+    unsigned long count, i;
+    FILE *file;
+    long last;
+
+    if (test_options.failed_file == NULL) {
+        return;
+    } else if (!test_failed_read(&previous, &contents, &count)) {
+        test_last_failed_drop("Could not read");
+        return;
+    }
+    if (test_now_failed_count > 0) {
+        qsort(test_now_failed, test_now_failed_count,
+              sizeof(*test_now_failed), test_compare_id);
+    }
+    if (count > 0 || test_now_failed_count > 0) {
+        if ((file = fopen(test_options.failed_file, "w")) != NULL) {
+            for (i = 0; i < count; i++) {
+                id = previous[i];
+                last = test_last_failed_find(id);
+                if ((last < 0 || !test_last_failed_run[last])
+                    && (test_now_failed_count == 0
+                        || bsearch(&id, test_now_failed,
+                                   test_now_failed_count,
+                                   sizeof(*test_now_failed),
+                                   test_compare_id) == NULL)) {
+                    fprintf(file, "%s\n", id);
+                }
+            }
+            for (i = 0; i < test_now_failed_count; i++) {
+                fprintf(file, "%s\n", test_now_failed[i]);
+            }
+            fclose(file);
+        }
+    }
+
+    free(previous);
+    free(contents);
+    test_last_failed_release();
+}
+
+/**
+ * Determine the shard to which the test with the specified identifier belongs,
+ * by its 32-bit FNV-1a hash.  The identifiers of parameterised cases contain
+ * their line numbers, so each case is assigned separately, and the assignment
+ * of a test never changes as other tests come and go.
+ *
+ * @param id The identifier of the test.
+ * @return The index of the shard of the test.
+ */
+static unsigned long test_shard(const char *id) {
+    unsigned long hash = 2166136261UL;
+
+    for (; *id != '\0'; id++) {
+        hash = ((hash ^ (unsigned char) *id) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash % test_options.shard_count;
+}
+
+/**
+ * Determine whether the specified test is selected by the filter of the test
+ * run.  Like Google Test, the filter is a colon-separated list of positive
+ * patterns optionally followed by a <code>-</code> and a colon-separated list
+ * of negative patterns; a test is selected if its identifier matches any
+ * positive pattern (or there are none) and no negative pattern.  When only the
+ * tests that failed in the last run are to be run, and when the tests are
+ * split into shards by their hashes, the tests are further narrowed down to
+ * those that failed and those of the shard of the test run.  Tests that are
+ * not selected are never set up, run, or reported.
+ *
+ * @param test_case The test to check.
+ * @return Nonzero if the test should be run.
+ */
+static int test_selected(const struct test_case *test_case) {
+    const char *filter = test_options.filter, *negative;
+    char id[512];
+
+    if ((filter == NULL || *filter == '\0') && test_options.shard_count == 0
+        && !test_options.last_failed) {
+        return 1;
+    }
+    test_identify(test_case, id, sizeof(id));
+    if (test_options.last_failed && test_last_failed_find(id) < 0) {
+        return 0;
+    } else if (test_options.shard_count > 0 && test_options.history == NULL
+        && test_shard(id) != test_options.shard_index) {
+        return 0;
+    } else if (filter == NULL || *filter == '\0') {
+        return 1;
+    }
+    negative = strchr(filter, '-');
+    if (negative == NULL) {
+        negative = filter + strlen(filter);
+    }
+    return (negative == filter || test_glob_any(filter, negative, id))
+           && (*negative == '\0'
+               || !test_glob_any(negative + 1, negative + strlen(negative),
+                                 id));
+}
+
+/**
+ * Comparison function for qsort, ordering tests by their declaration order
+ * within their translation units, the units being kept in an order fixed when
+ * the test binary is linked, and the cases of a table-driven test by row.
+ */
+static int test_compare_sequence(const void *a, const void *b) {
+    const struct test_case *case_a = *(const struct test_case *const *) a;
+    const struct test_case *case_b = *(const struct test_case *const *) b;
+    size_t unit_a = (size_t) case_a->unit, unit_b = (size_t) case_b->unit;
+    unsigned long row_a, row_b;
+    if (unit_a != unit_b) {
+        return (unit_a > unit_b) - (unit_a < unit_b);
+    } else if (case_a->sequence != case_b->sequence) {
+        return (case_a->sequence > case_b->sequence)
+               - (case_a->sequence < case_b->sequence);
+    }
+    /* The cases of the rows of a table share the sequence of the table. */
+    row_a = (case_a->flags & _TEST_ROW)
+            ? ((const struct test_row *) case_a)->index : 0;
+    row_b = (case_b->flags & _TEST_ROW)
+            ? ((const struct test_row *) case_b)->index : 0;
+    return (row_a > row_b) - (row_a < row_b);
+}
+
+/** A test and its estimated duration, for scheduling. */
+struct test_estimate {
+    const struct test_case *test_case;  /**< The test. */
+    double ns;                          /**< Its estimated duration. */
+};
+
+/**
+ * Comparison function for qsort, ordering tests longest first, and tests of
+ * the same length by their declaration order.
+ */
+static int test_compare_estimate(const void *a, const void *b) {
+    const struct test_estimate *estimate_a = (const struct test_estimate *) a;
+    const struct test_estimate *estimate_b = (const struct test_estimate *) b;
+    if (estimate_a->ns != estimate_b->ns) {
+        return estimate_a->ns < estimate_b->ns ? 1 : -1;
+    }
+    return test_compare_sequence(&estimate_a->test_case,
+                                 &estimate_b->test_case);
+}
+
+/**
+ * Estimate the durations of the specified tests from the history and sort
+ * them longest first.
+ *
+ * @param tests The tests to estimate.
+ * @param count The number of tests.
+ * @return A heap-allocated array of the estimates of the tests, longest first,
+ *         to be freed by the caller, or NULL if it could not be allocated.
+ */
+static struct test_estimate *test_estimate(const struct test_case **tests,
+                                           unsigned long count) {
+    struct test_estimate *estimates;
+    unsigned long i;
+
+    if ((estimates = (struct test_estimate *) malloc(
+             (count > 0 ? count : 1) * sizeof(*estimates)))
+        == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < count; i++) {
+        estimates[i].test_case = tests[i];
+        estimates[i].ns = test_history_estimate(tests[i]);
+    }
+    qsort(estimates, count, sizeof(*estimates), test_compare_estimate);
+    return estimates;
+}
+
+/**
+ * Split the specified tests, which are in declaration order, into shards of
+ * about equal duration, longest processing time first: each test in turn,
+ * longest first, is assigned to the shard with the least work so far.  Every
+ * shard makes the same assignment from the same history, so each test is run
+ * by exactly one shard.  Only the tests of the shard of the test run are kept,
+ * in declaration order.
  *
- * #pragma FIXTURE_END
+ * @param tests The tests to split.
+ * @param count The number of tests.
+ * @return The number of tests kept.
+ */
+static unsigned long test_shard_by_duration(const struct test_case **tests,
+                                            unsigned long count) {
+    struct test_estimate *estimates;
+    unsigned long kept = 0, shard, i, j;
+    double *loads;
+
+    estimates = test_estimate(tests, count);
+    loads = (double *) calloc(test_options.shard_count, sizeof(*loads));
+    if (estimates == NULL || loads == NULL) {
+        fputs("Could not allocate the shards of the test run." _TEST_NEWLINE,
+              stderr);
+        exit(1);
+    }
+    for (i = 0; i < count; i++) {
+        for (shard = 0, j = 1; j < test_options.shard_count; j++) {
+            if (loads[j] < loads[shard]) {
+                shard = j;
+            }
+        }
+        loads[shard] += estimates[i].ns;
+        if (shard == test_options.shard_index) {
+            tests[kept++] = estimates[i].test_case;
+        }
+    }
+    qsort(tests, kept, sizeof(*tests), test_compare_sequence);
+    free(estimates);
+    free(loads);
+    return kept;
+}
+
+/* Whether the runner of this translation unit runs the specified test: in a
+ * test binary built from several units, the runner of the implementation unit
+ * runs those of every unit. */
+#ifdef TEST_MULTI_UNIT
+#define _TEST_RUNS(TEST_CASE) 1
+#else
+#define _TEST_RUNS(TEST_CASE) ((TEST_CASE)->unit == &test_unit)
+#endif
+
+/** Whether the registry holds tests run by the runners of other units. */
+static int test_other_runners = 0;
+
+/** The cases of a table-driven test, expanded from its rows by the runner. */
+struct test_expansion {
+    struct test_expansion *next;  /**< The next table expanded. */
+    char *contents;               /**< The data in the file, or NULL. */
+    unsigned long size;           /**< The size of the contents. */
+    struct test_row *rows;        /**< The cases of the rows of the table. */
+};
+
+/** The tables expanded by the runner, most recently expanded first. */
+static struct test_expansion *test_expansions = NULL;
+
+/**
+ * Map the specified file into memory, or read it where files cannot be mapped.
  *
- * #pragma TEST_START
+ * @param path The path of the file.
+ * @param size Output parameter for the size of the file.
+ * @return The contents of the file, to be released with
+ *         <code>test_unmap_file</code>, or NULL if it could not be read.
+ */
+static char *test_map_file(const char *path, unsigned long *size) {
+#ifdef _TEST_FORK
+    struct stat status;
+    void *contents;
+    int file = open(path, O_RDONLY);
+
+    if (file < 0) {
+        return NULL;
+    } else if (fstat(file, &status) != 0) {
+        close(file);
+        return NULL;
+    }
+    *size = (unsigned long) status.st_size;
+    contents = *size > 0 ? mmap(NULL, *size, PROT_READ, MAP_PRIVATE, file, 0)
+                         : (void *) "";
+    close(file);
+    return contents != MAP_FAILED ? (char *) contents : NULL;
+#else
+    FILE *file = fopen(path, "rb");
+    char *contents = NULL;
+    long length;
+
+    if (file == NULL) {
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0
+        && fseek(file, 0, SEEK_SET) == 0
+        && (contents = malloc((size_t) length + 1)) != NULL) {
+        *size = (unsigned long) fread(contents, 1, (size_t) length, file);
+    }
+    fclose(file);
+    return contents;
+#endif
+}
+
+/**
+ * Release the contents of a file returned by <code>test_map_file</code>.
  *
- * PTEST(String_length, Param_fixture) {
- *     ASSERT_EQ(strlen(T_ message), T_ length);
- * }
+ * @param contents The contents of the file.
+ * @param size The size of the file.
+ */
+static void test_unmap_file(char *contents, unsigned long size) {
+#ifdef _TEST_FORK
+    if (size > 0) {
+        munmap(contents, size);
+    }
+#else
+    (void) size;
+    free(contents);
+#endif
+}
+
+/**
+ * Find the non-blank lines of the specified contents of a data file, less any
+ * carriage returns that end them.
  *
- * PCASE(String_length, Param_fixture) { T_ message = "Hi!"; T_ length = 3; }
- * PCASE(String_length, Param_fixture) { T_ message = "Hello"; T_ length = 5; }
- * PCASE(String_length, Param_fixture) { T_ message = "Salve!"; T_ length = 6; }
+ * @param contents The contents of the file.
+ * @param size The size of the contents.
+ * @param rows Output parameter for the lines, which are not stored if NULL.
+ * @return The number of non-blank lines.
+ */
+static unsigned long test_split_lines(const char *contents,
+                                      unsigned long size,
+                                      struct test_row *rows) {
+    unsigned long count = 0, start, end, length;
+    for (start = 0; start < size; start = end + 1) {
+        for (end = start; end < size && contents[end] != '\n'; end++) {
+        }
+        length = end - start;
+        if (length > 0 && contents[end - 1] == '\r') {
+            length--;
+        }
+        if (length > 0 && rows != NULL) {
+            rows[count].line = contents + start;
+            rows[count].length = length;
+        }
+        count += length > 0;
+    }
+    return count;
+}
+
+/**
+ * Expand the specified table-driven test into a case for each of the rows of
+ * its table, named after the index of the row.  A test whose data file cannot
+ * be read is expanded into a single case with its own name, which fails.
  *
- * #pragma TEST_END
- * @endcode
+ * @param table_case The table-driven test to expand.
+ * @param count Output parameter for the number of cases.
+ * @return The cases of the rows of the test.
+ */
+static struct test_row *test_expand(const struct test_case *table_case,
+                                    unsigned long *count) {
+    const struct test_table *table = table_case->table;
+    struct test_expansion *expansion;
+    unsigned long size = 0, row;
+    char *contents = NULL, *name;
+    size_t name_size = strlen(table_case->name) + 24;
+
+    if (table->path == NULL) {
+        *count = table->rows;
+    } else if ((contents = test_map_file(table->path, &size)) == NULL) {
+        *count = 1;
+    } else {
+        *count = test_split_lines(contents, size, NULL);
+    }
+    expansion = (struct test_expansion *) malloc(sizeof(*expansion));
+    if (expansion == NULL
+        || (expansion->rows = (struct test_row *) malloc(
+                *count * (sizeof(struct test_row) + name_size) + 1)) == NULL) {
+        fputs("Could not allocate the rows of the test run." _TEST_NEWLINE,
+              stderr);
+        exit(1);
+    }
+    expansion->contents = contents;
+    expansion->size = size;
+    expansion->next = test_expansions;
+    test_expansions = expansion;
+
+    /* The names of the cases follow the cases themselves. */
+    name = (char *) (expansion->rows + *count);
+    for (row = 0; row < *count; row++) {
+        expansion->rows[row].test_case = *table_case;
+        expansion->rows[row].test_case.flags |= _TEST_ROW;
+        expansion->rows[row].index = row;
+        expansion->rows[row].line = NULL;
+        expansion->rows[row].length = 0;
+        if (table->path == NULL || contents != NULL) {
+            sprintf(name, "%s[%lu]", table_case->name, row);
+            expansion->rows[row].test_case.name = name;
+            name += strlen(name) + 1;
+        }
+    }
+    if (contents != NULL) {
+        test_split_lines(contents, size, expansion->rows);
+    }
+    return expansion->rows;
+}
+
+/** Release the cases of the table-driven tests expanded by the runner. */
+static void test_release_expansions(void) {
+    struct test_expansion *expansion;
+    while ((expansion = test_expansions) != NULL) {
+        test_expansions = expansion->next;
+        if (expansion->contents != NULL) {
+            test_unmap_file(expansion->contents, expansion->size);
+        }
+        free(expansion->rows);
+        free(expansion);
+    }
+}
+
+/**
+ * Add the specified test to the specified collection of tests if it is
+ * selected by the filter of the test run.  Table-driven tests are first
+ * expanded into the cases of their rows, which are selected individually.
+ *
+ * @param test_case The test to add.
+ * @param tests The collected tests, grown as needed.
+ * @param found The number of tests collected.
+ * @param capacity The number of tests for which there is room.
+ */
+static void test_collect_case(const struct test_case *test_case,
+                              const struct test_case ***tests,
+                              unsigned long *found, unsigned long *capacity) {
+    const struct test_case **grown;
+    struct test_row *rows = NULL;
+    unsigned long count = 1, i;
+
+    if (test_case->table != NULL) {
+        rows = test_expand(test_case, &count);
+    }
+    for (i = 0; i < count; i++) {
+        if (rows != NULL) {
+            test_case = &rows[i].test_case;
+        }
+        if (!test_selected(test_case)) {
+            continue;
+        } else if (*found == *capacity) {
+            *capacity = *capacity > 0 ? 2 * *capacity : 64;
+            if ((grown = (const struct test_case **) realloc(
+                     *tests, *capacity * sizeof(*grown)))
+                == NULL) {
+                fputs("Could not allocate the tests of the test run."
+                      _TEST_NEWLINE, stderr);
+                exit(1);
+            }
+            *tests = grown;
+        }
+        (*tests)[(*found)++] = test_case;
+    }
+}
+
+/**
+ * Collect the tests run by this translation unit that are selected by the
+ * filter of the test run from the registry, in declaration order, expanding
+ * table-driven tests into the cases of their rows.
+ *
+ * @param count Output parameter for the number of tests collected.
+ * @return A heap-allocated array of the collected tests, to be freed by the
+ *         caller, or NULL if there are no tests to run.
+ */
+static const struct test_case **test_collect(unsigned long *count) {
+    const struct test_case **tests = NULL;
+    unsigned long found = 0, capacity = 0;
+#ifdef _TEST_LINKER_REGISTRY
+    const struct test_case *const *entry;
+#else
+    struct test_node *node;
+#endif
+
+    /* The registry may hold tests from other translation units, which are run
+     * by their own runners unless they share this one. */
+#ifdef _TEST_LINKER_REGISTRY
+    for (entry = __start_test_h_cases; entry < __stop_test_h_cases; entry++) {
+        if (*entry != NULL && !_TEST_RUNS(*entry)) {
+            test_other_runners = 1;
+        } else if (*entry != NULL) {
+            test_collect_case(*entry, &tests, &found, &capacity);
+        }
+    }
+#else
+    for (node = test_registry; node != NULL; node = node->next) {
+        if (_TEST_RUNS(node->test_case)) {
+            test_collect_case(node->test_case, &tests, &found, &capacity);
+        }
+    }
+#endif
+
+    qsort(tests, found, sizeof(*tests), test_compare_sequence);
+    if (test_options.shard_count > 0 && test_options.history != NULL) {
+        found = test_shard_by_duration(tests, found);
+    }
+    *count = found;
+    return tests;
+}
+
+/**
+ * Shuffle the specified tests into an order determined by the seed of the test
+ * run, with the Fisher-Yates shuffle driven by a 32-bit xorshift generator, so
+ * that the same seed always gives the same order.
+ *
+ * @param tests The tests to shuffle.
+ * @param count The number of tests.
+ */
+static void test_shuffle(const struct test_case **tests, unsigned long count) {
+    unsigned long state = test_options.seed ^ 0x9E3779B9UL, i, j;
+    const struct test_case *swap;
+
+    if (state == 0) {
+        state = 1;
+    }
+    for (i = count; i > 1; i--) {
+        state ^= (state << 13) & 0xFFFFFFFFUL;
+        state ^= state >> 17;
+        state ^= (state << 5) & 0xFFFFFFFFUL;
+        j = state % i;
+        swap = tests[i - 1];
+        tests[i - 1] = tests[j];
+        tests[j] = swap;
+    }
+}
+
+/**
+ * Move the tests among those specified that failed in the last run to the
+ * front, keeping the order of the tests that failed and of those that did not.
+ *
+ * @param tests The tests to reorder.
+ * @param count The number of tests.
+ */
+static void test_failed_first(const struct test_case **tests,
+                              unsigned long count) {
+    const struct test_case *failed;
+    unsigned long first = 0, i;
+    char id[512];
+
+    for (i = 0; i < count; i++) {
+        test_identify(tests[i], id, sizeof(id));
+        if (test_last_failed_find(id) >= 0) {
+            failed = tests[i];
+            memmove(tests + first + 1, tests + first,
+                    (i - first) * sizeof(*tests));
+            tests[first++] = failed;
+        }
+    }
+}
+
+#ifdef _TEST_FORK
+/**
+ * Order the specified tests longest first by their estimated durations, so
+ * that a pool of workers claiming them in turn finishes at about the same
+ * time, rather than one worker being left with a long test at the end.
+ *
+ * @param tests The tests to order.
+ * @param count The number of tests.
+ */
+static void test_schedule(const struct test_case **tests,
+                          unsigned long count) {
+    struct test_estimate *estimates;
+    unsigned long i;
+
+    if ((estimates = test_estimate(tests, count)) != NULL) {
+        for (i = 0; i < count; i++) {
+            tests[i] = estimates[i].test_case;
+        }
+        free(estimates);
+    }
+}
+#endif
+
+/**
+ * Add the specified test status to the totals of the test run.
+ *
+ * @param status The final status of a test.
+ */
+static void test_tally(enum test_status status) {
+    switch (status) {
+        case TEST_PASSED: test_passed_tests++; break;
+        case TEST_SKIPPED: test_skipped_tests++; break;
+        default: test_failed_tests++; break;
+    }
+}
+
+/** The shared state of a fixture in this process, and its lifecycle. */
+struct test_suite {
+    const struct test_fixture *fixture;  /**< The fixture of the suite. */
+    void *shared;                        /**< The shared state, or NULL. */
+    int active;                          /**< Whether the suite is set up. */
+    unsigned long remaining;             /**< Tests of the suite left to run. */
+    enum test_status status;             /**< Outcome of the suite setup. */
+    char message[_TEST_MAX_FAILURE_LENGTH];  /**< Skip or failure message. */
+};
+
+/* The suites of the fixtures of the test run, in order of first appearance. */
+static struct test_suite *test_suites = NULL;
+static unsigned long test_suite_count = 0;
+
+/**
+ * Find the suite of the specified fixture.  Tests are grouped by fixture, so
+ * the suite of the previous lookup is tried first.
+ *
+ * @param fixture The fixture whose suite to find.
+ * @return The suite of the fixture, or NULL if it has none.
+ */
+static struct test_suite *test_suite_find(const struct test_fixture *fixture) {
+    static unsigned long last = 0;
+    unsigned long i;
+    if (last < test_suite_count && test_suites[last].fixture == fixture) {
+        return &test_suites[last];
+    }
+    for (i = 0; i < test_suite_count; i++) {
+        if (test_suites[i].fixture == fixture) {
+            last = i;
+            return &test_suites[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Reorder the specified tests, which are in declaration order, so that the
+ * tests of each fixture are run together, in order of the first test of each
+ * fixture, and create the suites of the fixtures.  Grouping lets each suite be
+ * torn down as soon as its last test has run.
+ *
+ * @param tests The tests to group.
+ * @param count The number of tests.
+ * @return Nonzero on success, or 0 if memory could not be allocated.
+ */
+static int test_group(const struct test_case **tests, unsigned long count) {
+    const struct test_case **grouped;
+    unsigned long *offsets, i;
+    struct test_suite *suite;
+
+    test_suites = (struct test_suite *) calloc(count > 0 ? count : 1,
+                                               sizeof(*test_suites));
+    grouped = (const struct test_case **) malloc((count > 0 ? count : 1)
+                                                 * sizeof(*grouped));
+    if (test_suites == NULL || grouped == NULL) {
+        free(grouped);
+        return 0;
+    }
+
+    /* Count the tests of each fixture, then place the tests of each fixture
+     * after those of the fixtures that appeared before it. */
+    for (i = 0; i < count; i++) {
+        if ((suite = test_suite_find(tests[i]->fixture)) == NULL) {
+            suite = &test_suites[test_suite_count++];
+            suite->fixture = tests[i]->fixture;
+        }
+        suite->remaining++;
+    }
+    offsets = (unsigned long *) malloc((test_suite_count + 1)
+                                       * sizeof(*offsets));
+    if (offsets == NULL) {
+        free(grouped);
+        return 0;
+    }
+    offsets[0] = 0;
+    for (i = 0; i < test_suite_count; i++) {
+        offsets[i + 1] = offsets[i] + test_suites[i].remaining;
+        test_suites[i].remaining = 0;
+    }
+    for (i = 0; i < count; i++) {
+        grouped[offsets[test_suite_find(tests[i]->fixture) - test_suites]++] =
+                tests[i];
+    }
+    memcpy(tests, grouped, count * sizeof(*tests));
+    free(offsets);
+    free(grouped);
+    return 1;
+}
+
+/**
+ * Set up the specified suite, allocating its shared state and running its
+ * suite setup function.  The outcome of the setup is recorded so that it can
+ * be reported for each test of the suite, the first failed check of a failed
+ * setup being described by its message.
+ *
+ * @param suite The suite to set up.
+ */
+static void test_suite_setup(struct test_suite *suite) {
+    const struct test_fixture *fixture = suite->fixture;
+    const struct test_failure *failure;
+    suite->active = 1;
+    suite->status = TEST_PASSED;
+    if (*fixture->shared_size > 0
+        && (suite->shared = calloc(1, *fixture->shared_size)) == NULL) {
+        strcpy(suite->message, "Could not allocate the shared state of the "
+               "fixture.");
+        suite->status = TEST_FAILED;
+        return;
+    }
+    if (*fixture->suite_setup != NULL) {
+        test_reset_failures();
+        test_last_status = TEST_PASSED;
+        (*fixture->suite_setup)(suite->shared);
+        suite->status = test_last_status;
+        if (test_failure_count > 0) {
+            failure = test_failures;
+            snprintf(suite->message, sizeof(suite->message), "Suite setup "
+                     "failed! %s (Value 1: %s, Value 2: %s) at %s:%u",
+                     failure->expression, test_failure_text + failure->value_1,
+                     test_failure_text + failure->value_2, failure->file,
+                     failure->line);
+            suite->message[sizeof(suite->message) - 1] = '\0';
+        } else {
+            strcpy(suite->message, test_failure_message);
+        }
+    }
+}
+
+/**
+ * Tear down the specified suite if it is set up, running its suite teardown
+ * function and releasing its shared state.
+ *
+ * @param suite The suite to tear down.
+ */
+static void test_suite_teardown(struct test_suite *suite) {
+    if (!suite->active) {
+        return;
+    }
+    if (*suite->fixture->suite_teardown != NULL) {
+        (*suite->fixture->suite_teardown)(suite->shared);
+    }
+    free(suite->shared);
+    suite->shared = NULL;
+    suite->active = 0;
+}
+
+/**
+ * Run the specified test within the suite of its fixture, setting the suite up
+ * first if this is its first test.  If the suite setup did not pass, the test
+ * is not run, and takes on the outcome of the suite setup instead.
+ *
+ * @param test_case The test to run.
+ * @param result Output parameter for the outcome of the test.
+ */
+static void test_run_in_suite(const struct test_case *test_case,
+                              struct test_result *result) {
+    struct test_suite *suite = test_suite_find(test_case->fixture);
+    if (!suite->active) {
+        test_suite_setup(suite);
+    }
+    if (suite->status == TEST_PASSED) {
+        test_run(test_case, suite->shared, result);
+        return;
+    }
+    test_reset_failures();
+    strcpy(test_failure_message, suite->message);
+    test_last_benchmark.measured = test_last_benchmark.compared = 0;
+    test_last_threads.measured = 0;
+    test_latency_count = 0;
+    memset(result, 0, sizeof(*result));
+    result->test_case = test_case;
+    result->status = suite->status;
+}
+
+/* A description of the compiler used to build the test suite, recorded in
+ * benchmark baselines alongside the host on which they were measured. */
+#if defined(__clang__)
+#define _TEST_COMPILER "clang " __clang_version__
+#elif defined(__GNUC__)
+#define _TEST_COMPILER "gcc " __VERSION__
+#elif defined(_MSC_VER)
+#define _TEST_COMPILER "msvc " _TEST_STRINGIFY(_MSC_VER)
+#else
+#define _TEST_COMPILER "unknown compiler"
+#endif
+
+/* Critical value of the Mann-Whitney test statistic above which a benchmark
+ * is deemed to be slower than its baseline (one-sided, p < 0.01). */
+#define _TEST_BASELINE_CRITICAL_Z 2.326
+
+/** The measurements of a benchmark recorded in a baseline file. */
+struct test_baseline {
+    const char *id;            /**< Identifier of the benchmark. */
+    const char *tag;           /**< Build and host on which it was measured. */
+    const char *samples;       /**< Unparsed ns/op of each repetition. */
+};
+
+/** Contents of the baseline file, into which the baseline entries point. */
+static char *test_baseline_file = NULL;
+/** Benchmarks recorded in the baseline file. */
+static struct test_baseline *test_baselines = NULL;
+/** The number of benchmarks recorded in the baseline file. */
+static unsigned long test_baseline_count = 0;
+/** File to which benchmark results are being saved, once opened. */
+static FILE *test_baseline_output = NULL;
+/** The build and host tag of this test run. */
+static char test_baseline_tag[256];
+
+/**
+ * Determine the tag identifying the build and host of this test run, which is
+ * recorded in saved baselines, unless one was specified in the options.
+ */
+static void test_baseline_identify(void) {
+    char host[128] = "unknown host";
+    const char *name;
+
+    if (test_options.bench_tag != NULL) {
+        name = test_options.bench_tag;
+    } else {
+#if defined(_TEST_FORK)
+        if (gethostname(host, sizeof(host)) != 0) {
+            strcpy(host, "unknown host");
+        }
+        host[sizeof(host) - 1] = '\0';
+#elif defined(_WIN32)
+        if ((name = getenv("COMPUTERNAME")) != NULL) {
+            strncpy(host, name, sizeof(host) - 1);
+        }
+#endif
+        sprintf(test_baseline_tag, "%.127s, ", host);
+        name = _TEST_COMPILER;
+    }
+    strncat(test_baseline_tag, name,
+            sizeof(test_baseline_tag) - strlen(test_baseline_tag) - 1);
+}
+
+/**
+ * Load the benchmark baseline file named in the options, if any.  Each line of
+ * the file that does not begin with <code>#</code> records one benchmark as
+ * tab-separated fields: its identifier, the tag of the run that measured it,
+ * its median, mean and standard deviation in ns/op, its iteration count, and
+ * its repetitions in ns/op.  A missing file is reported but not fatal, so that
+ * a baseline can be saved on the first run of a new benchmark suite.
+ */
+static void test_baseline_load(void) {
+    struct test_baseline *entry;
+    char *line, *field;
+    FILE *file;
+    long size;
+    int i;
+
+    if (test_options.bench_baseline == NULL) {
+        return;
+    } else if ((file = fopen(test_options.bench_baseline, "rb")) == NULL) {
+        fprintf(stderr, "Could not read benchmark baseline %s." _TEST_NEWLINE,
+                test_options.bench_baseline);
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    test_baseline_file = (char *) malloc(size + 1);
+    test_baseline_file[fread(test_baseline_file, 1, size, file)] = '\0';
+    fclose(file);
+
+    for (line = strtok(test_baseline_file, "\r\n"); line != NULL;
+         line = strtok(NULL, "\r\n")) {
+        if (*line == '#') {
+            continue;
+        }
+        test_baselines = (struct test_baseline *) realloc(test_baselines,
+            (test_baseline_count + 1) * sizeof(struct test_baseline));
+        entry = &test_baselines[test_baseline_count];
+        entry->id = entry->tag = entry->samples = NULL;
+        /* Split off the identifier, tag, and the three statistics and
+         * iteration count, which are not needed for the comparison. */
+        for (i = 0, field = line; i < 6 && field != NULL; i++) {
+            if (i == 0) {
+                entry->id = field;
+            } else if (i == 1) {
+                entry->tag = field;
+            }
+            if ((field = strchr(field, '\t')) != NULL) {
+                *field++ = '\0';
+            }
+        }
+        if ((entry->samples = field) != NULL) {
+            test_baseline_count++;
+        }
+    }
+}
+
+/**
+ * Open the baseline file to be saved, if one is to be saved and it is not open
+ * yet, and write its header.  The file is opened by the runner before any
+ * benchmark is run by a worker process, so that every worker appends to it.
+ */
+static void test_baseline_open(void) {
+    if (test_options.bench_save == NULL || test_baseline_output != NULL) {
+        return;
+    } else if ((test_baseline_output = fopen(test_options.bench_save, "w"))
+               == NULL) {
+        fprintf(stderr, "Could not write benchmark baseline %s."
+                _TEST_NEWLINE, test_options.bench_save);
+        test_options.bench_save = NULL;
+        return;
+    }
+    fprintf(test_baseline_output, "# test.h benchmark baseline: "
+            "id, tag, median, mean, stddev (ns/op), iterations, "
+            "repetitions (ns/op)\n");
+    fflush(test_baseline_output);
+    test_baseline_identify();
+}
+
+/**
+ * Append the measurements of the last benchmark run to the baseline file being
+ * saved, opening it first if necessary.  Each entry is written out at once, as
+ * a worker process ends without flushing its streams.
+ *
+ * @param id The identifier of the benchmark.
+ */
+static void test_baseline_save(const char *id) {
+    const struct test_benchmark *benchmark = &test_last_benchmark;
+    unsigned long i;
+
+    test_baseline_open();
+    if (test_baseline_output == NULL) {
+        return;
+    }
+
+    fprintf(test_baseline_output, "%s\t%s\t%.17g\t%.17g\t%.17g\t%lu", id,
+            test_baseline_tag, benchmark->median, benchmark->mean,
+            benchmark->stddev, benchmark->iterations);
+    for (i = 0; i < benchmark->repetitions; i++) {
+        fprintf(test_baseline_output, "\t%.17g", benchmark->samples[i]);
+    }
+    fputc('\n', test_baseline_output);
+    fflush(test_baseline_output);
+}
+
+/**
+ * Compare the last benchmark run against its entry in the baseline file, if
+ * any, using a one-sided Mann-Whitney U test on the repetitions of the two.
+ * The benchmark is deemed to have regressed if it is significantly slower than
+ * the baseline and its median is slower by more than the threshold of the test
+ * run.  The outcome of the comparison is recorded with the benchmark's
+ * measurements, to be printed by the reporters.
+ *
+ * @param id The identifier of the benchmark.
+ * @return <code>TEST_FAILED</code> if the benchmark regressed, or
+ *         <code>TEST_PASSED</code> otherwise.
+ */
+static enum test_status test_baseline_compare(const char *id) {
+    struct test_benchmark *benchmark = &test_last_benchmark;
+    double samples[_TEST_MAX_REPETITIONS], median, u = 0, mean;
+    const struct test_baseline *entry = NULL;
+    unsigned long count = 0, i, j;
+    const char *field;
+    char *end;
+
+    for (i = 0; i < test_baseline_count && entry == NULL; i++) {
+        if (strcmp(test_baselines[i].id, id) == 0) {
+            entry = &test_baselines[i];
+        }
+    }
+    if (entry == NULL) {
+        return TEST_PASSED;
+    }
+    for (field = entry->samples; count < _TEST_MAX_REPETITIONS; field = end) {
+        samples[count] = strtod(field, &end);
+        if (end == field) {
+            break;
+        }
+        count++;
+    }
+    if (count == 0) {
+        return TEST_PASSED;
+    }
+
+    /* U counts the pairs of repetitions in which this run was slower, with
+     * ties counting as half; under the null hypothesis, it is approximately
+     * normally distributed for all but the smallest sample sizes. */
+    for (i = 0; i < benchmark->repetitions; i++) {
+        for (j = 0; j < count; j++) {
+            u += benchmark->samples[i] > samples[j] ? 1
+                 : benchmark->samples[i] == samples[j] ? 0.5 : 0;
+        }
+    }
+    mean = benchmark->repetitions * count / 2.0;
+    benchmark->z = (u - mean)
+                   / test_sqrt(benchmark->repetitions * count
+                               * (benchmark->repetitions + count + 1) / 12.0);
+
+    qsort(samples, count, sizeof(double), test_compare_double);
+    median = count % 2 ? samples[count / 2]
+             : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    benchmark->compared = 1;
+    benchmark->baseline_median = median;
+    benchmark->baseline_tag = entry->tag;
+    benchmark->change = median > 0
+                        ? (benchmark->median - median) / median * 100 : 0;
+
+    if (benchmark->z > _TEST_BASELINE_CRITICAL_Z
+        && benchmark->change > test_options.bench_threshold) {
+        sprintf(test_failure_message, "Benchmark regressed beyond the %.1f%% "
+                "threshold of its baseline.", test_options.bench_threshold);
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+/**
+ * Save the measurements of the benchmark just run to the baseline file and
+ * compare them with its baseline, if it was measured and passed.
+ *
+ * @param result The outcome of the benchmark, which fails if it regressed.
+ */
+static void test_baseline_check(struct test_result *result) {
+    char id[512];
+    if (test_last_benchmark.measured && result->status == TEST_PASSED) {
+        test_identify(result->test_case, id, sizeof(id));
+        test_baseline_save(id);
+        result->status = test_baseline_compare(id);
+    }
+}
+
+#ifdef _TEST_FORK
+
+/* Status of a test in the shared work queue that has not yet completed. */
+#define _TEST_PENDING 0xFF
+
+/* Whether this process is a worker, which must not print a summary even if a
+ * test calls exit(). */
+static int test_in_worker = 0;
+
+/* The outcome of the test being run by this worker, in the shared queue. */
+static struct test_result *test_worker_result;
+
+/** The work queue shared between the runner and its worker processes. */
+struct test_queue {
+    unsigned long first;          /**< Index of the first test of the queue. */
+    unsigned long next;           /**< Index of the next test to claim. */
+    unsigned long *current;       /**< Test being run by each worker. */
+    struct test_result *results;  /**< Outcome of each test. */
+};
+
+/**
+ * End this worker once its test has overrun its timeout, recording the timeout
+ * as the outcome of the test for the runner to report, and writing out the
+ * records of the tests that the worker completed before it.  Called by the
+ * watchdog's signal handler, so it does nothing that the test may have been
+ * interrupted in the middle of.
+ */
+static void test_worker_expire(void) {
+    struct test_result *result = test_worker_result;
+    result->setup_ns = result->teardown_ns = result->cpu_ns = 0;
+    result->body_ns = test_clock_ns() - test_watchdog_start;
+    result->allocations = result->allocated_bytes = 0;
+    result->counted = 0;
+    result->timeout_ns = test_watchdog_timeout;
+    result->status = TEST_TIMED_OUT;
+    test_write_committed();
+    _exit(0);
+}
+
+/**
+ * Body of a worker process: claim tests from the shared queue until none
+ * remain before the specified limit, which is the end of the run of tests of
+ * the fixture whose suite the runner set up for this worker.  Workers simply
+ * take the next unclaimed test whenever they become idle, so long-running
+ * tests never hold up a statically-assigned share of the suite.  A worker whose
+ * test times out ends there, since the interrupted test may have been holding
+ * a lock or left its state inconsistent, and is replaced by a fresh one.  Never
+ * returns.
  *
- * Note that the data for a parameterised test should be defined in a
- * corresponding fixture.  Note further that <code>PCASE</code> directives
- * should follow the corresponding <code>PTEST</code> directive, and that both
- * <code>PTEST</code> and <code>PCASE</code> directives must be inside a
- * <code>TEST_START</code>, <code>TEST_END</code> block.
+ * @param queue The shared work queue.
+ * @param worker The index of this worker.
+ * @param tests The tests to run.
+ * @param limit The index after the last test that the worker may claim.
  */
-#define PTEST(NAME, FIXTURE)                                               \
-    /* Simply allow the user to define the function, but do not run it. */ \
-    static void FIXTURE ## _ ## NAME ## _test(                             \
-            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED)
+static void test_worker(struct test_queue *queue, unsigned long worker,
+                        const struct test_case **tests, unsigned long limit) {
+    unsigned long index;
+    test_in_worker = 1;
+    test_output_chunk = _TEST_ATOMIC_CHUNK;
+    test_watchdog_expire = test_worker_expire;
+    while ((index = _TEST_ATOMIC_READ(queue->next)) < limit) {
+        if (!__sync_bool_compare_and_swap(&queue->next, index, index + 1)) {
+            continue;
+        }
+        queue->current[worker] = index;
+        test_worker_result = &queue->results[index - queue->first];
+        test_report_start(tests[index]);
+        test_run_in_suite(tests[index], test_worker_result);
+        test_baseline_check(test_worker_result);
+        test_report(test_worker_result, index);
+    }
+    test_drain_all();
+    _exit(0);
+}
 
-#define PCASE(NAME, FIXTURE)                                                  \
-    /* Forward declare the case setup function. */                            \
-    static void                                                               \
-    _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_setup_, __LINE__)(       \
-            struct FIXTURE ## _fixture_data *);                               \
-    /* Declare the combined fixture/case setup function. */                   \
-    static void                                                               \
-    _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_setup_reg_, __LINE__)(   \
-            struct FIXTURE ## _fixture_data *TEST) {                          \
-        FIXTURE ## _fixture_setup(TEST);                                      \
-        _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_setup_, __LINE__)    \
-                (TEST);                                                       \
-    }                                                                         \
-    /* Test runner: calls the parameterised test with the combined setup. */  \
-    static int _TEST_RUNNER                                                   \
-    _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _test_run_, __LINE__)(void) {  \
-        test_run(#NAME " (L" _TEST_LINE_STR ")",                              \
-                 (test_fn_t) _TEST_TOKEN_CONCAT(                              \
-                         FIXTURE ## _ ## NAME ## _case_setup_reg_, __LINE__), \
-                 (test_fn_t) FIXTURE ## _ ## NAME ## _test,                   \
-                 (test_fn_t) FIXTURE ## _fixture_teardown,                    \
-                 sizeof(struct FIXTURE ## _fixture_data));                    \
-        return 0;                                                             \
-    }                                                                         \
-    /* Make the test function run on Windows. */                              \
-    _TEST_EPILOGUE(                                                           \
-            _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _test_run_, __LINE__), \
-            _TEST_TEST_SECTION)                                               \
-    /* At last, the user-declared case setup function. */                     \
-    static void                                                               \
-    _TEST_TOKEN_CONCAT(FIXTURE ## _ ## NAME ## _case_setup_, __LINE__)(       \
-            struct FIXTURE ## _fixture_data *TEST _TEST_UNUSED)
+/**
+ * Report the failure of a test whose worker process terminated abnormally
+ * before the test could complete.
+ *
+ * @param result The outcome of the test, which is marked as failed.
+ * @param index The index of the test in the test run.
+ * @param wait_status The status of the worker as reported by waitpid().
+ */
+static void test_report_crash(struct test_result *result, unsigned long index,
+                              int wait_status) {
+    test_reset_failures();
+    if (WIFSIGNALED(wait_status)) {
+        sprintf(test_failure_message, "Test crashed! Worker terminated by "
+                "signal %d.", WTERMSIG(wait_status));
+    } else {
+        sprintf(test_failure_message, "Test crashed! Worker exited with "
+                "status %d.", WEXITSTATUS(wait_status));
+    }
+    test_last_benchmark.measured = test_last_threads.measured = 0;
+    test_latency_count = 0;
+    result->status = TEST_FAILED;
+    test_report(result, index);
+    /* The test never finished, so it has no duration for the history. */
+    result->setup_ns = result->body_ns = result->teardown_ns = 0;
+}
 
 /**
- * Skip the test in whose body this directive appears and print a skipped status
- * and the specified message in the test status report if the specified
- * condition holds true.  Explanation messages are required for all skipped
- * tests in order to enforce proper testing discipline.  This directive may
- * appear anywhere within the body of a test; if the condition holds true, all
- * assertions from that point forth will not be run.  Furthermore, skipped tests
- * will not be counted toward the total test count printed in the test report.
- * Example:
+ * Report a test whose worker process ended because the test overran its
+ * timeout, as recorded by the worker.
  *
- * @code{.c}
- * TEST(Conditionally_skipped_test, Some_fixture) {
- *     SKIP_IF(time(NULL) == -1, "Time functions not available");
- *     // Code that requires time here...
- * }
- * @endcode
+ * @param result The outcome of the test.
+ * @param index The index of the test in the test run.
  */
-#define SKIP_IF(CONDITION, MESSAGE)                \
-    do {                                           \
-        if (CONDITION) {                           \
-            strcpy(test_failure_message, MESSAGE); \
-            test_last_status = TEST_SKIPPED;       \
-            return;                                \
-        }                                          \
-    } while (0)
+static void test_report_timeout(const struct test_result *result,
+                                unsigned long index) {
+    test_reset_failures();
+    sprintf(test_failure_message, "Test timed out after %lu ms.",
+            (unsigned long) (result->timeout_ns / 1000000));
+    test_last_benchmark.measured = test_last_threads.measured = 0;
+    test_latency_count = 0;
+    test_report(result, index);
+}
 
 /**
- * Unconditional version of the <code>SKIP_IF</code> directive.  Immediately
- * skips the remainder of the test in whose body the directive appears.
- * Example:
+ * Fork a worker to run the tests of the run of consecutive tests of one
+ * fixture that holds the specified test, the next unclaimed test of the queue,
+ * setting up the suite of the fixture first if none of its tests has been
+ * dispatched yet, so that the worker inherits its shared state.
  *
- * @code{.c}
- * TEST(Skipped_test, Some_fixture) {
- *     SKIP("Bug #1: Faulty assertion");
- *     // Fix this!
- *     ASSERT_TRUE(0);
- * }
- * @endcode
+ * @param queue The shared work queue.
+ * @param worker The index of the worker.
+ * @param tests The tests of the test run.
+ * @param index The index of the next unclaimed test.
+ * @param count The index after the last test of the queue.
+ * @param limit Output parameter for the index after the last test of the run
+ *              of tests that the worker may claim.
+ * @return The process ID of the worker, or -1 if it could not be forked.
+ */
+static pid_t test_dispatch(struct test_queue *queue, unsigned long worker,
+                           const struct test_case **tests, unsigned long index,
+                           unsigned long count, unsigned long *limit) {
+    struct test_suite *suite = test_suite_find(tests[index]->fixture);
+    unsigned long end = index;
+    pid_t pid;
+
+    while (end < count && tests[end]->fixture == suite->fixture) {
+        end++;
+    }
+    if (!suite->active) {
+        test_suite_setup(suite);
+    }
+    *limit = end;
+    /* Anything left in the output buffers would be written by the worker. */
+    test_drain_all();
+    fflush(NULL);
+    if ((pid = fork()) == 0) {
+        test_worker(queue, worker, tests, end);
+    }
+    return pid;
+}
+
+/**
+ * Run the specified range of tests on a pool of worker processes, merging
+ * their results into the totals of this process.  Each worker is forked from
+ * the runner, so tests in different workers cannot interfere with each other
+ * through global state, and a worker that crashes or whose test times out is
+ * replaced so that the remaining tests still run.  With a single worker, the
+ * tests are run one at a time, in order.  Each worker runs the tests of a
+ * single fixture, whose suite the runner sets up just before forking the
+ * first worker for it, and tears down once the last of its tests has
+ * completed.
  *
- * @see SKIP_IF
+ * @param tests The tests of the test run.
+ * @param first The index of the first test to run.
+ * @param count The index after the last test to run.
+ * @param jobs The number of workers.
+ * @return Nonzero if the tests were run, or 0 if the pool could not be set up.
  */
-#define SKIP(MESSAGE) SKIP_IF(1, MESSAGE)
+static int test_run_parallel(const struct test_case **tests,
+                             unsigned long first, unsigned long count,
+                             unsigned long jobs) {
+    unsigned long size, alive = 0, worker, other, start, i;
+    unsigned long *limits;
+    struct test_queue *queue;
+    struct test_suite *suite;
+    struct test_result *result;
+    pid_t *workers, pid;
+    int wait_status;
 
-/* ******************************* ASSERTIONS ******************************* */
+    if (first == count) {
+        return 1;
+    } else if (jobs > count - first) {
+        jobs = count - first;
+    }
+    size = sizeof(struct test_queue) + jobs * sizeof(unsigned long)
+           + (count - first) * sizeof(struct test_result);
+    queue = (struct test_queue *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    workers = (pid_t *) malloc(jobs * sizeof(pid_t));
+    limits = (unsigned long *) malloc(jobs * sizeof(*limits));
+    if (queue == MAP_FAILED || workers == NULL || limits == NULL) {
+        if (queue != MAP_FAILED) {
+            munmap(queue, size);
+        }
+        free(workers);
+        free(limits);
+        return 0;
+    }
+    queue->first = queue->next = first;
+    queue->results = (struct test_result *) (queue + 1);
+    queue->current = (unsigned long *) (queue->results + (count - first));
+    for (i = first; i < count; i++) {
+        queue->results[i - first].test_case = tests[i];
+        queue->results[i - first].status = (enum test_status) _TEST_PENDING;
+    }
 
-/* Run an assertion comparing two values with the specified representations and
- * printf formats according to the specified comparator, printing an error
- * containing the specified message and terminating the test on failure. */
-#define _TEST_ASSERT(A, A_REPR, A_FMT, CMP, B, B_REPR, B_FMT, MSG)           \
-    do {                                                                     \
-        if (!((A) CMP (B))) {                                                \
-            sprintf(test_failure_message,                                    \
-                    _TEST_COLOUR_FAIL "Assertion failed!" _TEST_COLOUR_RESET \
-                    " " MSG _TEST_NEWLINE                                    \
-                    _TEST_COLOUR_VALUE "    Value 1: " _TEST_COLOUR_RESET    \
-                    A_FMT _TEST_NEWLINE                                      \
-                    _TEST_COLOUR_VALUE "    Value 2: " _TEST_COLOUR_RESET    \
-                    B_FMT _TEST_NEWLINE                                      \
-                    _TEST_COLOUR_FAIL "File: " _TEST_COLOUR_RESET __FILE__   \
-                    ":%u", (A_REPR), (B_REPR), __LINE__);                    \
-            test_last_status = TEST_FAILED;                                  \
-            return;                                                          \
-        }                                                                    \
-    } while (0)
+    /* Workers beyond the size of the first fixture's run of tests end at
+     * once, and are replaced by workers for the next run. */
+    for (worker = 0; worker < jobs; worker++) {
+        queue->current[worker] = count;
+        workers[worker] = 0;
+        if ((i = _TEST_ATOMIC_READ(queue->next)) < count) {
+            workers[worker] = test_dispatch(queue, worker, tests, i, count,
+                                            &limits[worker]);
+        }
+        alive += workers[worker] > 0;
+    }
 
-/** Assert that the specified predicate evaluates to a truthy (non-0) value. */
-#define ASSERT_TRUE(PREDICATE)                                             \
-    _TEST_ASSERT(0, "TRUE (!= 0)", "%s", !=, PREDICATE, (PREDICATE), "%d", \
-            "Expression is true: (" #PREDICATE ")")
+    while (alive > 0 && (pid = waitpid(-1, &wait_status, 0)) > 0) {
+        for (worker = 0; worker < jobs; worker++) {
+            if (workers[worker] == pid) {
+                break;
+            }
+        }
+        if (worker == jobs) {
+            continue;
+        }
+        alive--;
+        workers[worker] = 0;
 
-/** Assert that the specified predicate evaluates to a falsy (0) value. */
-#define ASSERT_FALSE(PREDICATE)                                          \
-    _TEST_ASSERT(0, "FALSE (0)", "%s", ==, PREDICATE, (PREDICATE), "%d", \
-            "Expression is false: (" #PREDICATE ")")
+        /* If the worker ended mid-test, report that test as timed out or
+         * crashed.  Either way, replace the worker if there is still work to
+         * be done. */
+        i = queue->current[worker];
+        result = i < count ? &queue->results[i - first] : NULL;
+        if (result != NULL && result->status == TEST_TIMED_OUT
+            && WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 0) {
+            test_report_timeout(result, i);
+        } else if ((!WIFEXITED(wait_status) || WEXITSTATUS(wait_status) != 0)
+                   && result != NULL
+                   && result->status == (enum test_status) _TEST_PENDING) {
+            test_report_crash(result, i, wait_status);
+        }
+        queue->current[worker] = count;
 
-/** Assert that the specified pointer is null (0). */
-#define ASSERT_NULL(PTR)                                         \
-    _TEST_ASSERT(NULL, "NULL (0x0)", "%s", ==, PTR, (PTR), "%p", \
-            "Pointer is non-null: (" #PTR ")")
+        /* Once every test of the worker's run of tests has been claimed and
+         * no other worker is still running one, the run is complete, and the
+         * suite is torn down if it has no tests left to run. */
+        for (other = 0; other < jobs; other++) {
+            if (workers[other] > 0 && limits[other] == limits[worker]) {
+                break;
+            }
+        }
+        i = _TEST_ATOMIC_READ(queue->next);
+        if (other == jobs && i >= limits[worker]) {
+            start = limits[worker] - 1;
+            while (start > first
+                   && tests[start - 1]->fixture == tests[start]->fixture) {
+                start--;
+            }
+            suite = test_suite_find(tests[start]->fixture);
+            suite->remaining -= limits[worker] - start;
+            if (suite->remaining == 0) {
+                test_suite_teardown(suite);
+            }
+        }
+        if (i < count) {
+            workers[worker] = test_dispatch(queue, worker, tests, i, count,
+                                            &limits[worker]);
+            alive += workers[worker] > 0;
+        }
+    }
 
-/** Assert that the specified pointer is non-null (non-0). */
-#define ASSERT_NON_NULL(PTR)                                            \
-    _TEST_ASSERT(NULL, "Non-null (!= 0x0)", "%s", !=, PTR, (PTR), "%p", \
-            "Pointer is null: (" #PTR ")")
+    for (i = first; i < count; i++) {
+        result = &queue->results[i - first];
+        if (result->status == (enum test_status) _TEST_PENDING) {
+            result->status = TEST_FAILED;
+        }
+        test_tally(result->status);
+        test_remember(result);
+    }
+    munmap(queue, size);
+    free(workers);
+    free(limits);
+    return 1;
+}
+
+#endif // _TEST_FORK
 
 /**
- * Assert that the first specified value is equal to the second specified value.
- * Values will be printed in the specified format.
+ * Add a reporter writing to the specified stream to the test run.  Output to a
+ * terminal is written as soon as each test completes; other output is written
+ * in large chunks, and the console report is stripped of colours and of the
+ * start markers that would otherwise be overwritten.
+ *
+ * @param reporter The format of the report.
+ * @param stream The stream to which to write the report.
  */
-#define ASSERT_EQ(VALUE_1, VALUE_2, FORMAT)                                  \
-    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, ==, VALUE_2, (VALUE_2), FORMAT, \
-            "(" #VALUE_1 ") == (" #VALUE_2 ")")
+static void test_add_reporter(const struct test_reporter *reporter,
+                              FILE *stream) {
+    struct test_report_stream *report = &test_reporters[test_reporter_count++];
+    report->reporter = reporter;
+    report->stream = stream;
+    report->interactive = _TEST_ISATTY(stream);
+    report->plain = reporter == &test_reporter_table[0]
+                    && (test_options.colour == -1 ? !report->interactive
+                        : !test_options.colour);
+}
 
 /**
- * Assert that the first specified value is not equal to the second specified
- * value.  Values will be printed in the specified format.
+ * Select the reporters of the test run and open the streams to which they
+ * write.  A report written to a file is accompanied by the console report on
+ * standard output.
  */
-#define ASSERT_NE(VALUE_1, VALUE_2, FORMAT)                                  \
-    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, !=, VALUE_2, (VALUE_2), FORMAT, \
-            "(" #VALUE_1 ") != (" #VALUE_2 ")")
+static void test_select_reporters(void) {
+    const struct test_reporter *reporter = NULL;
+    FILE *stream = stdout;
+    unsigned long i;
+
+    for (i = 0; i < sizeof(test_reporter_table) / sizeof(*test_reporter_table);
+         i++) {
+        if (strcmp(test_reporter_table[i].name, test_options.reporter) == 0) {
+            reporter = &test_reporter_table[i];
+        }
+    }
+    if (reporter == NULL) {
+        fprintf(stderr, "Unknown reporter %s." _TEST_NEWLINE,
+                test_options.reporter);
+        exit(1);
+    }
+
+    if (test_options.output != NULL) {
+        if ((stream = fopen(test_options.output, "w")) == NULL) {
+            fprintf(stderr, "Could not write report to %s." _TEST_NEWLINE,
+                    test_options.output);
+            exit(1);
+        }
+        /* Unbuffered, each chunk of records is written with a single system
+         * call, so that records from parallel workers are never interleaved. */
+        setvbuf(stream, NULL, _IONBF, 0);
+        if (reporter != &test_reporter_table[0]) {
+            test_add_reporter(&test_reporter_table[0], stdout);
+        }
+    }
+    test_add_reporter(reporter, stream);
+}
 
 /**
- * Assert that the first specified value is greater than the second specified
- * value.  Values will be printed in the specified format.
+ * Record the duration of the test of the specified JSON Lines record in the
+ * history.  The identifiers of tests are C identifiers, so their names need no
+ * unescaping.
+ *
+ * @param record The record, from just after its index.
  */
-#define ASSERT_GT(VALUE_1, VALUE_2, FORMAT)                                 \
-    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, >, VALUE_2, (VALUE_2), FORMAT, \
-            "(" #VALUE_1 ") > (" #VALUE_2 ")")
+static void test_merge_history(const char *record) {
+    static const char *const fields[] = {
+        "\"setup_ns\":", "\"body_ns\":", "\"teardown_ns\":"
+    };
+    char fixture[256], name[256], id[512];
+    const char *field;
+    double ns = 0;
+    unsigned i;
+
+    if (test_options.history == NULL
+        || sscanf(record, ",\"fixture\":\"%255[^\"]\",\"name\":"
+                  "\"%255[^\"]\"", fixture, name) != 2) {
+        return;
+    }
+    for (i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+        if ((field = strstr(record, fields[i])) != NULL) {
+            ns += strtod(field + strlen(fields[i]), NULL);
+        }
+    }
+    sprintf(id, "%s.%s", fixture, name);
+    test_history_record(id, ns);
+}
 
 /**
- * Assert that the first specified value is greater than or equal to the second
- * specified value.  Values will be printed in the specified format.
+ * Merge the JSON Lines reports of the shards of a test run, given after the
+ * <code>--merge</code> option, into a single report of the whole run, written
+ * to the output of the test run.  The tests are renumbered in the order of the
+ * reports and their totals recounted, as though all of them had been run by a
+ * single process.  Reports that cannot be read or that do not end, as those of
+ * shards that crashed, and shards that are missing from a sharded run make the
+ * merged run fail.  The durations of the tests are recorded in the history
+ * file of the test run, if any, which the shards themselves leave unchanged.
+ *
+ * @return The exit status of the merge: 0 if every test passed or was skipped,
+ *         or 1 otherwise.
  */
-#define ASSERT_GE(VALUE_1, VALUE_2, FORMAT)                                  \
-    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, >=, VALUE_2, (VALUE_2), FORMAT, \
-            "(" #VALUE_1 ") >= (" #VALUE_2 ")")
+static int test_merge(void) {
+    static const char begin_prefix[] = "{\"event\":\"begin\"";
+    static const char end_prefix[] = "{\"event\":\"end\"";
+    static const char test_prefix[] = "{\"event\":\"test\",\"index\":";
+    unsigned long tests = 0, index = 0, count, shard, shards = 0, i;
+    unsigned long passed = 0, failed = 0, skipped = 0;
+    char **reports, *line, *rest, *status;
+    unsigned char *seen = NULL;
+    FILE *file, *output = stdout;
+    int complete = 1, ended, fields;
+    long size;
+
+    reports = (char **) calloc(test_options.merge_count + 1,
+                               sizeof(*reports));
+    test_history_load();
+    if (test_options.output != NULL
+        && (output = fopen(test_options.output, "w")) == NULL) {
+        fprintf(stderr, "Could not write report to %s." _TEST_NEWLINE,
+                test_options.output);
+        exit(1);
+    }
+
+    /* Read every report up front, as the merged report starts with the total
+     * number of tests. */
+    for (i = 0; reports != NULL && i < (unsigned long) test_options.merge_count;
+         i++) {
+        if ((file = fopen(test_options.merge[i], "rb")) == NULL) {
+            fprintf(stderr, "Could not read report %s." _TEST_NEWLINE,
+                    test_options.merge[i]);
+            complete = 0;
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (size >= 0 && (reports[i] = (char *) malloc(size + 1)) != NULL) {
+            reports[i][fread(reports[i], 1, size, file)] = '\0';
+        }
+        fclose(file);
+        if (reports[i] == NULL) {
+            continue;
+        }
+
+        fields = sscanf(reports[i], "{\"event\":\"begin\",\"tests\":%lu,"
+                        "\"shard\":%lu,\"shards\":%lu", &count, &shard,
+                        &shards);
+        tests += fields >= 1 ? count : 0;
+        if (fields == 3 && seen == NULL && shards > 0) {
+            seen = (unsigned char *) calloc(shards, 1);
+        }
+        if (fields == 3 && seen != NULL && shard < shards) {
+            seen[shard] = 1;
+        }
+    }
+    for (shard = 0; seen != NULL && shard < shards; shard++) {
+        if (!seen[shard]) {
+            fprintf(stderr, "The report of shard %lu is missing."
+                    _TEST_NEWLINE, shard);
+            complete = 0;
+        }
+    }
+
+    fprintf(output, "{\"event\":\"begin\",\"tests\":%lu}\n", tests);
+    for (i = 0; reports != NULL && i < (unsigned long) test_options.merge_count;
+         i++) {
+        ended = 0;
+        for (line = reports[i] != NULL ? strtok(reports[i], "\r\n") : NULL;
+             line != NULL; line = strtok(NULL, "\r\n")) {
+            if (strncmp(line, begin_prefix, sizeof(begin_prefix) - 1) == 0) {
+                continue;
+            } else if (strncmp(line, end_prefix, sizeof(end_prefix) - 1)
+                       == 0) {
+                ended = 1;
+                continue;
+            } else if (strncmp(line, test_prefix, sizeof(test_prefix) - 1)
+                       != 0) {
+                fprintf(output, "%s\n", line);
+                continue;
+            }
+            strtoul(line + sizeof(test_prefix) - 1, &rest, 10);
+            fprintf(output, "%s%lu%s\n", test_prefix, index++, rest);
+            test_merge_history(rest);
+            status = strstr(rest, "\"status\":\"");
+            if (status == NULL) {
+                failed++;
+            } else if (strncmp(status + 10, "passed\"", 7) == 0) {
+                passed++;
+            } else if (strncmp(status + 10, "skipped\"", 8) == 0) {
+                skipped++;
+            } else {
+                failed++;
+            }
+        }
+        if (reports[i] != NULL && !ended) {
+            fprintf(stderr, "The report %s is incomplete." _TEST_NEWLINE,
+                    test_options.merge[i]);
+            complete = 0;
+        }
+        free(reports[i]);
+    }
+    fprintf(output, "{\"event\":\"end\",\"passed\":%lu,\"failed\":%lu,"
+            "\"skipped\":%lu}\n", passed, failed, skipped);
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    free(reports);
+    free(seen);
+    test_history_save();
+    return complete && failed == 0 ? 0 : 1;
+}
+
+/** Whether the end of the test run has been reported. */
+static int test_summarised = 0;
 
 /**
- * Assert that the first specified value is less than the second specified
- * value.  Values will be printed in the specified format.
+ * Report the end of the test run, and save the tests that failed for the next
+ * run.  Called by the runner once all tests have completed, and at exit should
+ * a test end the process before then by calling <code>exit()</code>.
  */
-#define ASSERT_LT(VALUE_1, VALUE_2, FORMAT)                                 \
-    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, <, VALUE_2, (VALUE_2), FORMAT, \
-            "(" #VALUE_1 ") < (" #VALUE_2 ")")
+static void test_summary(void) {
+#ifdef _TEST_FORK
+    if (test_in_worker) {
+        test_drain_all();
+        return;
+    }
+#endif
+    if (test_summarised) {
+        return;
+    }
+    test_summarised = 1;
+    test_report_end();
+    test_last_failed_save();
+}
 
+#ifdef _TEST_POSIX
 /**
- * Assert that the first specified value is less than or equal to the second
- * specified value.  Values will be printed in the specified format.
+ * Handler for signals that terminate the process, whether raised by a crashing
+ * test or sent to stop the test run: write out the complete records that the
+ * reporters have buffered, so that they are not lost along with the process,
+ * then let the signal take its default course.
+ *
+ * @param signal_number The signal received.
  */
-#define ASSERT_LE(VALUE_1, VALUE_2, FORMAT)                                  \
-    _TEST_ASSERT(VALUE_1, (VALUE_1), FORMAT, <=, VALUE_2, (VALUE_2), FORMAT, \
-            "(" #VALUE_1 ") <= (" #VALUE_2 ")")
+static void test_fatal_signal(int signal_number) {
+    test_write_committed();
+    raise(signal_number);
+}
 
 /**
- * Assert that the contents of the specified strings (<code>char *</code>) are
- * equal.  Values will be printed as strings.
+ * Install <code>test_fatal_signal</code> as the handler of signals raised by
+ * crashing tests, and of those with which a hung test run is killed, such as
+ * by a CI job timing out or by Ctrl-C.  The default handling of each signal is
+ * restored once it is received.
  */
-#define ASSERT_STREQ(STR_1, STR_2)                                            \
-    _TEST_ASSERT(strcmp((STR_1), (STR_2)), (STR_1), "\"%s\"", ==, 0, (STR_2), \
-            "\"%s\"", "(" #STR_1 ") == (" #STR_2 ")")
+static void test_handle_fatal_signals(void) {
+    static const int signals[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV,
+                                   SIGTERM, SIGINT, SIGHUP };
+    struct sigaction action;
+    unsigned i;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = test_fatal_signal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (i = 0; i < sizeof(signals) / sizeof(*signals); i++) {
+        sigaction(signals[i], &action, NULL);
+    }
+}
+#endif
 
 /**
- * Assert that the contents of the specified strings (<code>char *</code>) are
- * not equal.  Values will be printed as strings.
+ * Main entry point of the test runner.  Prints test environment information
+ * and headers, then runs every registered test once all tests are known.  Run
+ * before <code>main()</code>, after all registration functions.
  */
-#define ASSERT_STRNE(STR_1, STR_2)                                            \
-    _TEST_ASSERT(strcmp((STR_1), (STR_2)), (STR_1), "\"%s\"", !=, 0, (STR_2), \
-            "\"%s\"", "(" #STR_1 ") != (" #STR_2 ")")
+static int _TEST_RUNNER test_main(void) {
+    const struct test_case **tests;
+    struct test_result result;
+    struct test_suite *suite;
+    unsigned long count, first = 0, largest = 1, i;
+    const char *reason;
+    char id[512];
 
-/* ****************************** TEST RUNNER ******************************* */
+    test_parse_options();
+    if (test_options.merge != NULL) {
+        exit(test_merge());
+    }
+    test_history_load();
+    test_last_failed_load();
+    tests = test_collect(&count);
+    if (test_options.shuffle) {
+        test_shuffle(tests, count);
+    }
+    if (!test_group(tests, count)) {
+        fputs("Could not allocate the suites of the test run." _TEST_NEWLINE,
+              stderr);
+        exit(1);
+    }
+    /* This splits up the tests of fixtures with tests that failed, whose
+     * suites are then simply torn down later. */
+    if (test_options.failed_first) {
+        test_failed_first(tests, count);
+    }
 
-#pragma FIXTURE_START
+    /* In list mode, print the identifiers of the selected tests and exit
+     * without running anything. */
+    if (test_options.list) {
+        for (i = 0; i < count; i++) {
+            test_identify(tests[i], id, sizeof(id));
+            puts(id);
+        }
+        free(test_timings);
+        free(test_history_file);
+        free(test_last_failed);
+        free(test_last_failed_run);
+        free(test_last_failed_file);
+        free(test_suites);
+        free(tests);
+        test_release_expansions();
+        exit(0);
+    }
 
-/**
- * Print a summary of the test suite, describing the number of tests passed,
- * failed, and skipped.
- */
-static void test_summary(void) {
-    puts(_TEST_NEWLINE _TEST_COLOUR_HEADER
-         "================================= TEST SUMMARY ================================="
-         _TEST_COLOUR_RESET);
+    /* Fixture data for every test is carved from one arena, allocated up
+     * front (and inherited by any workers) so that the runner makes no
+     * allocations between tests. */
+    for (i = 0; i < count; i++) {
+        if (tests[i]->data_size > largest) {
+            largest = tests[i]->data_size;
+        }
+    }
+    if (!test_arena_reserve(largest)) {
+        fprintf(stderr, "Could not allocate %lu bytes of fixture data."
+                _TEST_NEWLINE, largest);
+        exit(1);
+    }
 
-    if (test_failed_tests == 0) {
-        printf(_TEST_COLOUR_PASS "All %lu tests passed!" _TEST_COLOUR_RESET
-               _TEST_NEWLINE, test_passed_tests);
-    } else {
-        printf(_TEST_COLOUR_PASS "Test(s) passed:" _TEST_COLOUR_RESET " %lu"
-               _TEST_NEWLINE, test_passed_tests);
-        printf(_TEST_COLOUR_FAIL "Test(s) failed:" _TEST_COLOUR_RESET " %lu"
-                                 _TEST_NEWLINE, test_failed_tests);
+    /* Hardware events may be off limits, in which case the tests are still
+     * run, but without counting them. */
+    if (test_options.counters && (reason = test_counters_open()) != NULL) {
+        fprintf(stderr, "Hardware events cannot be counted (%s)."
+                _TEST_NEWLINE, reason);
+        test_options.counters = 0;
     }
 
-    if (test_skipped_tests > 0) {
-        printf(_TEST_COLOUR_VALUE "Test(s) skipped:" _TEST_COLOUR_RESET " %lu"
-               _TEST_NEWLINE, test_skipped_tests);
+    test_passed_tests = test_failed_tests = test_skipped_tests = 0;
+    test_select_reporters();
+#ifdef _TEST_POSIX
+    test_handle_fatal_signals();
+#endif
+    test_report_begin(count);
+
+    /* Register the summary to run should a test end the process early. */
+    atexit(test_summary);
+    test_baseline_load();
+
+    /* Each suite is set up as its first test is run, and torn down once the
+     * last of its tests has run. */
+    for (i = 0; i < count; i++) {
+        test_suite_find(tests[i]->fixture)->remaining++;
     }
-}
 
+#ifdef _TEST_FORK
+    /* Tests are run by worker processes when run concurrently, or when any
+     * test may time out, so that a test that overruns its timeout, which may
+     * have been interrupted while holding a lock, ends its worker rather than
+     * hanging the runner.  Otherwise, they are run in this process, one after
+     * the other, without the cost of a fork each. */
+#ifdef _TEST_LINKER_REGISTRY
+    if (test_options.jobs > 1 || test_options.timeout_ns > 0
+        || &__start_test_h_timeouts[0] != &__stop_test_h_timeouts[0])
+#endif
+    {
+        const struct test_case *selected;
+        unsigned long serial = 0;
+
+        /* Benchmarks and threaded tests would disturb each other's
+         * measurements if run concurrently, so move them to the end of the
+         * list (preserving the order of both groups) and run them serially
+         * after the pool. */
+        for (i = 0; test_options.jobs > 1 && i < count; i++) {
+            if (tests[i]->flags & (_TEST_BENCHMARK | _TEST_THREADED)) {
+                serial++;
+            } else if (serial > 0) {
+                selected = tests[i];
+                memmove(tests + i - serial + 1, tests + i - serial,
+                        serial * sizeof(*tests));
+                tests[i - serial] = selected;
+            }
+        }
+        /* Unless shuffled or put in order of past failures, the longest tests
+         * of the pool are started first. */
+        if (test_options.jobs > 1 && test_options.history != NULL
+            && !test_options.shuffle && !test_options.failed_first) {
+            test_schedule(tests, count - serial);
+        }
+        /* Open the baseline file to be saved in this process, so that it is
+         * opened only once and shared by every worker.  Suites are set up by
+         * the pool as their first tests are dispatched. */
+        for (i = 0; i < count; i++) {
+            if ((tests[i]->flags & _TEST_BENCHMARK) && test_options.bench) {
+                test_baseline_open();
+            }
+        }
+        if (test_run_parallel(tests, 0, count - serial, test_options.jobs)) {
+            first = count - serial;
+            if (test_run_parallel(tests, first, count, 1)) {
+                first = count;
+            }
+        }
+    }
+#endif
+
+    for (i = first; i < count; i++) {
+        test_report_start(tests[i]);
+        test_run_in_suite(tests[i], &result);
+        test_baseline_check(&result);
+        test_report(&result, i);
+        test_tally(result.status);
+        test_remember(&result);
+        suite = test_suite_find(tests[i]->fixture);
+        if (--suite->remaining == 0) {
+            test_suite_teardown(suite);
+        }
+    }
+    /* Suites whose workers could not all be forked may still be set up. */
+    for (i = 0; i < test_suite_count; i++) {
+        test_suite_teardown(&test_suites[i]);
+    }
+    test_summary();
+    if (test_baseline_output != NULL) {
+        fclose(test_baseline_output);
+    }
+    free(test_baselines);
+    free(test_baseline_file);
+    test_history_save();
+    test_arena_release();
+    free(test_failures);
+    free(test_failure_text);
+    free(test_choices.bytes);
+    free(test_counterexample.bytes);
+    free(test_suites);
+    free(tests);
+    test_release_expansions();
+
+    /* If any test failed, the process exits with a status of 1 before
+     * main() is run, so that the failure is noticed by whatever ran the test
+     * binary.  exit() still runs the handlers registered with atexit() and
+     * the destructors, which write coverage data and report leaks.  That is,
+     * unless other units of the binary run their own tests, which would then
+     * not be run, as they are only brought together by TEST_MULTI_UNIT. */
+    if (test_failed_tests > 0 && !test_other_runners) {
+        exit(1);
+    }
+    return 0;
+}
+#ifdef TEST_FUZZ
 /**
- * Print test environment information and headers before test suite functions
- * are run.  Run in the fixture override stage to ensure proper execution order.
+ * Entry point for libFuzzer, which runs the test suite in place of the runner
+ * when it is built with <code>TEST_FUZZ</code> defined and
+ * <code>-fsanitize=fuzzer</code>.  Each input is run through every property
+ * selected by <code>TEST_FILTER</code> as the choices of its generators.  A
+ * property that fails on an input is reported as by the runner, and the
+ * process aborted, so that libFuzzer saves the input.
+ *
+ * @param data The input.
+ * @param size The size of the input.
+ * @return 0, as libFuzzer requires.
  */
-static int _TEST_FIXTURE_LIFECYCLE test_kickoff(void) {
-    test_passed_tests = test_failed_tests = test_skipped_tests = 0;
-    puts(_TEST_COLOUR_HEADER
-         "================================ BEGIN TEST RUN ================================"
-         _TEST_COLOUR_RESET);
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size);
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size) {
+    static const struct test_case **tests = NULL;
+    static unsigned long count = 0;
+    static int started = 0;
+    struct test_result result;
+    unsigned long largest = 1, kept = 0, i;
 
-    /* Register summary function to run after all tests have completed. */
-    atexit(test_summary);
+    if (!started) {
+        /* libFuzzer enforces timeouts of its own. */
+        test_parse_options();
+        test_options.timeout_ns = 0;
+        tests = test_collect(&count);
+        for (i = 0; i < count; i++) {
+            if (tests[i]->flags & _TEST_PROPERTY) {
+                tests[kept++] = tests[i];
+                if (tests[i]->data_size > largest) {
+                    largest = tests[i]->data_size;
+                }
+            }
+        }
+        count = kept;
+        if (!test_group(tests, count) || !test_arena_reserve(largest)) {
+            fputs("Could not allocate the properties to fuzz." _TEST_NEWLINE,
+                  stderr);
+            exit(1);
+        }
+        test_select_reporters();
+        test_report_begin(count);
+        started = 1;
+    }
+
+    test_fuzz_input = data;
+    test_fuzz_size = (unsigned long) size;
+    for (i = 0; i < count; i++) {
+        test_run_in_suite(tests[i], &result);
+        if (result.status == TEST_FAILED) {
+            test_report_start(tests[i]);
+            test_report(&result, i);
+            test_drain_all();
+            abort();
+        }
+    }
+    test_fuzz_input = NULL;
     return 0;
 }
-_TEST_EPILOGUE(test_kickoff, _TEST_FIXTURE_SECTION)
+#else
+_TEST_EPILOGUE(test_main, _TEST_RUNNER_SECTION)
+#endif
+
+#pragma _TEST_RUNNER_END
 
-#pragma FIXTURE_END
+#endif // _TEST_HAS_RUNNER
 
 #endif // TEST_H_INCLUDED